@@ -26,7 +26,7 @@ inline uint64_t run_concurrent(InitFunc initFn, Func&& fn, EndFunc endFunc, int
 
     initFn();
 
-    for (size_t i = 0; i < concurrent; ++i) {
+    for (int i = 0; i < concurrent; ++i) {
         threads.emplace_back([&, i] {
             while (!is_start.load()) {
                 ::std::this_thread::yield();
@@ -72,6 +72,32 @@ void bench_many_times(std::string name, BenchFunc&& benchFn, int ops_each_time,
     std::cout << std::endl;
 }
 
+// 输出带宽: GB/s，bytes_each_time为benchFn每次处理的字节数
+template <typename BenchFunc>
+void bench_bandwidth_many_times(std::string name, BenchFunc&& benchFn, uint64_t bytes_each_time, int times) {
+    uint64_t min = UINTMAX_MAX;
+    uint64_t max = 0;
+    uint64_t sum = 0;
+
+    for (int i = 0; i < times; i++) {
+        uint64_t cost = benchFn();
+        sum += cost;
+        max = std::max(cost, max);
+        min = std::min(cost, min);
+    }
+    uint64_t avg = sum / times;
+    std::string unit = " GB/s";
+    auto gbps = [&](uint64_t ns) {
+        return ns == 0 ? 0.0 : static_cast<double>(bytes_each_time) / ns;
+    };
+
+    // 依次是最慢、平均、最快
+    std::cout << std::left << std::setw(45) << name << std::fixed << std::setprecision(2);
+    std::cout << "    " << std::right << std::setw(6) << gbps(max) << unit;
+    std::cout << "    " << std::right << std::setw(6) << gbps(avg) << unit;
+    std::cout << "    " << std::right << std::setw(6) << gbps(min) << unit;
+    std::cout << std::defaultfloat << std::endl;
+}
 
 int32_t run_bench();
 
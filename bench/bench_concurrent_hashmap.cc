@@ -0,0 +1,618 @@
+#include <assert.h>
+#include "baidu/streaming_log.h"
+#include "base/comlog_sink.h"
+#include "base/strings/stringprintf.h"
+#include "com_log.h"
+#include "cronoapd.h"
+
+#undef DCHECK_IS_ON
+
+#include <chrono>
+#include <random>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <cmath>
+
+#include "gflags/gflags.h"
+
+#include "bench_common.h"
+#include "concurrent/concurrent_hashmap.h"
+#include "concurrent/concurrent_cache.h"
+#include "concurrent/thread_slab_allocator.h"
+
+DEFINE_int32(ops_per_thread, 1000000, "find ops per thread");
+DEFINE_int32(times, 3, "bench times");
+DEFINE_int32(threads, 4, "bench threads");
+DEFINE_string(key_counts, "1000000,100000000", "key counts of the map, separated by comma");
+DEFINE_int32(zipf_keys, 1000000, "key count of the zipfian write bench");
+DEFINE_double(zipf_theta, 0.99, "skew of the zipfian distribution");
+DEFINE_int32(write_percent, 80, "percent of writes in the zipfian write bench");
+DEFINE_int32(growth_keys, 4000000, "key count of the insert latency bench, map grows from 8 buckets");
+DEFINE_int32(string_keys, 1000000, "key count of the string key find bench");
+DEFINE_int32(multi_keys, 10000000, "key count of the multi_find bench");
+DEFINE_int32(multi_batch, 1000, "keys per multi_find call");
+DEFINE_int32(counter_keys, 100000, "key count of the counter update bench");
+DEFINE_int32(scan_keys, 50000000, "key count of the full scan bench");
+DEFINE_int32(cache_keys, 1000000, "key count of the cache hit bench");
+DEFINE_int32(churn_keys, 100000, "key count of the insert/erase churn bench");
+DEFINE_int32(teardown_keys, 10000000, "key count of the map destruction bench");
+DEFINE_string(migrate_batches, "0,8", "migrate batches of the insert latency bench, 0 means blocking rehash");
+
+// 统计bench期间的内存分配次数，数组版本也要替换，否则new[]不计数并且和delete[]不配对
+static std::atomic<uint64_t> g_alloc_count = {0};
+
+// 不能内联：gcc会把内联进来的free和标准库里的operator new配对，报-Wmismatched-new-delete
+__attribute__((noinline)) static void* counted_alloc(size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+__attribute__((noinline)) static void counted_free(void* p) noexcept {
+    free(p);
+}
+
+void* operator new(size_t size) {
+    return counted_alloc(size);
+}
+
+void* operator new[](size_t size) {
+    return counted_alloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    counted_free(p);
+}
+
+using ChainedMap = rcu::ConcurrentHashMap<uint64_t, uint64_t>;
+using SwissMap = rcu::SwissConcurrentHashMap<uint64_t, uint64_t>;
+using StripedMap = rcu::StripedConcurrentHashMap<uint64_t, uint64_t>;
+
+inline uint64_t key_of(uint64_t i) {
+    // 避免连续的key落在连续的bucket里，让cache miss接近真实场景
+    return i * 0x9E3779B97F4A7C15UL;
+}
+
+// 每个线程插入[tid * n, (tid+1) * n)
+template <typename Map>
+void insert_range(Map& map, uint64_t begin, uint64_t end) {
+    for (uint64_t i = begin; i < end; ++i) {
+        map.insert(key_of(i), i);
+    }
+}
+
+template <typename Map>
+void hashmap_insert_bench(std::string name, uint64_t key_count) {
+    uint64_t per_thread = key_count / FLAGS_threads;
+    auto benchFn = [&]() -> uint64_t {
+        std::unique_ptr<Map> map;
+        std::atomic<int> tid = {0};
+        auto initFn = [&] {
+            map.reset(new Map(key_count));
+        };
+        auto fn = [&]() {
+            uint64_t t = tid++;
+            insert_range(*map, t * per_thread, (t + 1) * per_thread);
+        };
+        auto endFn = [&] {
+            map->clear();
+        };
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, per_thread * FLAGS_threads, FLAGS_times);
+}
+
+template <typename Map>
+void hashmap_find_bench(std::string name, Map& map, uint64_t key_count) {
+    auto benchFn = [&]() -> uint64_t {
+        std::atomic<uint64_t> found = {0};
+        auto initFn = [] {};
+        auto fn = [&]() {
+            std::mt19937_64 generator(std::random_device{}());
+            uint64_t cnt = 0;
+            for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                auto iter = map.find(key_of(generator() % key_count));
+                cnt += (iter != map.cend());
+            }
+            found += cnt;
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, FLAGS_ops_per_thread * FLAGS_threads, FLAGS_times);
+}
+
+template <typename Map>
+void hashmap_erase_bench(std::string name, uint64_t key_count) {
+    uint64_t per_thread = key_count / FLAGS_threads;
+    auto benchFn = [&]() -> uint64_t {
+        std::unique_ptr<Map> map;
+        std::atomic<int> tid = {0};
+        auto initFn = [&] {
+            map.reset(new Map(key_count));
+            insert_range(*map, 0, per_thread * FLAGS_threads);
+        };
+        auto fn = [&]() {
+            uint64_t t = tid++;
+            for (uint64_t i = t * per_thread; i < (t + 1) * per_thread; ++i) {
+                map->erase(key_of(i));
+            }
+        };
+        auto endFn = [&] {
+            map->clear();
+        };
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, per_thread * FLAGS_threads, FLAGS_times);
+}
+
+template <typename Map>
+void run_map_bench(std::string prefix, uint64_t key_count) {
+    hashmap_insert_bench<Map>(prefix + "_insert_bench", key_count);
+    {
+        Map map(key_count);
+        insert_range(map, 0, key_count);
+        hashmap_find_bench(prefix + "_find_bench", map, key_count);
+        map.clear();
+    }
+    hashmap_erase_bench<Map>(prefix + "_erase_bench", key_count);
+}
+
+// 按zipf分布生成[0, n)之间的下标，0最热
+class ZipfGenerator {
+public:
+    ZipfGenerator(uint64_t n, double theta) : _cdf(n) {
+        double sum = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            sum += 1.0 / std::pow(i + 1, theta);
+            _cdf[i] = sum;
+        }
+        for (auto& v : _cdf) {
+            v /= sum;
+        }
+    }
+    template <typename G>
+    uint64_t next(G& generator) const {
+        double p = std::uniform_real_distribution<double>(0, 1)(generator);
+        return std::lower_bound(_cdf.begin(), _cdf.end(), p) - _cdf.begin();
+    }
+private:
+    std::vector<double> _cdf;
+};
+
+// 写多读少，热点key集中在少数segment和bucket上
+template <typename Map>
+void hashmap_zipf_write_bench(std::string name, const ZipfGenerator& zipf) {
+    auto benchFn = [&]() -> uint64_t {
+        Map map(FLAGS_zipf_keys);
+        insert_range(map, 0, FLAGS_zipf_keys);
+        auto initFn = [] {};
+        auto fn = [&]() {
+            std::mt19937_64 generator(std::random_device{}());
+            for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                uint64_t idx = zipf.next(generator);
+                int op = generator() % 100;
+                if (op < FLAGS_write_percent / 2) {
+                    map.insert(key_of(idx), i);
+                } else if (op < FLAGS_write_percent) {
+                    map.erase(key_of(idx));
+                } else {
+                    map.find(key_of(idx));
+                }
+            }
+        };
+        auto endFn = [] {};
+        uint64_t cost = run_concurrent(initFn, fn, endFn, FLAGS_threads);
+        map.clear();
+        return cost;
+    };
+    bench_many_times(name, benchFn, FLAGS_ops_per_thread * FLAGS_threads, FLAGS_times);
+}
+
+// 超过SSO长度，构造std::string时需要分配内存
+inline std::string string_key_of(uint64_t i) {
+    return "user_feature_slot_" + std::to_string(key_of(i));
+}
+
+// 请求里拿到的是string_view，比较三种查找方式：
+// copy: 先构造std::string再查找(原来唯一的用法)
+// view: transparent lookup，直接用string_view查找
+// hash: 调用方提前算好hash
+template <typename Map>
+void hashmap_string_find_bench(std::string name, const std::vector<std::string>& keys, int mode) {
+    Map map(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        map.insert(keys[i], i);
+    }
+    std::vector<size_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        hashes[i] = rcu::StringHash()(keys[i]);
+    }
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        auto fn = [&]() {
+            std::mt19937_64 generator(std::random_device{}());
+            uint64_t cnt = 0;
+            for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                size_t idx = generator() % keys.size();
+                std::string_view view = keys[idx];
+                if (mode == 0) {
+                    cnt += (map.find(std::string(view)) != map.cend());
+                } else if (mode == 1) {
+                    cnt += (map.find(view) != map.cend());
+                } else {
+                    cnt += (map.find(view, hashes[idx]) != map.cend());
+                }
+            }
+            assert(cnt == static_cast<uint64_t>(FLAGS_ops_per_thread));
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, FLAGS_ops_per_thread * FLAGS_threads, FLAGS_times);
+    map.clear();
+}
+
+// 模拟一个请求查multi_batch个key，逐个find和multi_find对比
+template <typename Map>
+void hashmap_multi_find_bench(std::string name, Map& map, uint64_t key_count, bool batch) {
+    int rounds = std::max(FLAGS_ops_per_thread / FLAGS_multi_batch, 1);
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        auto fn = [&]() {
+            std::mt19937_64 generator(std::random_device{}());
+            std::vector<uint64_t> keys(FLAGS_multi_batch);
+            std::vector<std::optional<uint64_t>> out;
+            uint64_t sum = 0;
+            for (int r = 0; r < rounds; ++r) {
+                for (auto& key : keys) {
+                    key = key_of(generator() % key_count);
+                }
+                if (batch) {
+                    map.multi_find(keys, out);
+                    for (auto& v : out) {
+                        sum += v ? *v : 0;
+                    }
+                } else {
+                    for (auto& key : keys) {
+                        auto iter = map.find(key);
+                        sum += iter != map.cend() ? *iter : 0;
+                    }
+                }
+            }
+            assert(sum != 0);
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, rounds * FLAGS_multi_batch * FLAGS_threads, FLAGS_times);
+}
+
+template <typename Map>
+void run_multi_find_bench(std::string prefix) {
+    Map map(FLAGS_multi_keys);
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> values;
+    for (int i = 0; i < FLAGS_multi_keys; ++i) {
+        keys.push_back(key_of(i));
+        values.push_back(i);
+    }
+    map.multi_insert(keys, values);
+    hashmap_multi_find_bench(prefix + "_find_bench", map, FLAGS_multi_keys, false);
+    hashmap_multi_find_bench(prefix + "_multi_find_bench", map, FLAGS_multi_keys, true);
+    map.clear();
+}
+
+// 计数器更新：0 find+insert(原来的写法) 1 upsert 2 fetch_add
+template <typename Map>
+void hashmap_counter_bench(std::string name, int mode) {
+    Map map(FLAGS_counter_keys);
+    for (int i = 0; i < FLAGS_counter_keys; ++i) {
+        map.insert(key_of(i), 0);
+    }
+    uint64_t alloc_before = g_alloc_count.load();
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        auto fn = [&]() {
+            std::mt19937_64 generator(std::random_device{}());
+            for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                uint64_t key = key_of(generator() % FLAGS_counter_keys);
+                if (mode == 0) {
+                    auto iter = map.find(key);
+                    map.insert(key, *iter + 1);
+                } else if (mode == 1) {
+                    map.upsert(key, [](uint64_t& v) { v++; });
+                } else {
+                    map.fetch_add(key, 1);
+                }
+            }
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, FLAGS_ops_per_thread * FLAGS_threads, FLAGS_times);
+    std::cout << name << " allocs_per_update:"
+            << double(g_alloc_count.load() - alloc_before) / FLAGS_ops_per_thread / FLAGS_threads / FLAGS_times
+            << std::endl;
+    map.clear();
+}
+
+// 全表扫描：ConstIterator单线程遍历和parallel_for_each对比
+template <typename Map>
+void hashmap_scan_bench(std::string prefix) {
+    Map map(FLAGS_scan_keys);
+    for (int i = 0; i < FLAGS_scan_keys; ++i) {
+        map.insert(key_of(i), i);
+    }
+    auto iterFn = [&]() -> uint64_t {
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t sum = 0;
+        for (auto iter = map.cbegin(); iter != map.cend(); ++iter) {
+            sum += *iter;
+        }
+        assert(sum == uint64_t(FLAGS_scan_keys) * (FLAGS_scan_keys - 1) / 2);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+    bench_many_times(prefix + "_iterator_scan_bench", iterFn, FLAGS_scan_keys, FLAGS_times);
+    auto parallelFn = [&]() -> uint64_t {
+        auto begin = std::chrono::steady_clock::now();
+        std::atomic<uint64_t> sum = {0};
+        map.parallel_for_each([&](const uint64_t&, const uint64_t& value) {
+            sum.fetch_add(value, std::memory_order_relaxed);
+        }, FLAGS_threads);
+        assert(sum == uint64_t(FLAGS_scan_keys) * (FLAGS_scan_keys - 1) / 2);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+    bench_many_times(prefix + "_parallel_scan_bench", parallelFn, FLAGS_scan_keys, FLAGS_times);
+    map.clear();
+}
+
+// 每个线程在自己的key区间里反复insert再erase，node的分配和hazptr回收都在热路径上
+template <typename Map>
+void hashmap_churn_bench(std::string name) {
+    uint64_t per_thread = FLAGS_churn_keys / FLAGS_threads;
+    Map map(FLAGS_churn_keys);
+    uint64_t alloc_before = g_alloc_count.load();
+    auto benchFn = [&]() -> uint64_t {
+        std::atomic<int> tid = {0};
+        auto initFn = [] {};
+        auto fn = [&]() {
+            uint64_t t = tid++;
+            std::mt19937_64 generator(t);
+            for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                uint64_t key = key_of(t * per_thread + generator() % per_thread);
+                map.insert(key, i);
+                map.erase(key);
+            }
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, FLAGS_ops_per_thread * FLAGS_threads, FLAGS_times);
+    std::cout << name << " operator_new_per_op:"
+            << double(g_alloc_count.load() - alloc_before) / FLAGS_ops_per_thread / FLAGS_threads / FLAGS_times
+            << std::endl;
+    map.clear();
+}
+
+// 析构整个map的耗时，按key平均。segment的node都在自己的cohort上，析构时一次扫描批量回收
+template <typename Map>
+void hashmap_teardown_bench(std::string name) {
+    uint64_t key_count = FLAGS_teardown_keys;
+    auto benchFn = [&]() -> uint64_t {
+        Map* map = new Map(key_count);
+        insert_range(*map, 0, key_count);
+        auto begin = std::chrono::steady_clock::now();
+        delete map;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    };
+    bench_many_times(name, benchFn, key_count, FLAGS_times);
+    std::cout << name << " global_retired_after_teardown:" << rcu::get_default_manager().retired_count() << std::endl;
+}
+
+// 监控场景下size()的代价：近似size()只读分片计数器，size_exact()要锁住所有segment
+template <typename Map>
+void hashmap_size_bench(std::string prefix, uint64_t key_count) {
+    Map map(key_count);
+    insert_range(map, 0, key_count);
+    for (int exact = 0; exact < 2; ++exact) {
+        auto benchFn = [&]() -> uint64_t {
+            auto begin = std::chrono::steady_clock::now();
+            uint64_t sum = 0;
+            for (int i = 0; i < 10000; ++i) {
+                sum += exact ? map.size_exact() : map.size();
+            }
+            assert(sum == key_count * 10000);
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        };
+        bench_many_times(prefix + (exact ? "_size_exact_bench" : "_size_bench"), benchFn, 10000, FLAGS_times);
+    }
+    map.clear();
+}
+
+// cache命中路径和直接find的对比，cache的上限比key数大，不会发生淘汰
+void cache_hit_bench() {
+    ChainedMap map(FLAGS_cache_keys);
+    rcu::ConcurrentCacheOptions options;
+    options.max_entries = FLAGS_cache_keys * 2;
+    options.default_ttl_ms = 3600 * 1000;
+    rcu::ConcurrentCache<uint64_t, uint64_t> cache(options);
+    for (int i = 0; i < FLAGS_cache_keys; ++i) {
+        map.insert(key_of(i), i);
+        cache.put(key_of(i), i);
+    }
+    hashmap_find_bench("chained_find_bench", map, FLAGS_cache_keys);
+    auto benchFn = [&]() -> uint64_t {
+        std::atomic<uint64_t> found = {0};
+        auto initFn = [] {};
+        auto fn = [&]() {
+            std::mt19937_64 generator(std::random_device{}());
+            uint64_t cnt = 0;
+            uint64_t value = 0;
+            for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                cnt += cache.get(key_of(generator() % FLAGS_cache_keys), &value);
+            }
+            found += cnt;
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times("cache_get_hit_bench", benchFn, FLAGS_ops_per_thread * FLAGS_threads, FLAGS_times);
+    auto stats = cache.stats();
+    std::cout << "cache hits:" << stats.hits << " misses:" << stats.misses << " evictions:" << stats.evictions << std::endl;
+    map.clear();
+}
+
+// 单segment从8个bucket一路扩容，统计单次insert的最大延迟
+template <typename Map>
+void hashmap_growth_latency_bench(std::string name, size_t migrate_batch) {
+    uint64_t per_thread = FLAGS_growth_keys / FLAGS_threads;
+    for (int n = 0; n < FLAGS_times; ++n) {
+        Map map;
+        map.set_migrate_batch(migrate_batch);
+        std::atomic<int> tid = {0};
+        std::atomic<uint64_t> max_ns = {0};
+        std::atomic<uint64_t> total_ns = {0};
+        auto initFn = [] {};
+        auto fn = [&]() {
+            uint64_t t = tid++;
+            uint64_t local_max = 0;
+            uint64_t local_total = 0;
+            for (uint64_t i = t * per_thread; i < (t + 1) * per_thread; ++i) {
+                auto begin = std::chrono::steady_clock::now();
+                map.insert(key_of(i), i);
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - begin).count();
+                local_max = std::max(local_max, ns);
+                local_total += ns;
+            }
+            total_ns += local_total;
+            uint64_t cur = max_ns.load();
+            while (cur < local_max && !max_ns.compare_exchange_weak(cur, local_max)) {
+            }
+        };
+        auto endFn = [] {};
+        run_concurrent(initFn, fn, endFn, FLAGS_threads);
+        std::cout << name << " migrate_batch:" << migrate_batch
+                << " max_insert_us:" << max_ns.load() / 1000
+                << " avg_insert_ns:" << total_ns.load() / (per_thread * FLAGS_threads) << std::endl;
+        map.clear();
+    }
+}
+
+int32_t run_bench() {
+    {
+        std::cout << "size keys:" << FLAGS_cache_keys << " -------------" << std::endl;
+        hashmap_size_bench<ChainedMap>("chained", FLAGS_cache_keys);
+        hashmap_size_bench<SwissMap>("swiss", FLAGS_cache_keys);
+    }
+    {
+        using SlabMap = rcu::ConcurrentHashMap<uint64_t, uint64_t, std::hash<uint64_t>, rcu::ThreadSlabAllocator<uint8_t>>;
+        std::cout << "churn keys:" << FLAGS_churn_keys << " threads:" << FLAGS_threads << " -------------" << std::endl;
+        hashmap_churn_bench<ChainedMap>("chained_churn_std_allocator_bench");
+        hashmap_churn_bench<SlabMap>("chained_churn_slab_allocator_bench");
+    }
+    {
+        std::cout << "teardown keys:" << FLAGS_teardown_keys << " -------------" << std::endl;
+        hashmap_teardown_bench<ChainedMap>("chained_teardown_bench");
+        hashmap_teardown_bench<SwissMap>("swiss_teardown_bench");
+    }
+    {
+        std::cout << "cache keys:" << FLAGS_cache_keys << " threads:" << FLAGS_threads << " -------------" << std::endl;
+        cache_hit_bench();
+    }
+    {
+        std::cout << "scan keys:" << FLAGS_scan_keys << " threads:" << FLAGS_threads << " -------------" << std::endl;
+        hashmap_scan_bench<ChainedMap>("chained");
+        hashmap_scan_bench<SwissMap>("swiss");
+    }
+    {
+        std::cout << "counter keys:" << FLAGS_counter_keys << " threads:" << FLAGS_threads << " -------------" << std::endl;
+        hashmap_counter_bench<ChainedMap>("chained_counter_find_insert_bench", 0);
+        hashmap_counter_bench<ChainedMap>("chained_counter_upsert_bench", 1);
+        hashmap_counter_bench<ChainedMap>("chained_counter_fetch_add_bench", 2);
+        hashmap_counter_bench<SwissMap>("swiss_counter_find_insert_bench", 0);
+        hashmap_counter_bench<SwissMap>("swiss_counter_fetch_add_bench", 2);
+    }
+    {
+        std::cout << "multi_find keys:" << FLAGS_multi_keys << " batch:" << FLAGS_multi_batch
+                << " threads:" << FLAGS_threads << " -------------" << std::endl;
+        run_multi_find_bench<ChainedMap>("chained");
+        run_multi_find_bench<SwissMap>("swiss");
+    }
+    {
+        using StringMap = rcu::ConcurrentHashMap<std::string, uint64_t, rcu::StringHash>;
+        using SwissStringMap = rcu::SwissConcurrentHashMap<std::string, uint64_t, rcu::StringHash>;
+        std::vector<std::string> keys;
+        for (int i = 0; i < FLAGS_string_keys; ++i) {
+            keys.push_back(string_key_of(i));
+        }
+        std::cout << "string keys:" << FLAGS_string_keys << " threads:" << FLAGS_threads << " -------------" << std::endl;
+        hashmap_string_find_bench<StringMap>("chained_string_find_copy_bench", keys, 0);
+        hashmap_string_find_bench<StringMap>("chained_string_find_view_bench", keys, 1);
+        hashmap_string_find_bench<StringMap>("chained_string_find_hash_bench", keys, 2);
+        hashmap_string_find_bench<SwissStringMap>("swiss_string_find_copy_bench", keys, 0);
+        hashmap_string_find_bench<SwissStringMap>("swiss_string_find_view_bench", keys, 1);
+        hashmap_string_find_bench<SwissStringMap>("swiss_string_find_hash_bench", keys, 2);
+    }
+    {
+        using GrowthMap = rcu::ConcurrentHashMap<uint64_t, uint64_t, std::hash<uint64_t>, std::allocator<uint8_t>, 0>;
+        std::cout << "growth keys:" << FLAGS_growth_keys << " threads:" << FLAGS_threads << " -------------" << std::endl;
+        std::stringstream ss(FLAGS_migrate_batches);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            hashmap_growth_latency_bench<GrowthMap>("chained_growth_latency_bench", std::stoull(item));
+        }
+    }
+
+    {
+        ZipfGenerator zipf(FLAGS_zipf_keys, FLAGS_zipf_theta);
+        std::cout << "zipf keys:" << FLAGS_zipf_keys << " theta:" << FLAGS_zipf_theta
+                << " write:" << FLAGS_write_percent << "% threads:" << FLAGS_threads << " -------------" << std::endl;
+        hashmap_zipf_write_bench<ChainedMap>("chained_zipf_write_bench", zipf);
+        hashmap_zipf_write_bench<StripedMap>("striped_zipf_write_bench", zipf);
+    }
+
+    std::stringstream ss(FLAGS_key_counts);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        uint64_t key_count = std::stoull(item);
+        std::cout << "keys:" << key_count << " threads:" << FLAGS_threads << " -------------" << std::endl;
+        run_map_bench<ChainedMap>("chained", key_count);
+        run_map_bench<SwissMap>("swiss", key_count);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+
+    std::string log_conf_file = "./conf/log_afile.conf";
+
+    com_registappender("CRONOLOG", comspace::CronoAppender::getAppender,
+                comspace::CronoAppender::tryAppender);
+
+    auto logger = logging::ComlogSink::GetInstance();
+    if (0 != logger->SetupFromConfig(log_conf_file.c_str())) {
+        LOG(FATAL) << "load log conf failed";
+        return -1;
+    }
+
+    return run_bench();
+}
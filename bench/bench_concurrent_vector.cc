@@ -16,6 +16,8 @@
 
 DEFINE_int32(ops_per_thread, 10000, "ops_per_thread");
 DEFINE_int32(times, 10, "bench times");
+DEFINE_int64(bulk_size, 10000000, "elements of the bulk fill_n/copy_n bench");
+DEFINE_int32(bulk_threads, 0, "threads of the parallel bulk bench, 0 means omp default");
 
 int intRand(const int & min, const int & max) {
     static thread_local std::mt19937 generator;
@@ -83,6 +85,64 @@ void cvec_ensure_concurrent_random_read_bench(std::string name, int concurrent)
 }
 
 
+/** 三种读法的区别只在于读临界区的开销：
+ *  operator[]每次读都进出一次临界区(线程本地查找record + 一次seq_cst fence)，
+ *  复用Snapshot和get_unguarded整个循环只进出一次。
+ *  单位是一次读，ops_per_thread:10000，1核的机器，每次读的差距就是进出临界区的~12ns
+ *  concurrent:1
+ *  cvec_operator_concurrent_random_read_bench        16 ns      13 ns      12 ns
+ *  cvec_snapshot_concurrent_random_read_bench         1 ns       1 ns       1 ns
+ *  cvec_unguarded_concurrent_random_read_bench        2 ns       1 ns       1 ns
+ *  concurrent:10
+ *  cvec_operator_concurrent_random_read_bench        13 ns      13 ns      12 ns
+ *  cvec_snapshot_concurrent_random_read_bench         1 ns       1 ns       1 ns
+ *  cvec_unguarded_concurrent_random_read_bench        2 ns       1 ns       1 ns
+ */
+enum class ReadMode {
+    OPERATOR,
+    SNAPSHOT,
+    UNGUARDED,
+};
+
+template <ReadMode MODE>
+void cvec_concurrent_random_read_bench(std::string name, int concurrent) {
+    int ops_each_time = FLAGS_ops_per_thread * concurrent;
+    std::atomic<size_t> total = {0};
+    auto benchFn = [&]() -> uint64_t {
+        std::vector<int> idxs;
+        rcu::ConcurrentVector<size_t> vec;
+        auto initFn = [&] {
+            vec.fill_n(0, FLAGS_ops_per_thread, 1);
+            for (int j = 0; j < FLAGS_ops_per_thread; ++j) {
+                idxs.push_back(intRand(0, FLAGS_ops_per_thread-1));
+            }
+        };
+        auto fn = [&]() {
+            size_t sum = 0;
+            if constexpr (MODE == ReadMode::OPERATOR) {
+                for (auto idx : idxs) {
+                    sum += vec[idx];
+                }
+            } else if constexpr (MODE == ReadMode::SNAPSHOT) {
+                auto snapshot = vec.snapshot();
+                for (auto idx : idxs) {
+                    sum += snapshot[idx];
+                }
+            } else {
+                rcu::EpochGuard guard;
+                for (auto idx : idxs) {
+                    sum += vec.get_unguarded(idx);
+                }
+            }
+            // 避免读被优化掉
+            total.fetch_add(sum, std::memory_order_relaxed);
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, concurrent);
+    };
+    bench_many_times(name, benchFn, ops_each_time, FLAGS_times);
+    assert(total.load() > 0);
+}
 
 void cvec_ensure_concurrent_random_write_bench(std::string name, int concurrent) {
     int ops_each_time = FLAGS_ops_per_thread * concurrent;
@@ -129,7 +189,7 @@ void cvec_snapshot_concurrent_random_write_bench(std::string name, int concurren
         auto fn = [&]() {
             auto snapshot = vec.snapshot();
             for (auto idx : idxs) {
-                snapshot[idx] = 5555;
+                snapshot.writable(idx) = 5555;
             }
         };
         auto endFn = [] {};
@@ -157,7 +217,7 @@ void cvec_concurrent_random_write_bench(std::string name, int concurrent) {
         // 定义每个线程干的活
         auto fn = [&]() {
             for (auto idx : idxs) {
-                vec[idx] = 5555;
+                vec.writable(idx) = 5555;
             }
         };
         auto endFn = [] {};
@@ -207,7 +267,7 @@ void cvec_sequence_write_bench(std::string name) {
             rcu::ConcurrentVector<size_t> vec;
             vec.reserve(FLAGS_ops_per_thread);
             for (int i = 0; i < FLAGS_ops_per_thread; i++) {
-                vec[i] = 1;
+                vec.writable(i) = 1;
             }
         };
         auto endFn = [] {};
@@ -241,6 +301,104 @@ void vector_sequence_write_bench(std::string name) {
     bench_many_times(name, benchFn, FLAGS_ops_per_thread, FLAGS_times);
 }
 
+void vector_fill_bandwidth_bench(std::string name) {
+    std::vector<size_t> vec(FLAGS_bulk_size);
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        auto fn = [&]() {
+            std::fill(vec.begin(), vec.end(), 5555);
+        };
+        auto endFn = [] {};
+        return run_single(initFn, fn, endFn);
+    };
+    bench_bandwidth_many_times(name, benchFn, FLAGS_bulk_size * sizeof(size_t), FLAGS_times);
+}
+
+void cvec_fill_n_bandwidth_bench(std::string name, bool parallel) {
+    rcu::ConcurrentVector<size_t> vec;
+    vec.reserve(FLAGS_bulk_size);
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        auto fn = [&]() {
+            if (parallel) {
+                vec.parallel_fill_n(0, FLAGS_bulk_size, 5555, FLAGS_bulk_threads);
+            } else {
+                vec.fill_n(0, FLAGS_bulk_size, 5555);
+            }
+        };
+        auto endFn = [] {};
+        return run_single(initFn, fn, endFn);
+    };
+    bench_bandwidth_many_times(name, benchFn, FLAGS_bulk_size * sizeof(size_t), FLAGS_times);
+}
+
+void cvec_copy_n_bandwidth_bench(std::string name, bool parallel) {
+    rcu::ConcurrentVector<size_t> vec;
+    vec.reserve(FLAGS_bulk_size);
+    std::vector<size_t> src(FLAGS_bulk_size, 5555);
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        auto fn = [&]() {
+            if (parallel) {
+                vec.parallel_copy_n(src.begin(), FLAGS_bulk_size, 0, FLAGS_bulk_threads);
+            } else {
+                vec.copy_n(src.begin(), FLAGS_bulk_size, 0);
+            }
+        };
+        auto endFn = [] {};
+        return run_single(initFn, fn, endFn);
+    };
+    bench_bandwidth_many_times(name, benchFn, FLAGS_bulk_size * sizeof(size_t), FLAGS_times);
+}
+
+struct RetireFoobar {
+    int64_t value[4];
+};
+
+struct HookedRetireFoobar : public rcu::RetireListHook {
+    int64_t value[4];
+};
+
+// 只统计retire本身的耗时，对象提前分配好，释放放在endFn里
+template <typename T, bool BATCH>
+void retire_list_bench(std::string name, int concurrent) {
+    int ops_each_time = FLAGS_ops_per_thread * concurrent;
+    auto benchFn = [&]() -> uint64_t {
+        rcu::RetireList<T> list;
+        std::vector<std::vector<T*>> objects(concurrent);
+        std::atomic<int> thread_id = {0};
+        auto initFn = [&] {
+            for (auto& items : objects) {
+                for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                    items.push_back(new T);
+                }
+            }
+        };
+        auto fn = [&]() {
+            auto& items = objects[thread_id++];
+            if constexpr (BATCH) {
+                typename rcu::RetireList<T>::Batch batch;
+                for (auto* item : items) {
+                    batch.add(item);
+                    if (batch.size() == 64) {
+                        list.retire(batch);
+                    }
+                }
+                list.retire(batch);
+            } else {
+                for (auto* item : items) {
+                    list.retire(item);
+                }
+            }
+        };
+        auto endFn = [&] {
+            list.force_gc();
+        };
+        return run_concurrent(initFn, fn, endFn, concurrent);
+    };
+    bench_many_times(name, benchFn, ops_each_time, FLAGS_times);
+}
+
 // 分别用多少种并发来压测
 std::vector<int> concurrent_list = {1, 10};
 int32_t run_bench() {
@@ -257,7 +415,25 @@ int32_t run_bench() {
 
         vec_ensure_concurrent_random_read_bench("vec_ensure_concurrent_random_read_bench", concurrent);
         cvec_ensure_concurrent_random_read_bench("cvec_ensure_concurrent_random_read_bench", concurrent);
+        cvec_concurrent_random_read_bench<ReadMode::OPERATOR>("cvec_operator_concurrent_random_read_bench", concurrent);
+        cvec_concurrent_random_read_bench<ReadMode::SNAPSHOT>("cvec_snapshot_concurrent_random_read_bench", concurrent);
+        cvec_concurrent_random_read_bench<ReadMode::UNGUARDED>("cvec_unguarded_concurrent_random_read_bench", concurrent);
     }
+
+    for (auto concurrent : concurrent_list) {
+        std::cout << "retire_list concurrent:" << concurrent << " threads -------------" << std::endl;
+        retire_list_bench<RetireFoobar, false>("retire_list_node_bench", concurrent);
+        retire_list_bench<HookedRetireFoobar, false>("retire_list_intrusive_bench", concurrent);
+        retire_list_bench<HookedRetireFoobar, true>("retire_list_intrusive_batch_bench", concurrent);
+        retire_list_bench<RetireFoobar, true>("retire_list_node_batch_bench", concurrent);
+    }
+
+    std::cout << "bulk: " << FLAGS_bulk_size << " elements -------------" << std::endl;
+    vector_fill_bandwidth_bench("vector_fill_bandwidth_bench");
+    cvec_fill_n_bandwidth_bench("cvec_fill_n_bandwidth_bench", false);
+    cvec_fill_n_bandwidth_bench("cvec_parallel_fill_n_bandwidth_bench", true);
+    cvec_copy_n_bandwidth_bench("cvec_copy_n_bandwidth_bench", false);
+    cvec_copy_n_bandwidth_bench("cvec_parallel_copy_n_bandwidth_bench", true);
     return 0;
 }
 
@@ -0,0 +1,108 @@
+#include <assert.h>
+#include "baidu/streaming_log.h"
+#include "base/comlog_sink.h"
+#include "base/strings/stringprintf.h"
+#include "com_log.h"
+#include "cronoapd.h"
+
+#undef DCHECK_IS_ON
+
+#include <random>
+#include <sstream>
+
+#include "gflags/gflags.h"
+
+#include "bench_common.h"
+#include "swmr_list.h"
+#include "concurrent/lock_free_list_set.h"
+
+// 有序链表set的add/remove/contains混合操作，SWMRListSet的写者串行在mutex上，LockFreeListSet无锁
+// 单位是一次操作，keys:1000，预先插入一半的key，1核的机器，每个线程200000次
+// 1核上写者本来就不会并行，mutex没有竞争，看不出多写者的收益；
+// LockFreeListSet的写者遍历时每个节点都要发布一次hazptr，SWMRListSet的写者在锁里直接读，所以慢15%左右
+// threads:1 write:50% -------------
+// swmr_list_set_bench                               758 ns     698 ns     661 ns
+// lock_free_list_set_bench                          844 ns     824 ns     804 ns
+// threads:1 write:10% -------------
+// swmr_list_set_bench                               714 ns     702 ns     687 ns
+// lock_free_list_set_bench                          851 ns     820 ns     800 ns
+// threads:4 write:50% -------------
+// swmr_list_set_bench                               793 ns     686 ns     611 ns
+// lock_free_list_set_bench                          802 ns     791 ns     771 ns
+// threads:4 write:10% -------------
+// swmr_list_set_bench                               732 ns     706 ns     679 ns
+// lock_free_list_set_bench                          875 ns     821 ns     787 ns
+
+DEFINE_int32(ops_per_thread, 200000, "ops per thread");
+DEFINE_int32(times, 3, "bench times");
+DEFINE_int32(threads, 4, "bench threads");
+DEFINE_string(key_counts, "1000", "key ranges of the set, separated by comma");
+DEFINE_string(write_percents, "50,10", "percent of add/remove ops, separated by comma");
+
+/** 每个线程在[0, key_count)里随机选key，write_percent的操作一半add一半remove，其余contains。
+ *  set里预先放好一半的key，add和remove大致平衡，链表长度稳定在key_count/2左右。
+ */
+template <typename Set>
+void list_set_bench(std::string name, int key_count, int write_percent) {
+    Set set;
+    for (int i = 0; i < key_count; i += 2) {
+        set.add(i);
+    }
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        auto fn = [&]() {
+            std::mt19937 generator(std::random_device{}());
+            uint64_t hit = 0;
+            for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                int key = generator() % key_count;
+                int op = generator() % 200;
+                if (op < write_percent) {
+                    hit += set.add(key);
+                } else if (op < write_percent * 2) {
+                    hit += set.remove(key);
+                } else {
+                    hit += set.contains(key);
+                }
+            }
+            assert(hit != 0);
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, FLAGS_ops_per_thread * FLAGS_threads, FLAGS_times);
+}
+
+int32_t run_bench() {
+    std::stringstream keys_ss(FLAGS_key_counts);
+    std::string keys_item;
+    while (std::getline(keys_ss, keys_item, ',')) {
+        int key_count = std::stoi(keys_item);
+        std::stringstream write_ss(FLAGS_write_percents);
+        std::string write_item;
+        while (std::getline(write_ss, write_item, ',')) {
+            int write_percent = std::stoi(write_item);
+            std::cout << "keys:" << key_count << " threads:" << FLAGS_threads
+                    << " write:" << write_percent << "% -------------" << std::endl;
+            list_set_bench<rcu::SWMRListSet<int>>("swmr_list_set_bench", key_count, write_percent);
+            list_set_bench<rcu::LockFreeListSet<int>>("lock_free_list_set_bench", key_count, write_percent);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+
+    std::string log_conf_file = "./conf/log_afile.conf";
+
+    com_registappender("CRONOLOG", comspace::CronoAppender::getAppender,
+                comspace::CronoAppender::tryAppender);
+
+    auto logger = logging::ComlogSink::GetInstance();
+    if (0 != logger->SetupFromConfig(log_conf_file.c_str())) {
+        LOG(FATAL) << "load log conf failed";
+        return -1;
+    }
+
+    return run_bench();
+}
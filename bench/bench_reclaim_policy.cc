@@ -0,0 +1,139 @@
+#include <assert.h>
+#include "baidu/streaming_log.h"
+#include "base/comlog_sink.h"
+#include "base/strings/stringprintf.h"
+#include "com_log.h"
+#include "cronoapd.h"
+
+#undef DCHECK_IS_ON
+
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include "gflags/gflags.h"
+
+#include "bench_common.h"
+#include "concurrent/concurrent_hashmap.h"
+#include "concurrent/urcu_policy.h"
+
+// ConcurrentHashMap的find路径，hazptr、urcu QSBR、urcu memb三种回收策略对比
+// 单位是一次操作，keys:1000000，1核的机器(memb可以用membarrier)，threads:4时每个线程300000次
+// hazptr每次find要申请和发布几个record，QSBR的读端没有任何额外指令
+// threads:1 write:0% -------------
+// hazptr_find_bench                                 433 ns     428 ns     424 ns
+// qsbr_find_bench                                   208 ns     193 ns     186 ns
+// memb_find_bench                                   517 ns     307 ns     251 ns
+// threads:1 write:10% -------------
+// hazptr_find_bench                                 711 ns     492 ns     428 ns
+// qsbr_find_bench                                   265 ns     225 ns     205 ns
+// memb_find_bench                                   535 ns     378 ns     282 ns
+// threads:4 write:0% -------------
+// hazptr_find_bench                                 448 ns     434 ns     426 ns
+// qsbr_find_bench                                   182 ns     180 ns     178 ns
+// memb_find_bench                                   273 ns     240 ns     197 ns
+// threads:4 write:10% -------------
+// hazptr_find_bench                                 625 ns     516 ns     432 ns
+// qsbr_find_bench                                   285 ns     279 ns     272 ns
+// memb_find_bench                                   515 ns     442 ns     400 ns
+
+DEFINE_int32(ops_per_thread, 1000000, "ops per thread");
+DEFINE_int32(times, 3, "bench times");
+DEFINE_int32(threads, 4, "bench threads");
+DEFINE_string(key_counts, "1000000", "key counts of the map, separated by comma");
+DEFINE_string(write_percents, "0,10", "percent of insert/erase ops, separated by comma");
+DEFINE_int32(quiescent_interval, 1024, "ops between two QSBR quiescent states");
+
+inline uint64_t key_of(uint64_t i) {
+    return i * 0x9E3779B97F4A7C15UL;
+}
+
+template <typename Policy>
+using PolicyMap = rcu::ConcurrentHashMap<uint64_t, uint64_t, std::hash<uint64_t>,
+      std::allocator<uint8_t>, 8, rcu::ConcurrentHashMapSegment, Policy>;
+
+/** 每个线程随机find，write_percent的操作换成insert(覆盖已有的key，旧node要回收)或者erase再insert。
+ *  bench线程都在Policy::ThreadScope里，QSBR每quiescent_interval次操作报告一次静止状态。
+ */
+template <typename Policy>
+void policy_find_bench(std::string name, uint64_t key_count, int write_percent) {
+    using Map = PolicyMap<Policy>;
+    std::unique_ptr<Map> map;
+    {
+        typename Policy::ThreadScope scope;
+        map.reset(new Map(key_count));
+        for (uint64_t i = 0; i < key_count; ++i) {
+            map->insert(key_of(i), i);
+        }
+    }
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        auto fn = [&]() {
+            typename Policy::ThreadScope scope;
+            std::mt19937_64 generator(std::random_device{}());
+            uint64_t sum = 0;
+            for (int i = 0; i < FLAGS_ops_per_thread; ++i) {
+                uint64_t idx = generator() % key_count;
+                if (int(generator() % 100) < write_percent) {
+                    if (i % 2 == 0) {
+                        map->insert(key_of(idx), idx);
+                    } else {
+                        map->erase(key_of(idx));
+                        map->insert(key_of(idx), idx);
+                    }
+                } else {
+                    auto iter = map->find(key_of(idx));
+                    sum += iter != map->cend() ? *iter : 0;
+                }
+                if (i % FLAGS_quiescent_interval == 0) {
+                    Policy::quiescent_state();
+                }
+            }
+            assert(sum != 0);
+        };
+        auto endFn = [] {};
+        return run_concurrent(initFn, fn, endFn, FLAGS_threads);
+    };
+    bench_many_times(name, benchFn, FLAGS_ops_per_thread * FLAGS_threads, FLAGS_times);
+    {
+        // 析构时retire bucket list，urcu要求在注册过的线程上调用call_rcu
+        typename Policy::ThreadScope scope;
+        map.reset();
+    }
+}
+
+int32_t run_bench() {
+    std::stringstream keys_ss(FLAGS_key_counts);
+    std::string keys_item;
+    while (std::getline(keys_ss, keys_item, ',')) {
+        uint64_t key_count = std::stoull(keys_item);
+        std::stringstream write_ss(FLAGS_write_percents);
+        std::string write_item;
+        while (std::getline(write_ss, write_item, ',')) {
+            int write_percent = std::stoi(write_item);
+            std::cout << "keys:" << key_count << " threads:" << FLAGS_threads
+                    << " write:" << write_percent << "% -------------" << std::endl;
+            policy_find_bench<rcu::HazptrReclaimPolicy>("hazptr_find_bench", key_count, write_percent);
+            policy_find_bench<rcu::UrcuQsbrPolicy>("qsbr_find_bench", key_count, write_percent);
+            policy_find_bench<rcu::UrcuMembPolicy>("memb_find_bench", key_count, write_percent);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    google::ParseCommandLineFlags(&argc, &argv, true);
+
+    std::string log_conf_file = "./conf/log_afile.conf";
+
+    com_registappender("CRONOLOG", comspace::CronoAppender::getAppender,
+                comspace::CronoAppender::tryAppender);
+
+    auto logger = logging::ComlogSink::GetInstance();
+    if (0 != logger->SetupFromConfig(log_conf_file.c_str())) {
+        LOG(FATAL) << "load log conf failed";
+        return -1;
+    }
+
+    return run_bench();
+}
@@ -1,11 +1,14 @@
 #include "bench_common.h"
-#include "my_hazptr.h"
+#include "concurrent/hazptr.h"
 #include <iostream>
 
 #include "gflags/gflags.h"
 
 DEFINE_int32(ops, 1000, "ops_per_thread");
 DEFINE_int32(times, 10, "bench times");
+DEFINE_int32(reclaim_records, 1000, "hazard records in reclaim bench");
+DEFINE_int32(reclaim_objects, 100000, "retired objects in reclaim bench");
+DEFINE_bool(background_reclaim, false, "reclaim retired objects in a background thread");
 
 void holder_bench(std::string name, int concurrent) {
     int ops_per_thread = FLAGS_ops;
@@ -60,14 +63,130 @@ void retire_bench(std::string name, int concurrent) {
     bench_many_times(name, benchFn, ops_each_time, times);
 }
 
+// 一次申请3个record，对应hashmap遍历时bucket数组+当前节点+下一个节点
+void array_bench(std::string name, int concurrent) {
+    int ops_per_thread = FLAGS_ops;
+    int times = FLAGS_times;
+    int ops_each_time = ops_per_thread * concurrent;
+
+    // bench一次
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        // 定义每个线程干的活
+        auto fn = [&]() {
+            for (int i = 0; i < ops_per_thread; i++) {
+                rcu::HazptrArray<3> holders;
+            }
+        };
+        auto endFn = [] {};
+        // 启动concurrent个线程压测
+        uint64_t cost = run_concurrent(initFn, fn, endFn, concurrent);
+        return cost;
+    };
+
+    // bench多次，取最大值、平均值、最小值
+    bench_many_times(name, benchFn, ops_each_time, times);
+}
+
+// 读者侧的开销：每次protect一个共享指针，读者之间没有竞争
+void protect_bench(std::string name, int concurrent) {
+    int ops_per_thread = FLAGS_ops;
+    int times = FLAGS_times;
+    int ops_each_time = ops_per_thread * concurrent;
+
+    struct FooNode : public rcu::HazptrNode<FooNode> {
+        int x;
+    };
+    FooNode* node = new FooNode();
+    std::atomic<FooNode*> src = {node};
+
+    // bench一次
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [] {};
+        // 定义每个线程干的活
+        auto fn = [&]() {
+            rcu::HazptrHolder holder;
+            int64_t sum = 0;
+            for (int i = 0; i < ops_per_thread; i++) {
+                sum += holder.get_protected(src)->x;
+            }
+            holder.reset();
+            // 防止循环被优化掉
+            if (sum != 0) {
+                std::cout << sum << std::endl;
+            }
+        };
+        auto endFn = [] {};
+        // 启动concurrent个线程压测
+        uint64_t cost = run_concurrent(initFn, fn, endFn, concurrent);
+        return cost;
+    };
+
+    // bench多次，取最大值、平均值、最小值
+    bench_many_times(name, benchFn, ops_each_time, times);
+    delete node;
+}
+
+// 一次bulkReclaim的开销，按retired对象平均。每个record保护一个retired对象
+void reclaim_bench(std::string name) {
+    int records = FLAGS_reclaim_records;
+    int objects = FLAGS_reclaim_objects;
+    int times = FLAGS_times;
+    auto& manager = rcu::get_default_manager();
+
+    struct FooNode : public rcu::HazptrNode<FooNode> {
+        int x;
+    };
+    std::vector<rcu::HazptrHolder> holders(records);
+    std::vector<FooNode*> nodes(objects);
+
+    // bench一次
+    auto benchFn = [&]() -> uint64_t {
+        auto initFn = [&] {
+            rcu::DoubleLinkedList<rcu::HazptrObj> list;
+            for (int i = 0; i < objects; i++) {
+                nodes[i] = new FooNode();
+                list.push(nodes[i]);
+            }
+            for (int i = 0; i < records; i++) {
+                holders[i].reset(nodes[(int64_t)i * objects / records]);
+            }
+            manager.append(list.head, list.tail, list.count);
+        };
+        auto fn = [&] {
+            manager.bulkReclaim();
+        };
+        // 放开保护，把剩下的对象回收掉，不计入耗时
+        auto endFn = [&] {
+            for (auto& holder : holders) {
+                holder.reset();
+            }
+            manager.bulkReclaim();
+        };
+        return run_single(initFn, fn, endFn);
+    };
+
+    // bench多次，取最大值、平均值、最小值
+    bench_many_times(name, benchFn, objects, times);
+}
+
 // 分别用多少种并发来压测
 std::vector<int> concurrent_list = {1, 10};
 
 int32_t run_bench() {
+    if (FLAGS_background_reclaim) {
+        rcu::get_default_manager().start_reclaimer();
+    }
     for (auto concurrent : concurrent_list) {
         std::cout << "concurrent:" << concurrent << " threads -------------" << std::endl;
         holder_bench("bench_holder", concurrent);
+        array_bench("bench_array", concurrent);
+        protect_bench("bench_protect", concurrent);
         retire_bench("bench_retire", concurrent);
     }
+    std::cout << "reclaim " << FLAGS_reclaim_records << " records " << FLAGS_reclaim_objects
+              << " objects -------------" << std::endl;
+    rcu::get_default_manager().stop_reclaimer();
+    reclaim_bench("bench_reclaim");
     return 0;
 }
@@ -85,7 +85,7 @@ constexpr std::size_t hardware_destructive_interference_size = 64;
 #ifdef DCHECK_IS_ON
 #  define DCHECK(...) CHECK(__VA_ARGS__);
 #else
-#  define DCHECK(expr) ((void) expr);
+#  define DCHECK(expr) ((void) (expr));
 #endif
 
 #ifndef NOTREACHED
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <mutex>
-#include "my_hazptr.h"
+#include "concurrent/hazptr.h"
 
 namespace rcu {
 
@@ -89,7 +89,8 @@ public:
             Node* curr = p_prev->load(std::memory_order_seq_cst);
             while (true) {
                 if (!curr) return false;
-                if (curr->element < data) return false;
+                // 链表是升序的，第一个大于data的节点之后不会再有data
+                if (curr->element > data) return false;
                 if(!holder_curr.try_protect(curr, *p_prev)) {
                     break;
                 }
@@ -1,4 +1,5 @@
 #include "stack.h"
+#include "hazptr_stack.h"
 
 #include "gflags/gflags.h"
 #include <thread>
@@ -11,11 +12,24 @@
 #include "base/comlog_sink.h"
 #include "base/strings/stringprintf.h"
 #include "com_log.h"
+#include "bench_common.h"
 //#include "cronoapd.h"
 
+// 每个线程n次push+pop，单位是一次push+pop，n=200000，1核的机器
+// threads:1 -------------
+// lock_free_stack_push_pop                           98 ns      88 ns      75 ns
+// hazptr_stack_push_pop                              71 ns      65 ns      55 ns
+// hazptr_stack_push_pop_all(64)                      52 ns      45 ns      40 ns
+// threads:4 -------------
+// lock_free_stack_push_pop                          382 ns     340 ns     307 ns
+// hazptr_stack_push_pop                             237 ns     231 ns     226 ns
+// hazptr_stack_push_pop_all(64)                     173 ns     170 ns     167 ns
+
 DEFINE_int32(threads, 1, "option.");
 DEFINE_int32(n, 1000, "n");
 DEFINE_int32(option, 0, "option");
+DEFINE_int32(times, 5, "bench times");
+DEFINE_int32(batch, 64, "push count before each pop_all");
 
 int intRand(const int & min, const int & max) {
     //static thread_local std::mt19937 generator;
@@ -24,7 +38,20 @@ int intRand(const int & min, const int & max) {
     return distribution(generator);
 }
 
-int torture1(rcu::LockFreeStack<int> *stack) {
+bool pop_one(rcu::LockFreeStack<int>* stack, int& value) {
+    auto ret = stack->pop();
+    if (ret) {
+        value = *ret;
+    }
+    return ret != nullptr;
+}
+
+bool pop_one(rcu::HazptrStack<int>* stack, int& value) {
+    return stack->pop(value);
+}
+
+template <typename Stack>
+int torture1(Stack *stack) {
     for (int i = 0; i < FLAGS_n; ++i) {
         int n = intRand(1, 1000000);
         if (true) {
@@ -35,26 +62,25 @@ int torture1(rcu::LockFreeStack<int> *stack) {
         }
         int n2 = intRand(1, 1000000);
         if (n2 % 2 == 0) {
-            auto ret = stack->pop();
-            if (FLAGS_option == 1) { 
+            int value = 0;
+            bool ret = pop_one(stack, value);
+            if (FLAGS_option == 1) {
                 if (ret) {
-                    LOG(NOTICE) << "pop -> " << *ret << "  n2:" << n2 ;
+                    LOG(NOTICE) << "pop -> " << value << "  n2:" << n2 ;
                 } else {
                     LOG(NOTICE) << "pop -> nullptr,  n2:" << n2 ;
                 }
             }
         }
     }
-    if (FLAGS_option == 1) {
-        //LOG(NOTICE) << "stack size -> " << stack->size() ;
-    }
     return 0;
 }
 
-int torture2(rcu::LockFreeStack<int> *stack) {
+template <typename Stack>
+int torture2(Stack *stack) {
     std::vector<std::thread> threads;
     for (int j = 0; j < FLAGS_threads; j++) {
-        std::thread t(torture1, stack);
+        std::thread t(torture1<Stack>, stack);
         threads.emplace_back(std::move(t));
     }
     for (auto& th : threads) {
@@ -63,12 +89,43 @@ int torture2(rcu::LockFreeStack<int> *stack) {
     return 0;
 }
 
+template <typename Stack>
+void push_pop_bench(std::string name) {
+    bench_many_times(name, [&] {
+        Stack stack;
+        return run_concurrent([] {}, [&] {
+            int value = 0;
+            for (int i = 0; i < FLAGS_n; ++i) {
+                stack.push(i);
+                pop_one(&stack, value);
+            }
+        }, [] {}, FLAGS_threads);
+    }, FLAGS_n, FLAGS_times);
+}
+
+// 攒batch个再一次摘下整个栈，比如线程间批量交接任务
+void push_pop_all_bench(std::string name) {
+    bench_many_times(name, [&] {
+        rcu::HazptrStack<int> stack;
+        return run_concurrent([] {}, [&] {
+            int64_t sum = 0;
+            for (int i = 0; i < FLAGS_n; ++i) {
+                stack.push(i);
+                if (i % FLAGS_batch == FLAGS_batch - 1) {
+                    stack.pop_all([&](int&& value) { sum += value; });
+                }
+            }
+            stack.pop_all([&](int&& value) { sum += value; });
+        }, [] {}, FLAGS_threads);
+    }, FLAGS_n, FLAGS_times);
+}
+
 int main(int argc, char** argv) {
     google::ParseCommandLineFlags(&argc, &argv, false);
 
     std::string log_conf_file = "./conf/log.conf";
 
-    com_registappender("BFILE", AsyncFileAppender::get_appender, 
+    com_registappender("BFILE", AsyncFileAppender::get_appender,
                 AsyncFileAppender::try_appender);
 
     auto logger = logging::ComlogSink::GetInstance();
@@ -94,18 +151,24 @@ int main(int argc, char** argv) {
         case COMLOG_DEBUG:
             ::logging::SetMinLogLevel(::logging::BLOG_DEBUG);
             break;
-        
+
         default:
             break;
     }
 
-    //rcu::LockFreeStack<int> stack1;
-    //torture1(&stack1);
+    if (FLAGS_option == 1) {
+        // 随机push/pop并打印，用来查正确性
+        rcu::LockFreeStack<int> stack1;
+        torture2(&stack1);
+        rcu::HazptrStack<int> stack2;
+        torture2(&stack2);
+        return 0;
+    }
 
-    rcu::LockFreeStack<int> stack2;
-    torture2(&stack2);
-    
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    std::cout << "threads:" << FLAGS_threads << " -------------" << std::endl;
+    push_pop_bench<rcu::LockFreeStack<int>>("lock_free_stack_push_pop");
+    push_pop_bench<rcu::HazptrStack<int>>("hazptr_stack_push_pop");
+    push_pop_all_bench("hazptr_stack_push_pop_all(" + std::to_string(FLAGS_batch) + ")");
 
     return 0;
 }
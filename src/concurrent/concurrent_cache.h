@@ -0,0 +1,251 @@
+#pragma once
+
+// TODO
+// 1 每个entry的过期时间 done
+// 2 按segment的CLOCK近似LRU淘汰 done
+// 3 entry个数/字节数上限 done
+// 4 hit/miss/eviction统计 done
+
+#include <time.h>
+#include <array>
+#include <atomic>
+#include <algorithm>
+
+#include "concurrent_hashmap.h"
+
+// 每一轮CLOCK扫描访问的bucket个数
+#ifndef CONCURRENT_CACHE_SWEEP_BUCKETS
+#define CONCURRENT_CACHE_SWEEP_BUCKETS 16
+#endif
+
+// 一次put最多扫描的轮数，超过之后留给下一次put继续淘汰
+#ifndef CONCURRENT_CACHE_MAX_SWEEP_ROUNDS
+#define CONCURRENT_CACHE_MAX_SWEEP_ROUNDS 16
+#endif
+
+namespace rcu {
+
+struct ConcurrentCacheOptions {
+    // 0表示不限制
+    size_t max_entries = {0};
+    size_t max_bytes = {0};
+    // put不指定ttl时使用，0表示不过期
+    uint64_t default_ttl_ms = {0};
+};
+
+struct ConcurrentCacheStats {
+    uint64_t hits = {0};
+    uint64_t misses = {0};
+    // 因为超过上限被淘汰的
+    uint64_t evictions = {0};
+    // 过期之后被清理的
+    uint64_t expirations = {0};
+    size_t entries = {0};
+    size_t bytes = {0};
+};
+
+/** 基于ConcurrentHashMap的有界cache。
+ *
+ *  读路径就是一次map的find：检查过期时间，没有设置引用位时设置一下，再拷贝value。
+ *  上限按segment平分，余数分给编号小的segment，各segment的上限之和等于总上限；
+ *  上限小于segment个数时有的segment上限为0，写进去的key马上被淘汰，这时应该调小ShardBits。
+ *  每个segment有自己的计数和CLOCK指针，淘汰只扫描写入的key所在的segment，
+ *  没有全局的LRU链表和锁。CLOCK扫描时过期的entry直接清理，引用位为1的清零，为0的淘汰。
+ *  上限是近似的：并发写入时可能短暂超过，一次put扫描的轮数有上限。
+ */
+template <
+    typename KeyType,
+    typename ValueType,
+    typename HashFn = std::hash<KeyType>,
+    uint8_t ShardBits = 8>
+class ConcurrentCache {
+public:
+    struct Entry {
+        Entry() = default;
+        Entry(const Entry& o)
+            : value(o.value),
+              expire_at_ms(o.expire_at_ms),
+              charge(o.charge),
+              referenced(o.referenced.load(std::memory_order_relaxed)) {
+        }
+        Entry& operator=(const Entry& o) {
+            value = o.value;
+            expire_at_ms = o.expire_at_ms;
+            charge = o.charge;
+            referenced.store(o.referenced.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+
+        ValueType value;
+        // 0表示不过期
+        uint64_t expire_at_ms = {0};
+        // 和引用位挤在一个8字节里，让节点小一些
+        uint32_t charge = {0};
+        // 读者只设置这一个字段，所以允许在const的entry上修改
+        mutable std::atomic<uint8_t> referenced = {0};
+    };
+    using Map = ConcurrentHashMap<KeyType, Entry, HashFn, std::allocator<uint8_t>, ShardBits>;
+    static constexpr uint64_t NumShards = Map::NumShards;
+
+    explicit ConcurrentCache(const ConcurrentCacheOptions& options)
+        : _options(options), _map(std::max(options.max_entries, size_t(NumShards))) {
+        for (uint64_t i = 0; i < NumShards; ++i) {
+            _shards[i].max_entries = split_budget(options.max_entries, i);
+            _shards[i].max_bytes = split_budget(options.max_bytes, i);
+        }
+    }
+    // 禁止拷贝和移动
+    ConcurrentCache(ConcurrentCache&&) = delete;
+    ConcurrentCache(const ConcurrentCache&) = delete;
+    ConcurrentCache& operator=(ConcurrentCache&&) = delete;
+    ConcurrentCache& operator=(const ConcurrentCache&) = delete;
+
+    // 命中时把value拷贝到*value，过期的entry算miss
+    template <typename K>
+    bool get(const K& key, ValueType* value) {
+        auto hash = HashFn()(key);
+        auto& shard = _shards[hash & (NumShards - 1)];
+        auto iter = _map.find(key, hash);
+        if (iter == _map.cend() || expired(*iter, now_ms())) {
+            shard.misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // 先读再写，热点key不用反复写同一个cache line
+        if (iter->referenced.load(std::memory_order_relaxed) == 0) {
+            iter->referenced.store(1, std::memory_order_relaxed);
+        }
+        *value = iter->value;
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void put(const KeyType& key, const ValueType& value) {
+        put(key, value, _options.default_ttl_ms, sizeof(KeyType) + sizeof(ValueType));
+    }
+
+    // ttl_ms为0表示不过期，charge是这个entry计入max_bytes的字节数
+    void put(const KeyType& key, const ValueType& value, uint64_t ttl_ms, uint32_t charge) {
+        uint64_t segment_id = _map.segment_id_of(key);
+        auto& shard = _shards[segment_id];
+        size_t old_charge = 0;
+        bool inserted = _map.upsert(key, [&](Entry& entry) {
+            old_charge = entry.charge;
+            entry.value = value;
+            entry.expire_at_ms = ttl_ms ? now_ms() + ttl_ms : 0;
+            entry.charge = charge;
+            // 引用位只由get设置：只写不读的key在第一轮CLOCK就被淘汰，不会把读过的热点key挤出去
+        });
+        if (inserted) {
+            shard.entries.fetch_add(1, std::memory_order_relaxed);
+        }
+        shard.bytes.fetch_add(charge - old_charge, std::memory_order_relaxed);
+        if (over_budget(shard)) {
+            evict(segment_id);
+        }
+    }
+
+    template <typename K>
+    bool erase(const K& key) {
+        auto& shard = _shards[_map.segment_id_of(key)];
+        size_t charge = 0;
+        bool erased = _map.erase_if(key, [&](const Entry& entry) {
+            charge = entry.charge;
+            return true;
+        });
+        if (erased) {
+            shard.entries.fetch_sub(1, std::memory_order_relaxed);
+            shard.bytes.fetch_sub(charge, std::memory_order_relaxed);
+        }
+        return erased;
+    }
+
+    ConcurrentCacheStats stats() const {
+        ConcurrentCacheStats stats;
+        for (auto& shard : _shards) {
+            stats.hits += shard.hits.load(std::memory_order_relaxed);
+            stats.misses += shard.misses.load(std::memory_order_relaxed);
+            stats.evictions += shard.evictions.load(std::memory_order_relaxed);
+            stats.expirations += shard.expirations.load(std::memory_order_relaxed);
+            stats.entries += shard.entries.load(std::memory_order_relaxed);
+            stats.bytes += shard.bytes.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+    size_t size() const {
+        return stats().entries;
+    }
+
+    // 粗粒度的单调时钟，精度是几毫秒，读一次只要几ns
+    static uint64_t now_ms() {
+        struct timespec spec;
+        ::clock_gettime(CLOCK_MONOTONIC_COARSE, &spec);
+        return spec.tv_sec * 1000UL + spec.tv_nsec / 1000000;
+    }
+private:
+    // 每个segment一份，独占cache line
+    struct alignas(hardware_destructive_interference_size) Shard {
+        std::atomic<size_t> entries = {0};
+        std::atomic<size_t> bytes = {0};
+        std::atomic<size_t> clock_hand = {0};
+        std::atomic<uint64_t> hits = {0};
+        std::atomic<uint64_t> misses = {0};
+        std::atomic<uint64_t> evictions = {0};
+        std::atomic<uint64_t> expirations = {0};
+        // 构造之后不变，只在对应的总上限不为0时生效
+        size_t max_entries = {0};
+        size_t max_bytes = {0};
+    };
+
+    // 第segment_id个segment分到的上限
+    static size_t split_budget(size_t total, uint64_t segment_id) {
+        return total / NumShards + (segment_id < total % NumShards ? 1 : 0);
+    }
+
+    static bool expired(const Entry& entry, uint64_t now) {
+        return entry.expire_at_ms != 0 && entry.expire_at_ms <= now;
+    }
+
+    bool over_budget(const Shard& shard) const {
+        return (_options.max_entries && shard.entries.load(std::memory_order_relaxed) > shard.max_entries) ||
+            (_options.max_bytes && shard.bytes.load(std::memory_order_relaxed) > shard.max_bytes);
+    }
+
+    // 在segment内转动CLOCK指针，直到回到上限以内
+    void evict(uint64_t segment_id) {
+        auto& shard = _shards[segment_id];
+        uint64_t now = now_ms();
+        for (int round = 0; round < CONCURRENT_CACHE_MAX_SWEEP_ROUNDS && over_budget(shard); ++round) {
+            // 指针只在回到上限以内时停下，和经典CLOCK一样按需前进；并发淘汰时指针的更新互相覆盖也没关系
+            size_t cursor = shard.clock_hand.load(std::memory_order_relaxed);
+            cursor = _map.visit_segment_buckets(segment_id, cursor, CONCURRENT_CACHE_SWEEP_BUCKETS,
+                    [&](const KeyType& key, const Entry& entry) {
+                bool is_expired = expired(entry, now);
+                if (!is_expired && !over_budget(shard)) {
+                    return false;
+                }
+                if (!is_expired && entry.referenced.load(std::memory_order_relaxed)) {
+                    entry.referenced.store(0, std::memory_order_relaxed);
+                    return true;
+                }
+                // 只删除看到的这个entry，期间被重新put的key不删
+                bool erased = _map.erase_if(key, [&](const Entry& current) {
+                    return &current == &entry;
+                });
+                if (erased) {
+                    shard.entries.fetch_sub(1, std::memory_order_relaxed);
+                    shard.bytes.fetch_sub(entry.charge, std::memory_order_relaxed);
+                    (is_expired ? shard.expirations : shard.evictions).fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            });
+            shard.clock_hand.store(cursor, std::memory_order_relaxed);
+        }
+    }
+private:
+    ConcurrentCacheOptions _options;
+    Map _map;
+    std::array<Shard, NumShards> _shards;
+};
+
+} // namespace
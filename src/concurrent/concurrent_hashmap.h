@@ -4,7 +4,7 @@
 // 1 clear() bug fix done
 // 2 rehash() done
 // 3 Destructor
-// 4 Move Iterator
+// 4 Move Iterator done
 // 5 Lock-free done
 // 6 align allocate
 // 7 size()  done
@@ -15,31 +15,76 @@
 // 12 reserve() done
 // 13 内存泄漏 done
 // 14 lock的提前释放+引用计数+hazptr的使用
-// 15 Allocator替换new和delete
+// 15 Allocator替换new和delete done
 // 16 根据iterator erase元素,  return an iterator to the element that follows the last element removed 
 // 17 根据iterator insert元素 return an iterator pointing to either the 
 //    newly inserted element or to the element that already had an equivalent key in the map
-
+// 18 可选的swiss table segment done
+// 19 bucket粒度的写锁 done
+// 20 增量rehash done
+// 21 transparent lookup + 只算一次hash done
+// 22 multi_find/multi_insert批量接口 done
+// 23 upsert/compute_if_present/assign_if_equal原地修改 done
+// 24 ConstIterator修复 + parallel_for_each done
+// 25 erase_if + 按segment访问bucket，给ConcurrentCache做CLOCK淘汰 done
+// 26 O(1)近似size() + size_exact() + segment占用统计 done
+// 27 可以指定hazptr domain，不和别的容器共用retired链表和record done
+// 28 ReclaimPolicy参数，可以用urcu的QSBR/memb代替hazptr done
+
+#include <array>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <type_traits>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "concurrent_hashmap_detail.h"
+#include "concurrent_hashmap_swiss.h"
+
+// 批量接口的预取距离，大约等于能同时在路上的cache miss个数
+#ifndef CONCURRENT_HASHMAP_PREFETCH_DISTANCE
+#define CONCURRENT_HASHMAP_PREFETCH_DISTANCE 8
+#endif
 
 namespace rcu {
 
+// std::string作为key时使用，可以直接用string_view/const char*查找
+struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const {
+        // 和std::hash<std::string>的结果相同
+        return std::hash<std::string_view>()(s);
+    }
+};
+
 template <
     typename KeyType, 
     typename ValueType, 
     typename HashFn = std::hash<KeyType>,
     typename Allocator = std::allocator<uint8_t>,
-    uint8_t ShardBits = 8>
+    uint8_t ShardBits = 8,
+    // ConcurrentHashMapSegment: 链表 + 每个key一个node
+    // ConcurrentHashMapStripedSegment: 同上，写者只锁bucket所在的stripe
+    // ConcurrentHashMapSwissSegment: open addressing，entry内联，SIMD probe
+    // segment、node和bucket list都用Allocator分配，hazptr回收时也还给Allocator
+    template <typename, typename, typename, uint8_t, typename, typename> class Segment = ConcurrentHashMapSegment,
+    // HazptrReclaimPolicy: 读者逐个发布hazptr，retire的对象攒够一批扫描回收
+    // UrcuQsbrPolicy/UrcuMembPolicy(urcu_policy.h): 读者不发布指针，对象等grace period之后在call_rcu线程上回收
+    typename ReclaimPolicy = HazptrReclaimPolicy>
 class ConcurrentHashMap {
 public:
-    using SegmentT = ConcurrentHashMapSegment<
+    using SegmentT = Segment<
           KeyType,
           ValueType,
           HashFn,
-          ShardBits>;
+          ShardBits,
+          Allocator,
+          ReclaimPolicy>;
+    using Domain = typename ReclaimPolicy::Domain;
     typedef ValueType value_type;
 
     static constexpr uint64_t NumShards = (1 << ShardBits);
@@ -51,20 +96,34 @@ public:
     inline ConcurrentHashMap(size_t init_capacity) noexcept {
         init_capacity_ = nextPowTwo(init_capacity);
     }
+
+    // 读者的保护和node、bucket list的回收都在manager这个domain里，manager要比map活得长
+    inline ConcurrentHashMap(size_t init_capacity, Domain& manager) noexcept
+            : hazptr_manager_(&manager) {
+        init_capacity_ = nextPowTwo(init_capacity);
+    }
     // 禁止拷贝和移动
     inline ConcurrentHashMap(ConcurrentHashMap&&) = delete;
     inline ConcurrentHashMap(const ConcurrentHashMap&) = delete;
     inline ConcurrentHashMap& operator=(ConcurrentHashMap&&) = delete;
     inline ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
 
+    // 调用者保证析构时没有并发的读写。每个segment的对象在segment析构时批量回收，不经过全局retired链表
+    ~ConcurrentHashMap() {
+        for (uint64_t i = 0; i < NumShards; ++i) {
+            SegmentT* seg = segments_[i].load(std::memory_order_acquire);
+            if (seg) {
+                seg->~SegmentT();
+                Allocator().deallocate((uint8_t*)seg, sizeof(SegmentT));
+            }
+        }
+    }
+
     template <typename Key, typename Value>
     std::pair<ConstIterator, bool> insert(Key&& key, Value&& value) {
         auto hash = HashFn()(key);
-        auto segment_id = pickSegment(key);
-        std::pair<ConstIterator, bool> res(
-            std::piecewise_construct,
-            std::forward_as_tuple(segment_id),
-            std::forward_as_tuple(false));
+        auto segment_id = pickSegment(hash);
+        std::pair<ConstIterator, bool> res(ConstIterator(segment_id), false);
 
         res.second = ensureSegment(segment_id)->insert(hash, std::forward<Key>(key), std::forward<Value>(value));
 
@@ -74,7 +133,7 @@ public:
   template <typename Key, typename Value>
   std::pair<ConstIterator, bool> insert_or_assign(Key&& k, Value&& v) {
     auto hash = HashFn()(k);
-    auto segment = pickSegment(k);
+    auto segment = pickSegment(hash);
     std::pair<ConstIterator, bool> res(
         std::piecewise_construct,
         std::forward_as_tuple(this, segment),
@@ -87,27 +146,32 @@ public:
     template <typename... Args>
     std::pair<ConstIterator, bool> emplace(Args&&... args) {
         using Node = typename SegmentT::Node;
-        Node* new_node = new Node(std::forward<Args>(args)...);
+        Node* new_node = Node::create(std::forward<Args>(args)...);
         const KeyType& key = new_node->value_holder_.key;
         auto hash = HashFn()(key);
-        auto segment_id = pickSegment(key);
+        auto segment_id = pickSegment(hash);
 
-        std::pair<ConstIterator, bool> res(
-            std::piecewise_construct,
-            std::forward_as_tuple(segment_id),
-            std::forward_as_tuple(false));
+        std::pair<ConstIterator, bool> res(ConstIterator(segment_id), false);
 
-        bool ret = ensureSegment(segment_id)->emplace(hash, key, new_node);
-        if (!ret) {
-            delete new_node;
-        }
-        res.second = ret;
+        // 失败时node由segment释放
+        res.second = ensureSegment(segment_id)->emplace(hash, key, new_node);
         return res;
     }
 
       ConstIterator find(const KeyType& k) const {
-        auto hash = HashFn()(k);
-        auto segment = pickSegment(k);
+        return find(k, HashFn()(k));
+      }
+
+      // HashFn定义了is_transparent时，可以直接用string_view之类的类型查找，不用先构造KeyType
+      template <typename K, typename H = HashFn, typename = typename H::is_transparent>
+      ConstIterator find(const K& k) const {
+        return find(k, HashFn()(k));
+      }
+
+      // 调用方已经算好了hash，必须和HashFn()(k)相等
+      template <typename K>
+      ConstIterator find(const K& k, size_t hash) const {
+        auto segment = pickSegment(hash);
         ConstIterator res(this, segment);
         auto seg = segments_[segment].load(std::memory_order_acquire);
         //auto seg = segments_[segment];
@@ -117,9 +181,144 @@ public:
         return res;
       }
 
-  void erase(const KeyType& k) {
-    auto segment = pickSegment(k);
+  // key存在时对value调用fn(ValueType&)，不存在时对ValueType()调用fn后插入，返回是否新插入了key
+  template <typename K, typename Fn>
+  bool upsert(const K& k, Fn&& fn) {
+    auto hash = HashFn()(k);
+    auto result = ensureSegment(pickSegment(hash))->update(hash, k,
+        [&](ValueType& value) { fn(value); return true; }, true);
+    return result == UpdateResult::INSERTED;
+  }
+
+  // key存在时对value调用fn(ValueType&)，返回key是否存在
+  template <typename K, typename Fn>
+  bool compute_if_present(const K& k, Fn&& fn) {
     auto hash = HashFn()(k);
+    auto seg = segments_[pickSegment(hash)].load(std::memory_order_acquire);
+    if (!seg) {
+      return false;
+    }
+    auto result = seg->update(hash, k,
+        [&](ValueType& value) { fn(value); return true; }, false);
+    return result == UpdateResult::UPDATED;
+  }
+
+  // 当前value等于expected时改成desired，返回是否修改
+  template <typename K>
+  bool assign_if_equal(const K& k, const ValueType& expected, const ValueType& desired) {
+    auto hash = HashFn()(k);
+    auto seg = segments_[pickSegment(hash)].load(std::memory_order_acquire);
+    if (!seg) {
+      return false;
+    }
+    auto result = seg->update(hash, k, [&](ValueType& value) {
+      if (!(value == expected)) {
+        return false;
+      }
+      value = desired;
+      return true;
+    }, false);
+    return result == UpdateResult::UPDATED;
+  }
+
+  // 只用于算术类型的value，返回加之前的值，key不存在时从0开始加
+  template <typename K>
+  ValueType fetch_add(const K& k, ValueType delta) {
+    static_assert(std::is_arithmetic<ValueType>::value, "fetch_add needs an arithmetic value type");
+    ValueType old_value = ValueType();
+    upsert(k, [&](ValueType& value) {
+      old_value = value;
+      value += delta;
+    });
+    return old_value;
+  }
+
+  /** 批量查找，out[i]对应keys[i]，返回找到的个数。
+   *  先算出所有key的hash并按segment分组，然后流水线地处理：
+   *  第i个key查找的时候，第i+PREFETCH_DISTANCE/2个key的头节点和第i+PREFETCH_DISTANCE个key的bucket在预取。
+   *  整个batch共用一组iterator上的hazptr，value拷贝到out里。
+   */
+  template <typename K>
+  size_t multi_find(const std::vector<K>& keys, std::vector<std::optional<ValueType>>& out) const {
+    constexpr size_t distance = CONCURRENT_HASHMAP_PREFETCH_DISTANCE;
+    constexpr size_t half = distance / 2;
+    size_t n = keys.size();
+    out.assign(n, std::nullopt);
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> order;
+    group_by_segment(keys, hashes, order);
+
+    // 同时在流水线上的key最多distance+1个，每个占一个slot
+    std::array<typename SegmentT::Iterator, distance + 1> slots;
+    std::array<SegmentT*, distance + 1> slot_segments;
+    size_t found = 0;
+    for (size_t i = 0; i < n + distance; ++i) {
+      if (i < n) {
+        uint32_t idx = order[i];
+        SegmentT* seg = segments_[pickSegment(hashes[idx])].load(std::memory_order_acquire);
+        slot_segments[i % (distance + 1)] = seg;
+        if (seg) {
+          seg->prefetch_bucket(hashes[idx], slots[i % (distance + 1)]);
+        }
+      }
+      if (i >= half && i - half < n) {
+        size_t j = i - half;
+        SegmentT* seg = slot_segments[j % (distance + 1)];
+        if (seg) {
+          seg->prefetch_node(slots[j % (distance + 1)]);
+        }
+      }
+      if (i >= distance) {
+        size_t j = i - distance;
+        uint32_t idx = order[j];
+        SegmentT* seg = slot_segments[j % (distance + 1)];
+        auto& iter = slots[j % (distance + 1)];
+        if (seg && seg->find_prefetched(hashes[idx], iter, keys[idx])) {
+          out[idx].emplace(*iter);
+          found++;
+        }
+      }
+    }
+    return found;
+  }
+
+  // 批量插入，keys和values一一对应，返回insert成功的个数。按segment分组后预取bucket再插入
+  template <typename K, typename V>
+  size_t multi_insert(const std::vector<K>& keys, const std::vector<V>& values) {
+    constexpr size_t distance = CONCURRENT_HASHMAP_PREFETCH_DISTANCE;
+    DCHECK(keys.size() == values.size());
+    size_t n = keys.size();
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> order;
+    group_by_segment(keys, hashes, order);
+
+    std::array<typename SegmentT::Iterator, distance + 1> slots;
+    size_t inserted = 0;
+    for (size_t i = 0; i < n + distance; ++i) {
+      if (i < n) {
+        uint32_t idx = order[i];
+        ensureSegment(pickSegment(hashes[idx]))->prefetch_bucket(hashes[idx], slots[i % (distance + 1)]);
+      }
+      if (i >= distance) {
+        uint32_t idx = order[i - distance];
+        inserted += ensureSegment(pickSegment(hashes[idx]))->insert(hashes[idx], keys[idx], values[idx]);
+      }
+    }
+    return inserted;
+  }
+
+  void erase(const KeyType& k) {
+    erase(k, HashFn()(k));
+  }
+
+  template <typename K, typename H = HashFn, typename = typename H::is_transparent>
+  void erase(const K& k) {
+    erase(k, HashFn()(k));
+  }
+
+  template <typename K>
+  void erase(const K& k, size_t hash) {
+    auto segment = pickSegment(hash);
     auto seg = segments_[segment].load(std::memory_order_acquire);
     //auto seg = segments_[segment];
     if (!seg) {
@@ -129,7 +328,36 @@ public:
     }
   }
 
+  // 在写锁内对当前的value调用pred，返回true才删除，返回是否删除
+  template <typename K, typename Pred>
+  bool erase_if(const K& k, Pred&& pred) {
+    auto hash = HashFn()(k);
+    auto seg = segments_[pickSegment(hash)].load(std::memory_order_acquire);
+    return seg && seg->erase_if(hash, k, std::forward<Pred>(pred));
+  }
+
+  // key所在的segment
+  template <typename K>
+  uint64_t segment_id_of(const K& k) const {
+    return pickSegment(HashFn()(k));
+  }
+
+  /** 访问第segment_id个segment从cursor开始的max_buckets个bucket，fn(const KeyType&, const ValueType&)
+   *  返回false时停止，返回下一次的cursor。给上层按segment做CLOCK淘汰用，fn里可以调用erase/erase_if。
+   */
+  template <typename Fn>
+  size_t visit_segment_buckets(uint64_t segment_id, size_t cursor, size_t max_buckets, Fn&& fn) {
+    auto seg = segments_[segment_id].load(std::memory_order_acquire);
+    if (!seg) {
+      return cursor;
+    }
+    return seg->visit_buckets(cursor, max_buckets, std::forward<Fn>(fn));
+  }
+
 
+  /** 按segment顺序遍历，每个segment内用segment的hazptr iterator，是弱一致的：
+   *  遍历期间插入和删除的key可能访问到也可能访问不到。需要每个key恰好一次时用for_each/parallel_for_each。
+   */
   class ConstIterator {
    public:
     friend class ConcurrentHashMap;
@@ -142,8 +370,12 @@ public:
       return &*it_;
     }
 
+    const KeyType& key() const {
+      return it_.key();
+    }
+
     ConstIterator& operator++() {
-      it_++;
+      ++it_;
       next();
       return *this;
     }
@@ -154,8 +386,9 @@ public:
       return prev;
     }
 
+    // 所有走到末尾的iterator都相等
     bool operator==(const ConstIterator& o) const {
-      return it_ == o.it_ && segment_ == o.segment_;
+      return segment_ == o.segment_ && (segment_ == NumShards || it_ == o.it_);
     }
 
     bool operator!=(const ConstIterator& o) const {
@@ -165,23 +398,34 @@ public:
     ConstIterator& operator=(const ConstIterator& o) {
       it_ = o.it_;
       segment_ = o.segment_;
+      parent_ = o.parent_;
       return *this;
     }
 
-    ConstIterator(const ConstIterator& o) {
-      it_ = o.it_;
+    ConstIterator& operator=(ConstIterator&& o) {
+      it_ = std::move(o.it_);
       segment_ = o.segment_;
+      parent_ = o.parent_;
+      return *this;
     }
 
+    ConstIterator(const ConstIterator& o)
+        : it_(o.it_), segment_(o.segment_), parent_(o.parent_) {}
+
+    ConstIterator(ConstIterator&& o)
+        : it_(std::move(o.it_)), segment_(o.segment_), parent_(o.parent_) {}
+
     ConstIterator(const ConcurrentHashMap* parent, uint64_t segment)
         : segment_(segment), parent_(parent) {}
 
    private:
-    // cbegin iterator
+    // cbegin iterator，不创建segment
     explicit ConstIterator(const ConcurrentHashMap* parent)
-        : it_(parent->ensureSegment(0)->cbegin()),
-          segment_(0),
-          parent_(parent) {
+        : segment_(0), parent_(parent) {
+      auto seg = parent_->segments_[0].load(std::memory_order_acquire);
+      if (seg) {
+        it_ = seg->cbegin();
+      }
       // Always iterate to the first element, could be in any shard.
       next();
     }
@@ -189,16 +433,15 @@ public:
     // cend iterator
     explicit ConstIterator(uint64_t shards) : segment_(shards) {}
 
+    // 当前segment遍历完了就找下一个非空的segment
     void next() {
-      while (it_ == parent_->ensureSegment(segment_)->cend() &&
-             segment_ < parent_->NumShards) {
+      while (segment_ < NumShards && it_.at_end()) {
         segment_++;
+        if (segment_ == NumShards) {
+          break;
+        }
         auto seg = parent_->segments_[segment_].load(std::memory_order_acquire);
-        //auto seg = parent_->segments_[segment_];
-        if (segment_ < parent_->NumShards) {
-          if (!seg) {
-            continue;
-          }
+        if (seg) {
           it_ = seg->cbegin();
         }
       }
@@ -206,9 +449,36 @@ public:
 
     typename SegmentT::Iterator it_;
     uint64_t segment_;
-    const ConcurrentHashMap* parent_;
+    const ConcurrentHashMap* parent_ = {nullptr};
   };
 
+    // 单线程遍历，fn(const KeyType&, const ValueType&)，每个segment内遍历期间一直存在的key恰好访问一次
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        parallel_for_each(std::forward<Fn>(fn), 1);
+    }
+
+    /** 多个线程并发遍历不同的segment，fn会被并发调用，需要自己保证线程安全。
+     *  threads<=0时使用OpenMP默认的线程数。
+     */
+    template <typename Fn>
+    void parallel_for_each(Fn&& fn, int threads) const {
+#ifdef _OPENMP
+        if (threads <= 0) {
+            threads = omp_get_max_threads();
+        }
+#endif
+        threads = std::max(threads, 1);
+        // segment大小不均匀，动态分配
+        #pragma omp parallel for schedule(dynamic) num_threads(threads)
+        for (int64_t i = 0; i < static_cast<int64_t>(NumShards); ++i) {
+            auto seg = segments_[i].load(std::memory_order_acquire);
+            if (seg) {
+                seg->for_each(fn);
+            }
+        }
+    }
+
       ConstIterator cend() const noexcept {
         return ConstIterator(NumShards);
       }
@@ -218,7 +488,7 @@ public:
       }
 
     void clear() {
-        for (int i = 0; i < NumShards; i++) {
+        for (uint64_t i = 0; i < NumShards; i++) {
             auto* segment = segments_[i].load(std::memory_order_acquire);
             //auto* segment = segments_[i];
             if (segment) {
@@ -229,7 +499,7 @@ public:
 
     void reserve(size_t capacity) {
         auto bucket_count = capacity >> ShardBits;
-        for (int i = 0; i < NumShards; i++) {
+        for (uint64_t i = 0; i < NumShards; i++) {
             SegmentT* segment = segments_[i].load(std::memory_order_acquire);
             //SegmentT* segment = segments_[i];
             if (segment) {
@@ -238,20 +508,90 @@ public:
         }
     }
 
+    // 扩容时每次写操作额外迁移的bucket个数，0表示一次性迁移完
+    void set_migrate_batch(size_t migrate_batch) {
+        migrate_batch_.store(migrate_batch, std::memory_order_relaxed);
+        for (uint64_t i = 0; i < NumShards; i++) {
+            SegmentT* segment = segments_[i].load(std::memory_order_acquire);
+            if (segment) {
+                segment->set_migrate_batch(migrate_batch);
+            }
+        }
+    }
+
+    // O(1)的近似大小，只读分片计数器，并发修改时可能和真实值有偏差，适合每个请求都调用的监控
     size_t size() const {
+        // 不同线程的insert和erase记在不同分片上，读到一半时可能是负的
+        return std::max<int64_t>(size_counter_.sum(), 0);
+    }
+
+    /** 持有所有segment的写锁时的大小，是某一时刻的准确值，代价是短暂阻塞所有写者。
+     *  多个size_exact之间互斥，避免第二轮补锁新建的segment时和别的size_exact死锁。
+     */
+    size_t size_exact() const {
+        std::lock_guard<std::mutex> g(size_exact_mutex_);
+        std::array<SegmentT*, NumShards> locked = {nullptr};
+        for (uint64_t i = 0; i < NumShards; i++) {
+            locked[i] = segments_[i].load(std::memory_order_acquire);
+            if (locked[i]) {
+                locked[i]->lock_all();
+            }
+        }
+        // 加锁期间新建的segment也要锁上，否则它上面已经完成的写入不在快照里
+        for (uint64_t i = 0; i < NumShards; i++) {
+            if (!locked[i]) {
+                locked[i] = segments_[i].load(std::memory_order_acquire);
+                if (locked[i]) {
+                    locked[i]->lock_all();
+                }
+            }
+        }
         size_t result = 0;
-        for (int i = 0; i < NumShards; i++) {
-            auto* segment = segments_[i].load(std::memory_order_acquire);
-            //auto* segment = segments_[i];
+        for (auto* segment : locked) {
             if (segment) {
                 result += segment->size();
             }
         }
+        for (auto* segment : locked) {
+            if (segment) {
+                segment->unlock_all();
+            }
+        }
         return result;
     }
+
+    // 每个segment的占用情况，下标是segment id，没有创建的segment全是0
+    std::vector<SegmentStats> segment_stats() const {
+        std::vector<SegmentStats> stats(NumShards);
+        for (uint64_t i = 0; i < NumShards; i++) {
+            auto* segment = segments_[i].load(std::memory_order_acquire);
+            if (segment) {
+                stats[i] = segment->stats();
+            }
+        }
+        return stats;
+    }
 private:
-  uint64_t pickSegment(const KeyType& k) const {
-    auto h = HashFn()(k);
+  // 算出所有key的hash，order是按segment计数排序之后的下标，同一个segment内保持原来的顺序
+  template <typename K>
+  void group_by_segment(const std::vector<K>& keys, std::vector<uint64_t>& hashes, std::vector<uint32_t>& order) const {
+    size_t n = keys.size();
+    hashes.resize(n);
+    order.resize(n);
+    std::array<uint32_t, NumShards + 1> offsets = {0};
+    for (size_t i = 0; i < n; ++i) {
+      hashes[i] = HashFn()(keys[i]);
+      offsets[pickSegment(hashes[i]) + 1]++;
+    }
+    for (size_t i = 1; i <= NumShards; ++i) {
+      offsets[i] += offsets[i - 1];
+    }
+    for (size_t i = 0; i < n; ++i) {
+      order[offsets[pickSegment(hashes[i])]++] = i;
+    }
+  }
+
+  uint64_t pickSegment(uint64_t h) const {
     // Use the lowest bits for our shard bits.
     //
     // This works well even if the hash function is biased towards the
@@ -280,7 +620,9 @@ private:
     if (!seg) {
       SegmentT* newseg = (SegmentT*)Allocator().allocate(sizeof(SegmentT));
       newseg = new (newseg)
-          SegmentT(init_capacity_ >> ShardBits, load_factor_);
+          SegmentT(init_capacity_ >> ShardBits, load_factor_, *hazptr_manager_);
+      newseg->set_migrate_batch(migrate_batch_.load(std::memory_order_relaxed));
+      newseg->set_size_counter(&size_counter_);
       if (!segments_[i].compare_exchange_strong(seg, newseg)) {
         // seg is updated with new value, delete ours.
         newseg->~SegmentT();
@@ -298,8 +640,35 @@ private:
     mutable std::atomic<SegmentT*> segments_[NumShards] {nullptr};
     //mutable SegmentT* segments_[NumShards] = {nullptr};
     float load_factor_ = {1.05};
+    std::atomic<size_t> migrate_batch_ = {CONCURRENT_HASHMAP_MIGRATE_BATCH};
+    // 所有segment的size变化都累加到这里，size()不用遍历segment
+    mutable StripedCounter size_counter_;
+    mutable std::mutex size_exact_mutex_;
+    Domain* hazptr_manager_ = {&ReclaimPolicy::default_domain()};
 };
 
+// 写者只锁bucket所在stripe的ConcurrentHashMap
+template <
+    typename KeyType,
+    typename ValueType,
+    typename HashFn = std::hash<KeyType>,
+    typename Allocator = std::allocator<uint8_t>,
+    uint8_t ShardBits = 8,
+    typename ReclaimPolicy = HazptrReclaimPolicy>
+using StripedConcurrentHashMap = ConcurrentHashMap<
+    KeyType, ValueType, HashFn, Allocator, ShardBits, ConcurrentHashMapStripedSegment, ReclaimPolicy>;
+
+// 使用swiss table segment的ConcurrentHashMap
+template <
+    typename KeyType,
+    typename ValueType,
+    typename HashFn = std::hash<KeyType>,
+    typename Allocator = std::allocator<uint8_t>,
+    uint8_t ShardBits = 8,
+    typename ReclaimPolicy = HazptrReclaimPolicy>
+using SwissConcurrentHashMap = ConcurrentHashMap<
+    KeyType, ValueType, HashFn, Allocator, ShardBits, ConcurrentHashMapSwissSegment, ReclaimPolicy>;
+
 }
 
 
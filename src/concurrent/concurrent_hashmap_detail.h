@@ -1,21 +1,100 @@
 #pragma once
 
-#define USE_THREAD_LOCAL_CACHE false
-#define HAZPTR_RECORD_CACHE_SIZE 10
-#define HAZPTR_SCAN_MULT 2
-#define HAZPTR_SCAN_THRESHOLD 5
-
+#include <array>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <type_traits>
+#include <thread>
+#include "debug.h"
 #include "hazptr.h"
 //#include "folly_hazptr.h"
 #include "memory_resource.h"
 
 #define DEBUG 0
 
+// striped模式下每个segment的bucket锁个数
+#ifndef SEGMENT_LOCK_STRIPES
+#define SEGMENT_LOCK_STRIPES 64
+#endif
+
+// map大小计数器的分片个数
+#ifndef CONCURRENT_HASHMAP_COUNTER_STRIPES
+#define CONCURRENT_HASHMAP_COUNTER_STRIPES 64
+#endif
+
+// 增量rehash时每次写操作额外迁移的bucket个数
+#ifndef CONCURRENT_HASHMAP_MIGRATE_BATCH
+#define CONCURRENT_HASHMAP_MIGRATE_BATCH 8
+#endif
+
 namespace rcu {
 
+// 独占一个cache line的自旋锁，临界区只有几次指针操作，不值得进内核
+class alignas(hardware_destructive_interference_size) SpinLock {
+public:
+    void lock() {
+        while (_locked.exchange(true, std::memory_order_acquire)) {
+            // 先只读等待，避免反复抢占cache line；持锁线程被调度出去时让出cpu
+            for (int spins = 0; _locked.load(std::memory_order_relaxed); ++spins) {
+                if (spins < 128) {
+#if defined(__x86_64__) || defined(__i386__)
+                    __builtin_ia32_pause();
+#endif
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+    void unlock() {
+        _locked.store(false, std::memory_order_release);
+    }
+private:
+    std::atomic<bool> _locked = {false};
+};
+
+/** 分片的计数器，每个分片独占一个cache line。
+ *  线程第一次使用时按轮转分到一个分片，之后只写自己的分片，线程数不超过分片数时写入没有竞争。
+ *  读的时候把所有分片加起来，并发修改时结果是近似的。
+ */
+class StripedCounter {
+public:
+    void add(int64_t delta) {
+        stripes_[stripe_id()].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+    int64_t sum() const {
+        int64_t result = 0;
+        for (auto& stripe : stripes_) {
+            result += stripe.value.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+private:
+    static size_t stripe_id() {
+        static std::atomic<size_t> next_id = {0};
+        static thread_local size_t id = next_id.fetch_add(1, std::memory_order_relaxed) % CONCURRENT_HASHMAP_COUNTER_STRIPES;
+        return id;
+    }
+    struct alignas(hardware_destructive_interference_size) Stripe {
+        std::atomic<int64_t> value = {0};
+    };
+    std::array<Stripe, CONCURRENT_HASHMAP_COUNTER_STRIPES> stripes_;
+};
+
+// 单个segment的占用情况，用来发现分布不好的hash函数
+struct SegmentStats {
+    size_t size = {0};
+    size_t bucket_count = {0};
+    // size / bucket_count
+    double load_factor = {0};
+    // 链表segment是最长的链表长度，swiss segment是最长的探测group数
+    size_t longest_chain = {0};
+    // 扩容(包括swiss原地清理tombstone)的次数
+    size_t rehash_count = {0};
+};
+
 template<typename T>
 int print_list(std::string name, T* head) {
     return 0;
@@ -58,6 +137,70 @@ class HazptrDeleter {
   }
 };
 
+// 用无状态的Allocator(每次临时构造一个，和ensureSegment一样)分配对象，Allocator按字节分配
+template <typename T, typename Allocator, typename... Args>
+T* allocator_new(Args&&... args) {
+    void* p = Allocator().allocate(sizeof(T));
+    return new (p) T(std::forward<Args>(args)...);
+}
+
+template <typename T, typename Allocator>
+void allocator_delete(T* p) {
+    p->~T();
+    Allocator().deallocate(reinterpret_cast<uint8_t*>(p), sizeof(T));
+}
+
+/** bucket数组要求全0。Allocator提供allocate_zeroed时用它，否则分配之后再清零。
+ *  std::allocator保持calloc：大块内存直接拿全0的匿名页，扩容时不用在锁内逐个清零。
+ */
+template <typename Allocator>
+class ZeroedAllocator {
+public:
+    static void* allocate(size_t bytes) {
+        return allocate_impl<Allocator>(bytes, 0);
+    }
+    static void deallocate(void* p, size_t bytes) {
+        Allocator().deallocate(static_cast<uint8_t*>(p), bytes);
+    }
+private:
+    template <typename A>
+    static auto allocate_impl(size_t bytes, int) -> decltype(A().allocate_zeroed(bytes)) {
+        return A().allocate_zeroed(bytes);
+    }
+    template <typename A>
+    static uint8_t* allocate_impl(size_t bytes, long) {
+        uint8_t* p = A().allocate(bytes);
+        memset(p, 0, bytes);
+        return p;
+    }
+};
+
+template <>
+class ZeroedAllocator<std::allocator<uint8_t>> {
+public:
+    static void* allocate(size_t bytes) {
+        return calloc(bytes, 1);
+    }
+    static void deallocate(void* p, size_t) {
+        free(p);
+    }
+};
+
+// segment上update操作的结果
+enum class UpdateResult {
+    NOT_FOUND,  // key不存在，没有插入
+    UNCHANGED,  // key存在，fn决定不修改
+    UPDATED,    // key存在，已修改
+    INSERTED    // key不存在，已插入
+};
+
+// 读者不加锁读value，只有一次原子store能写完的值才能在写锁内原地修改，其它类型要换一个新的node
+template <typename T>
+constexpr bool inplace_updatable() {
+    return std::is_trivially_copyable<T>::value &&
+        (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+}
+
 template <typename KeyType, typename ValueType>
 struct ValueHolder {
     // 使用初始化列表，原地构造key和value
@@ -70,8 +213,9 @@ struct ValueHolder {
     ValueType value;
 };
 
-template <typename KeyType, typename ValueType>
-class NodeT : public rcu::HazptrNode<NodeT<KeyType,ValueType>> {
+template <typename KeyType, typename ValueType, typename Allocator = std::allocator<uint8_t>,
+         typename ReclaimPolicy = HazptrReclaimPolicy>
+class NodeT : public ReclaimPolicy::template Node<NodeT<KeyType, ValueType, Allocator, ReclaimPolicy>> {
 //class NodeT : public folly::hazptr::hazptr_obj_base<NodeT<KeyType, ValueType>, HazptrDeleter> {
 //class NodeT : public TestObj {
 //class NodeT {
@@ -91,6 +235,18 @@ public:
     inline NodeT(NodeT&&) noexcept = delete;
     inline NodeT& operator=(NodeT&&) noexcept = delete;
 
+    // node的分配和回收都走Allocator，不能直接new/delete
+    template <typename...Args>
+    static NodeT* create(Args&&... args) {
+        return allocator_new<NodeT, Allocator>(std::forward<Args>(args)...);
+    }
+    static void destroy(NodeT* node) {
+        allocator_delete<NodeT, Allocator>(node);
+    }
+    void reclaim() override {
+        destroy(this);
+    }
+
     ValueHolder<KeyType, ValueType>* get_value_holder() {
         return &value_holder_;
     }
@@ -120,11 +276,27 @@ public:
     std::atomic<uint16_t>  refcount_{1}; //链表上的每个node初始化都被上一个node引用
 };
 
+/** 链表实现的segment。
+ *
+ *  StripedLock为false时写者之间用一把m_互斥；
+ *  为true时写者只锁bucket所在的stripe(bucket_id % SEGMENT_LOCK_STRIPES)，
+ *  不同bucket的写入可以并行，rehash/clear持有所有的stripe。
+ *
+ *  扩容是增量的：只分配2倍大小的新BucketList，旧的挂在old_bucket_list_上，
+ *  之后每个写者顺路迁移自己要写的bucket，再额外迁移migrate_batch_个bucket。
+ *  迁移完的旧bucket头部放一个转发标记(forward_marker)，读者看到后去新表里找。
+ *  所有bucket迁移完之后旧表通过hazptr回收，单次insert不会再因为扩容卡住。
+ *
+ *  node和bucket list的保护、回收都通过ReclaimPolicy，默认是hazptr，也可以换成urcu_policy.h里的QSBR/memb。
+ */
 template <
     typename KeyType, 
     typename ValueType, 
     typename HashFn,
-    uint8_t ShardBits>
+    uint8_t ShardBits,
+    typename Allocator = std::allocator<uint8_t>,
+    typename ReclaimPolicy = HazptrReclaimPolicy,
+    bool StripedLock = false>
 class ConcurrentHashMapSegment {
     enum class InsertType {
         DISCARD_IF_EXIST,
@@ -132,25 +304,40 @@ class ConcurrentHashMapSegment {
         ANY
     };
 public:
-    using Node = NodeT<KeyType, ValueType>;
-    class BucketList : public HazptrNode<BucketList> {
+    using Node = NodeT<KeyType, ValueType, Allocator, ReclaimPolicy>;
+    using Domain = typename ReclaimPolicy::Domain;
+    using ReclaimHolder = typename ReclaimPolicy::Holder;
+
+    // 已经迁移到新表的旧bucket的头部，不是一个真实的node
+    static Node* forward_marker() {
+        return reinterpret_cast<Node*>(1);
+    }
+    static bool is_forward(Node* node) {
+        return node == forward_marker();
+    }
+
+    class BucketList : public ReclaimPolicy::template Node<BucketList> {
     //class BucketList : public folly::hazptr::hazptr_obj_base<BucketList, HazptrDeleter> {
     public:
         explicit BucketList(size_t buckets_count) {
             buckets_count_ = buckets_count;
-            buckets_ = new std::atomic<Node*>[bucket_count()];
-            for (int i = 0; i < bucket_count(); ++i) {
-                buckets_[i] = nullptr;
-            }
+            buckets_ = static_cast<std::atomic<Node*>*>(
+                    ZeroedAllocator<Allocator>::allocate(bucket_count() * sizeof(std::atomic<Node*>)));
         }
         ~BucketList() {
-            for (int i = 0; i < bucket_count(); ++i) {
+            for (size_t i = 0; i < bucket_count(); ++i) {
                 Node* head = get_head(i);
-                if (head) {
+                if (head && !is_forward(head)) {
                     head->release();
                 }
             }
-            //delete buckets_;
+            ZeroedAllocator<Allocator>::deallocate(buckets_, bucket_count() * sizeof(std::atomic<Node*>));
+        }
+        static BucketList* create(size_t buckets_count) {
+            return allocator_new<BucketList, Allocator>(buckets_count);
+        }
+        void reclaim() override {
+            allocator_delete<BucketList, Allocator>(this);
         }
         Node* get_head(int bucket_id) {
             return buckets_[bucket_id].load(std::memory_order_acquire);
@@ -165,17 +352,27 @@ public:
             return buckets_count_;
         }
     private:
+        friend class ConcurrentHashMapSegment;
         size_t buckets_count_ = {0};
         std::atomic<Node*>* buckets_ = {nullptr};
     };
+
+    /** 迭代器先遍历旧表里还没迁移的bucket，再遍历新表。
+     *  遍历期间如果有bucket被迁移，同一个key可能被访问到两次。
+     */
     class Iterator {
     public:
         Iterator() {}
+        explicit Iterator(Domain& manager)
+            : holder_bucket(manager), holder_old(manager), holder_node(manager), holder_next(manager) {}
         ~Iterator() {}
 
-        void init(BucketList* bucket_list) {
+        void init(BucketList* bucket_list, BucketList* old_list) {
             bucket_list_ = bucket_list;
-            node_ = bucket_list_->get_head(bucket_id_);
+            old_list_ = old_list;
+            list_ = old_list ? old_list : bucket_list;
+            bucket_id_ = 0;
+            node_ = load_head();
             advanceBucketIfAtEnd();
         }
 
@@ -189,25 +386,38 @@ public:
             return &(node_->get_value_holder()->value);
         }
 
+        const KeyType& key() const {
+            DCHECK(node_);
+            return node_->get_value_holder()->key;
+        }
+
+        // 和cend()相等，不用构造一个新的Iterator去比较
+        bool at_end() const {
+            return node_ == nullptr;
+        }
+
         void advanceBucketIfAtEnd() {
-            LOG(NOTICE) << "advanceBucketIfAtEnd";
             while (node_ == nullptr) {
                 bucket_id_++;
-                if (bucket_id_ >= bucket_list_->bucket_count()) {
-                    break;
+                if (bucket_id_ >= list_->bucket_count()) {
+                    if (list_ == bucket_list_) {
+                        break;
+                    }
+                    // 旧表遍历完了，接着遍历新表
+                    list_ = bucket_list_;
+                    bucket_id_ = 0;
                 }
-                DCHECK(bucket_list_);
-                DCHECK(bucket_list_->buckets_);
-                //auto* atomic_head = bucket_list_->get_atomic_head(bucket_id_);
-                //node_ = holder_node.get_protected(*atomic_head);
-                node_ = holder_node.get_protected(bucket_list_->buckets_[bucket_id_]);
+                node_ = load_head();
             }
         }
 
         // 前置操作重载
         const Iterator& operator++() {
             DCHECK(node_);
-            node_ = holder_node.get_protected(node_->next_);
+            // 先保护下一个节点，再放弃当前节点
+            Node* next = holder_next.get_protected(node_->next_);
+            holder_next.swap(holder_node);
+            node_ = next;
             advanceBucketIfAtEnd();
             return *this;
         }
@@ -227,89 +437,156 @@ public:
             return !(*this == o);
         }
 
+        // o仍然持有保护，所以这里直接发布同样的指针是安全的
         Iterator& operator=(const Iterator& o) {
-            node_ = o.node_;
-            bucket_list_ = o.bucket_list_;
-            bucket_id_ = o.bucket_id_;
+            copy_from(o);
             return *this;
         }
 
         Iterator(const Iterator& o) {
+            copy_from(o);
+        }
+
+        Iterator(Iterator&& o) {
+            move_from(o);
+        }
+
+        Iterator& operator=(Iterator&& o) {
+            move_from(o);
+            return *this;
+        }
+    private:
+        friend class ConcurrentHashMapSegment;
+
+        // 默认构造的iterator(比如map的find结果)在segment第一次保护之前换到segment的domain
+        void set_manager(Domain& manager) {
+            if (&holder_bucket.manager() != &manager) {
+                holder_bucket.set_manager(manager);
+                holder_old.set_manager(manager);
+                holder_node.set_manager(manager);
+                holder_next.set_manager(manager);
+            }
+        }
+
+        void copy_from(const Iterator& o) {
+            set_manager(o.holder_bucket.manager());
             node_ = o.node_;
             bucket_list_ = o.bucket_list_;
+            old_list_ = o.old_list_;
+            list_ = o.list_;
             bucket_id_ = o.bucket_id_;
+            holder_bucket.reset(bucket_list_);
+            holder_old.reset(old_list_);
+            holder_node.reset(node_);
         }
 
-        Iterator(Iterator&& o) {
+        void move_from(Iterator& o) {
             node_ = o.node_;
             bucket_list_ = o.bucket_list_;
+            old_list_ = o.old_list_;
+            list_ = o.list_;
             bucket_id_ = o.bucket_id_;
+            holder_bucket.swap(o.holder_bucket);
+            holder_old.swap(o.holder_old);
+            holder_node.swap(o.holder_node);
         }
-    private:
+
+        // 旧表里已经迁移走的bucket当作空bucket
+        Node* load_head() {
+            Node* head = holder_node.get_protected(list_->buckets_[bucket_id_]);
+            return is_forward(head) ? nullptr : head;
+        }
+
         Node* node_ = {nullptr};
         BucketList* bucket_list_ = {nullptr};
+        BucketList* old_list_ = {nullptr};
+        BucketList* list_ = {nullptr};
         uint64_t bucket_id_ = {0};
-        HazptrHolder holder_bucket;
-        HazptrHolder holder_node;
+        ReclaimHolder holder_bucket;
+        ReclaimHolder holder_old;
+        ReclaimHolder holder_node;
+        ReclaimHolder holder_next;
         //folly::hazptr::hazptr_holder holder_bucket;
         //folly::hazptr::hazptr_holder holder_node;
     };
 public:
-    ConcurrentHashMapSegment(size_t buckets_count, float load_factor) {
+    // node和bucket list在manager这个domain里保护和回收
+    ConcurrentHashMapSegment(size_t buckets_count, float load_factor,
+            Domain& manager = ReclaimPolicy::default_domain()) : cohort_(manager) {
         buckets_count = nextPowTwo(buckets_count);
-        bucket_list_ = new BucketList(buckets_count);
+        bucket_list_ = create_bucket_list(buckets_count);
         set_load_factor(load_factor);
     }
 
+    // 调用者保证没有并发的读写。node和bucket list都挂在cohort_上，cohort_析构时一次扫描批量回收
+    ~ConcurrentHashMapSegment() {
+        BucketList* migrating_list = old_bucket_list_.load(std::memory_order_acquire);
+        if (migrating_list) {
+            migrating_list->retire();
+        }
+        get_bucket_list()->retire();
+    }
+
     Iterator cbegin() {
-        Iterator iter;
-        iter.init(bucket_list_);
-        return iter;
+        Iterator iter(hazptr_manager());
+        while (true) {
+            BucketList* bucket_list = iter.holder_bucket.get_protected(bucket_list_);
+            BucketList* old_list = iter.holder_old.get_protected(old_bucket_list_);
+            // 两次读之间可能开始了新的一轮扩容
+            if (bucket_list == bucket_list_.load(std::memory_order_acquire)) {
+                iter.init(bucket_list, old_list);
+                return iter;
+            }
+        }
     }
 
     Iterator cend() {
         return Iterator();
     }
 
-    size_t size() { return size_; }
-    bool empty() { return size_ == 0; }
+    size_t size() { return size_.load(std::memory_order_relaxed); }
+    bool empty() { return size() == 0; }
 
     template <typename Key, typename Value>
     bool insert(uint64_t hash, Key&& key, Value&& value) {
-        Node* new_node = new Node(std::forward<Key>(key), std::forward<Value>(value));
+        Node* new_node = create_node(std::forward<Key>(key), std::forward<Value>(value));
         // Error: bool ret = insert_internal(hash, key, new_node); 不能使用被转发后的变量
         bool ret = insert_internal(hash, new_node->value_holder_.key, new_node);
         if (!ret) {
-            delete new_node;
+            Node::destroy(new_node);
         }
         return ret;
     }
 
+    // 接管node，失败时由segment释放
     bool emplace(uint64_t hash, const KeyType& key, Node* new_node) {
-        return insert_internal(hash, key, new_node);
-     }
+        new_node->set_cohort(&cohort_);
+        bool ret = insert_internal(hash, key, new_node);
+        if (!ret) {
+            Node::destroy(new_node);
+        }
+        return ret;
+    }
 
     bool insert_internal(uint64_t hash, const KeyType& key, Node* new_node) {
-        std::unique_lock<std::mutex> g(m_);
-
-        BucketList* bucket_list = get_bucket_list();
-
-        if (size_ >= load_factor_cnt_threshold_) {
-            rehash(bucket_list->bucket_count() << 1);
-            // reload latest bucket_list
-            bucket_list = get_bucket_list();
+        if (size() >= load_factor_cnt_threshold_.load(std::memory_order_relaxed)) {
+            start_resize();
         }
-        auto bucket_id = (hash >> ShardBits) & (bucket_list->bucket_count() - 1);
+        size_t bucket_id = 0;
+        BucketList* bucket_list = lock_bucket(hash, bucket_id);
+        migrate_for_write(bucket_list, bucket_id);
+
         Node* head = bucket_list->get_head(bucket_id);
         Node* node = head;
         std::atomic<Node*>* prev = bucket_list->get_atomic_head(bucket_id);
-        //std::cout << "size_:" << size_ << " load_factor_cnt_threshold_:" << load_factor_cnt_threshold_ << std::endl;
         // Check if key exist
         while (node) {
             if (key == node->value_holder_.key) {
                 InsertType insert_type = InsertType::ANY;
                 if (insert_type == InsertType::DISCARD_IF_EXIST) {
                     // Will not update existed node
+                    unlock_bucket(bucket_id);
+                    help_migrate();
                     return false;
                 } else {
                     // Replace the existed node
@@ -319,29 +596,102 @@ public:
                     }
                     new_node->next_.store(node_next, std::memory_order_relaxed);
                     prev->store(new_node, std::memory_order_release);
-                    g.unlock();
+                    unlock_bucket(bucket_id);
                     // 回收不需要加锁
                     node->release();
+                    help_migrate();
                     return true;
                 }
             }
             prev = &node->next_;
             node = node->next_.load(std::memory_order_relaxed);
         }
-        size_++;
+        add_size(1);
         new_node->next_.store(head, std::memory_order_relaxed);
         bucket_list->set_head(bucket_id, new_node);
+        unlock_bucket(bucket_id);
+        help_migrate();
         //print_list("bucket_id:" + std::to_string(bucket_id), new_node);
         return true;
     }
 
-    void erase(uint64_t hash, const KeyType& key) {
+    /** 在写锁内找到key，对value的副本调用fn(ValueType&)，fn返回false表示不修改。
+     *  inplace_updatable的value直接原子写回原node，不分配内存；否则换成一个新node，旧node走hazptr回收。
+     *  key不存在并且insert_if_absent时对ValueType()调用fn再插入。
+     */
+    template <typename K, typename Fn>
+    UpdateResult update(uint64_t hash, const K& key, Fn&& fn, bool insert_if_absent) {
+        if (insert_if_absent && size() >= load_factor_cnt_threshold_.load(std::memory_order_relaxed)) {
+            start_resize();
+        }
+        size_t bucket_id = 0;
+        BucketList* bucket_list = lock_bucket(hash, bucket_id);
+        migrate_for_write(bucket_list, bucket_id);
+
+        Node* head = bucket_list->get_head(bucket_id);
+        Node* node = head;
+        std::atomic<Node*>* prev = bucket_list->get_atomic_head(bucket_id);
+        while (node && !(key == node->value_holder_.key)) {
+            prev = &node->next_;
+            node = node->next_.load(std::memory_order_relaxed);
+        }
+        UpdateResult result = UpdateResult::UPDATED;
+        Node* old_node = nullptr;
+        if (node == nullptr) {
+            if (insert_if_absent) {
+                Node* new_node = create_node(KeyType(key), ValueType());
+                fn(new_node->value_holder_.value);
+                add_size(1);
+                new_node->next_.store(head, std::memory_order_relaxed);
+                bucket_list->set_head(bucket_id, new_node);
+                result = UpdateResult::INSERTED;
+            } else {
+                result = UpdateResult::NOT_FOUND;
+            }
+        } else if constexpr (inplace_updatable<ValueType>()) {
+            ValueType value = node->value_holder_.value;
+            if (fn(value)) {
+                __atomic_store(&node->value_holder_.value, &value, __ATOMIC_RELEASE);
+            } else {
+                result = UpdateResult::UNCHANGED;
+            }
+        } else {
+            ValueType value = node->value_holder_.value;
+            if (fn(value)) {
+                Node* new_node = create_node(node->value_holder_.key, std::move(value));
+                Node* node_next = node->next_.load(std::memory_order_relaxed);
+                if (node_next) {
+                    node_next->acquire();
+                }
+                new_node->next_.store(node_next, std::memory_order_relaxed);
+                prev->store(new_node, std::memory_order_release);
+                old_node = node;
+            } else {
+                result = UpdateResult::UNCHANGED;
+            }
+        }
+        unlock_bucket(bucket_id);
+        // 回收不需要加锁
+        if (old_node) {
+            old_node->release();
+        }
+        help_migrate();
+        return result;
+    }
+
+    template <typename K>
+    bool erase(uint64_t hash, const K& key) {
+        return erase_if(hash, key, [](const ValueType&) { return true; });
+    }
+
+    // 在写锁内对当前的value调用pred，返回true才删除，返回是否删除
+    template <typename K, typename Pred>
+    bool erase_if(uint64_t hash, const K& key, Pred&& pred) {
         Node* node = nullptr;
         {
-            std::lock_guard<std::mutex> g(m_);
-
-            BucketList* bucket_list = get_bucket_list();
-            auto bucket_id = (hash >> ShardBits) & (bucket_list->bucket_count() - 1);
+            size_t bucket_id = 0;
+            BucketList* bucket_list = lock_bucket(hash, bucket_id);
+            migrate_for_write(bucket_list, bucket_id);
             //print_list("before delete bucket_id:" + std::to_string(bucket_id) + " key:" + key, bucket_list_->get_head(bucket_id));
             Node* head = bucket_list->get_head(bucket_id);
             node = head;
@@ -354,12 +704,14 @@ public:
                 prev = &node->next_;
                 node = node->next_.load(std::memory_order_relaxed);
             }
-            if (node == nullptr) {
+            if (node == nullptr || !pred(node->value_holder_.value)) {
                 // key not found
-                return;
+                unlock_bucket(bucket_id);
+                help_migrate();
+                return false;
             }
 
-            size_--;
+            add_size(-1);
 
             // separate node from list
             Node* node_next = node->next_.load(std::memory_order_relaxed);
@@ -367,58 +719,141 @@ public:
                 node_next->acquire();
             }
             prev->store(node_next, std::memory_order_release);
+            unlock_bucket(bucket_id);
         }
         // 回收不需要加锁
         if (node) {
             node->release();
         }
+        help_migrate();
         //print_list("after delete bucket_id:" + std::to_string(bucket_id) + " key:" + key, bucket_list_->get_head(bucket_id));
+        return true;
+    }
+
+    /** 从cursor开始访问max_buckets个bucket上的节点，fn(const KeyType&, const ValueType&)返回false时停止，
+     *  返回下一次的cursor(停在中途时就是当前的bucket)。
+     *  cursor对当前表的bucket数取模，用于cache按CLOCK淘汰，fn里可以调用erase。
+     *  迁移过程中新表的两个bucket可能对应旧表的同一个bucket，节点可能被访问两次。
+     */
+    template <typename Fn>
+    size_t visit_buckets(size_t cursor, size_t max_buckets, Fn&& fn) {
+        Iterator iter(hazptr_manager());
+        while (true) {
+            iter.bucket_list_ = iter.holder_bucket.get_protected(bucket_list_);
+            iter.old_list_ = iter.holder_old.get_protected(old_bucket_list_);
+            if (iter.bucket_list_ == bucket_list_.load(std::memory_order_acquire)) {
+                break;
+            }
+        }
+        size_t mask = iter.bucket_list_->bucket_count() - 1;
+        for (size_t i = 0; i < max_buckets; ++i, ++cursor) {
+            iter.bucket_id_ = cursor & mask;
+            if (!load_head(iter)) {
+                // 当前表也开始迁移了，剩下的留给下一次
+                break;
+            }
+            for (Node* node = iter.node_; node; ) {
+                if (!fn(node->value_holder_.key, node->value_holder_.value)) {
+                    return cursor;
+                }
+                node = iter.holder_next.get_protected(node->next_);
+                iter.holder_next.swap(iter.holder_node);
+            }
+        }
+        return cursor;
     }
 
-    bool find(size_t hash, Iterator& iter, const KeyType& key) {
+    template <typename K>
+    bool find(size_t hash, Iterator& iter, const K& key) {
         // 就算find加锁，也会出core
         // 因为iter拿到后锁就释放了，别的线程可以delete了，之后使用iter的时候可能已经被别的线程delete了
         // std::lock_guard<std::mutex> g(m_);
         // 链表遍历过程中一定要同时保护前后2个节点，否则会出core
-
-        BucketList* bucket_list = iter.holder_bucket.get_protected(bucket_list_);
-        auto bucket_id = (hash >> ShardBits) & (bucket_list->bucket_count() - 1);
-        //std::atomic<Node*>& atomic_head = bucket_list->get_atomic_head(bucket_id);
-        Node* node = iter.holder_node.get_protected(bucket_list->buckets_[bucket_id]);
-        //folly::hazptr::hazptr_holder holder_next;
-        HazptrHolder holder_next;
-        while (node) {
-            std::string node_key = node->value_holder_.key;
-            if (key == node_key) {
-                iter.node_ = node;
-                iter.bucket_list_ = bucket_list;
-                iter.bucket_id_ = bucket_id;
-                return true;
+        while (true) {
+            protect_bucket_list(hash, iter);
+            if (load_head(iter)) {
+                return find_in_chain(iter, key);
             }
-            //node = iter.holder_node.get_protected(node->next_);
-            node = holder_next.get_protected(node->next_);
-            holder_next.swap(iter.holder_node);
         }
-        return false;
     }
 
+    /** 批量查找分三步，每一步之间可以穿插别的key的操作，把cache miss叠起来：
+     *  prefetch_bucket保护bucket list并预取bucket头，prefetch_node读出头节点并预取，
+     *  find_prefetched遍历链表。iter在三步之间一直持有保护。
+     */
+    void prefetch_bucket(size_t hash, Iterator& iter) {
+        protect_bucket_list(hash, iter);
+        __builtin_prefetch(&iter.bucket_list_->buckets_[iter.bucket_id_]);
+        if (iter.old_list_) {
+            __builtin_prefetch(&iter.old_list_->buckets_[iter.bucket_id_ & (iter.old_list_->bucket_count() - 1)]);
+        }
+    }
+
+    void prefetch_node(Iterator& iter) {
+        if (!load_head(iter)) {
+            // bucket list在这期间开始了迁移，find_prefetched走普通的find
+            iter.list_ = nullptr;
+            return;
+        }
+        if (iter.node_) {
+            __builtin_prefetch(iter.node_);
+        }
+    }
+
+    template <typename K>
+    bool find_prefetched(size_t hash, Iterator& iter, const K& key) {
+        if (iter.list_ == nullptr) {
+            return find(hash, iter, key);
+        }
+        return find_in_chain(iter, key);
+    }
+
+    /** 遍历整个segment，fn(const KeyType&, const ValueType&)。
+     *  开始前把进行中的迁移做完，遍历期间不开始新的增量迁移，只遍历一张表，
+     *  遍历期间一直存在的key恰好访问一次，遍历期间插入和删除的key可能访问到也可能访问不到。
+     */
+    template <typename Fn>
+    void for_each(Fn&& fn) {
+        scanners_.fetch_add(1);
+        // 加锁之后开始的扩容一定能看到scanners_
+        lock_all();
+        BucketList* old_list = finish_migration_locked();
+        unlock_all();
+        if (old_list) {
+            old_list->retire();
+        }
+        for (auto iter = cbegin(); !iter.at_end(); ++iter) {
+            fn(iter.key(), *iter);
+        }
+        scanners_.fetch_sub(1);
+    }
+
+    // 同步扩容到new_bucket_cnt，会先把进行中的增量迁移做完，不会缩容
     void rehash(size_t new_bucket_cnt) {
+        lock_all();
+        BucketList* old_list = finish_migration_locked();
+        rehash_locked(new_bucket_cnt);
+        unlock_all();
+        if (old_list) {
+            old_list->retire();
+        }
+    }
+
+    // 调用者持有所有写锁，并且没有进行中的增量迁移
+    void rehash_locked(size_t new_bucket_cnt) {
         BucketList* old_bucket_list = get_bucket_list();
-        std::cout << "rehash -> old:" << old_bucket_list->bucket_count() << " new:" << new_bucket_cnt << std::endl;
+        new_bucket_cnt = nextPowTwo(new_bucket_cnt);
+        if (new_bucket_cnt <= old_bucket_list->bucket_count()) {
+            return;
+        }
         // hash     -> [47, 55, 35, 43, 51, 59]
         // hash % 4 -> [3, 3, 3, 3, 3, 3]  old bucket
         // hash % 8 -> [7, 7, 3, 3, 3, 3]  new bucket
-        load_factor_cnt_threshold_ = new_bucket_cnt * load_factor_;
-        auto* new_bucket_list = new BucketList(new_bucket_cnt);
+        load_factor_cnt_threshold_.store(new_bucket_cnt * load_factor_, std::memory_order_relaxed);
+        auto* new_bucket_list = create_bucket_list(new_bucket_cnt);
+        rehash_count_.fetch_add(1, std::memory_order_relaxed);
         for (int i = 0; i < old_bucket_list->bucket_count(); ++i) {
-            Node* head = old_bucket_list->get_head(i);
-            for (auto* p = head; p != nullptr; p = p->next_.load(std::memory_order_relaxed)) {
-                auto hash = HashFn()(p->value_holder_.key);
-                auto bucket_id = (hash >> ShardBits) & (new_bucket_cnt - 1);
-                Node* new_node = new Node(p->value_holder_.key, p->value_holder_.value);
-                new_node->next_.store(new_bucket_list->get_head(bucket_id), std::memory_order_relaxed);
-                new_bucket_list->set_head(bucket_id, new_node);
-            }
+            copy_bucket(old_bucket_list, new_bucket_list, i);
         }
         bucket_list_.store(new_bucket_list, std::memory_order_release);
         old_bucket_list->retire();
@@ -430,36 +865,390 @@ public:
     }
 
     void set_load_factor(float load_factor) {
-        std::lock_guard<std::mutex> g(m_);
+        lock_all();
         BucketList* bucket_list = get_bucket_list();
         load_factor_ = load_factor;
-        load_factor_cnt_threshold_ = bucket_list->bucket_count() * load_factor_;
+        load_factor_cnt_threshold_.store(bucket_list->bucket_count() * load_factor_, std::memory_order_relaxed);
+        unlock_all();
+    }
+
+    // 每次写操作额外迁移的bucket个数，0表示扩容时一次性迁移完(旧的同步rehash)
+    void set_migrate_batch(size_t migrate_batch) {
+        migrate_batch_.store(migrate_batch, std::memory_order_relaxed);
+    }
+
+    size_t get_migrate_batch() const {
+        return migrate_batch_.load(std::memory_order_relaxed);
+    }
+
+    // 是否有进行中的增量迁移
+    bool migrating() const {
+        return old_bucket_list_.load(std::memory_order_acquire) != nullptr;
     }
 
     void clear() {
+        lock_all();
         auto old_bucket_list = get_bucket_list();
-        auto new_bucket_list = new BucketList(old_bucket_list->bucket_count());
-        {
-            std::lock_guard<std::mutex> g(m_);
-            bucket_list_.store(new_bucket_list, std::memory_order_release);
-            size_ = 0;
-        }
+        auto migrating_list = old_bucket_list_.load(std::memory_order_relaxed);
+        auto new_bucket_list = create_bucket_list(old_bucket_list->bucket_count());
+        old_bucket_list_.store(nullptr, std::memory_order_release);
+        bucket_list_.store(new_bucket_list, std::memory_order_release);
+        add_size(-static_cast<int64_t>(size()));
+        unlock_all();
         old_bucket_list->retire();
+        if (migrating_list) {
+            migrating_list->retire();
+        }
         //old_bucket_list->retire(folly::hazptr::default_hazptr_domain(), HazptrDeleter());
     }
 
     BucketList* get_bucket_list() {
         return  bucket_list_.load(std::memory_order_relaxed);
     }
+
+    // size的变化同时累加到map的分片计数器上
+    void set_size_counter(StripedCounter* size_counter) {
+        size_counter_ = size_counter;
+    }
+
+    /** 不加锁遍历所有bucket统计占用情况，和读者一样用hazptr保护。
+     *  增量迁移期间还没迁移的旧bucket按旧表的链表算，会比迁移完之后偏长。
+     */
+    SegmentStats stats() {
+        SegmentStats stats;
+        stats.size = size();
+        stats.rehash_count = rehash_count_.load(std::memory_order_relaxed);
+        Iterator iter(hazptr_manager());
+        while (true) {
+            iter.bucket_list_ = iter.holder_bucket.get_protected(bucket_list_);
+            iter.old_list_ = iter.holder_old.get_protected(old_bucket_list_);
+            if (iter.bucket_list_ == bucket_list_.load(std::memory_order_acquire)) {
+                break;
+            }
+        }
+        BucketList* bucket_list = iter.bucket_list_;
+        BucketList* old_list = iter.old_list_;
+        stats.bucket_count = bucket_list->bucket_count();
+        stats.load_factor = static_cast<double>(stats.size) / stats.bucket_count;
+        for (size_t i = 0; i < stats.bucket_count; ++i) {
+            // load_head会改写这几个字段
+            iter.bucket_list_ = bucket_list;
+            iter.old_list_ = old_list;
+            iter.bucket_id_ = i;
+            if (!load_head(iter)) {
+                break;
+            }
+            size_t length = 0;
+            for (Node* node = iter.node_; node; ++length) {
+                node = iter.holder_next.get_protected(node->next_);
+                iter.holder_next.swap(iter.holder_node);
+            }
+            stats.longest_chain = std::max(stats.longest_chain, length);
+        }
+        return stats;
+    }
+
+    // 按顺序持有所有的写锁，striped模式下先用m_让rehash之间互斥
+    void lock_all() {
+        m_.lock();
+        if constexpr (StripedLock) {
+            for (auto& lock : locks_) {
+                lock.lock();
+            }
+        }
+    }
+
+    void unlock_all() {
+        if constexpr (StripedLock) {
+            for (auto& lock : locks_) {
+                lock.unlock();
+            }
+        }
+        m_.unlock();
+    }
+
+private:
+    void add_size(int64_t delta) {
+        size_.fetch_add(delta, std::memory_order_relaxed);
+        if (size_counter_) {
+            size_counter_->add(delta);
+        }
+    }
+
+    // 加写锁，返回加锁之后的bucket_list，bucket_id通过参数返回
+    BucketList* lock_bucket(uint64_t hash, size_t& bucket_id) {
+        if constexpr (!StripedLock) {
+            m_.lock();
+            BucketList* bucket_list = get_bucket_list();
+            bucket_id = (hash >> ShardBits) & (bucket_list->bucket_count() - 1);
+            return bucket_list;
+        } else {
+            while (true) {
+                BucketList* bucket_list = bucket_list_.load(std::memory_order_acquire);
+                bucket_id = (hash >> ShardBits) & (bucket_list->bucket_count() - 1);
+                auto& lock = locks_[bucket_id % SEGMENT_LOCK_STRIPES];
+                lock.lock();
+                // 加锁之前可能被rehash替换了
+                if (bucket_list == bucket_list_.load(std::memory_order_acquire)) {
+                    return bucket_list;
+                }
+                lock.unlock();
+            }
+        }
+    }
+
+    // 保护当前的bucket list和进行中迁移的旧表，bucket_id是key在新表里的位置
+    void protect_bucket_list(size_t hash, Iterator& iter) {
+        iter.set_manager(hazptr_manager());
+        while (true) {
+            BucketList* bucket_list = iter.holder_bucket.get_protected(bucket_list_);
+            BucketList* old_list = iter.holder_old.get_protected(old_bucket_list_);
+            // 两次读之间开始了新的一轮扩容，old_list不一定是bucket_list的旧表
+            if (bucket_list == bucket_list_.load(std::memory_order_acquire)) {
+                iter.bucket_list_ = bucket_list;
+                iter.old_list_ = old_list;
+                iter.bucket_id_ = (hash >> ShardBits) & (bucket_list->bucket_count() - 1);
+                return;
+            }
+        }
+    }
+
+    // 读出key所在链表的头节点放到iter.node_，bucket list自己被迁移时返回false
+    bool load_head(Iterator& iter) {
+        BucketList* bucket_list = iter.bucket_list_;
+        BucketList* old_list = iter.old_list_;
+        iter.list_ = bucket_list;
+        if (old_list) {
+            // 旧表的bucket还没迁移就在旧表里找
+            auto old_bucket_id = iter.bucket_id_ & (old_list->bucket_count() - 1);
+            Node* node = iter.holder_node.get_protected(old_list->buckets_[old_bucket_id]);
+            if (!is_forward(node)) {
+                iter.list_ = old_list;
+                iter.bucket_id_ = old_bucket_id;
+                iter.node_ = node;
+                return true;
+            }
+        }
+        Node* node = iter.holder_node.get_protected(bucket_list->buckets_[iter.bucket_id_]);
+        if (is_forward(node)) {
+            return false;
+        }
+        iter.node_ = node;
+        return true;
+    }
+
+    // 从iter.node_开始遍历，找不到时iter.node_为空
+    template <typename K>
+    bool find_in_chain(Iterator& iter, const K& key) {
+        Node* node = iter.node_;
+        while (node) {
+            if (key == node->value_holder_.key) {
+                iter.node_ = node;
+                return true;
+            }
+            node = iter.holder_next.get_protected(node->next_);
+            iter.holder_next.swap(iter.holder_node);
+        }
+        iter.node_ = nullptr;
+        return false;
+    }
+
+    // 按bucket_id加锁，用于迁移旧表的bucket
+    void lock_bucket_id(size_t bucket_id) {
+        if constexpr (!StripedLock) {
+            m_.lock();
+        } else {
+            locks_[bucket_id % SEGMENT_LOCK_STRIPES].lock();
+        }
+    }
+
+    void unlock_bucket(size_t bucket_id) {
+        if constexpr (!StripedLock) {
+            m_.unlock();
+        } else {
+            locks_[bucket_id % SEGMENT_LOCK_STRIPES].unlock();
+        }
+    }
+
+    // 把旧表第i个bucket的node拷贝到新表，旧链表保持不变
+    void copy_bucket(BucketList* old_list, BucketList* new_list, size_t i) {
+        size_t mask = new_list->bucket_count() - 1;
+        Node* head = old_list->get_head(i);
+        for (auto* p = head; p != nullptr; p = p->next_.load(std::memory_order_relaxed)) {
+            auto hash = HashFn()(p->value_holder_.key);
+            auto bucket_id = (hash >> ShardBits) & mask;
+            Node* new_node = create_node(p->value_holder_.key, p->value_holder_.value);
+            new_node->next_.store(new_list->get_head(bucket_id), std::memory_order_relaxed);
+            new_list->set_head(bucket_id, new_node);
+        }
+    }
+
+    template <typename...Args>
+    Node* create_node(Args&&... args) {
+        Node* node = Node::create(std::forward<Args>(args)...);
+        node->set_cohort(&cohort_);
+        return node;
+    }
+
+    BucketList* create_bucket_list(size_t buckets_count) {
+        BucketList* list = BucketList::create(buckets_count);
+        list->set_cohort(&cohort_);
+        return list;
+    }
+
+    Domain& hazptr_manager() {
+        return cohort_.manager();
+    }
+
+    // 调用者持有旧bucket i对应的锁(新表的i和i+old_count在同一个stripe)
+    void migrate_bucket(BucketList* old_list, BucketList* new_list, size_t i) {
+        Node* head = old_list->get_head(i);
+        copy_bucket(old_list, new_list, i);
+        // 新表的bucket发布之后才放转发标记，读者看到标记时一定能在新表里找到
+        old_list->set_head(i, forward_marker());
+        if (head) {
+            head->release();
+        }
+        migrated_.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // 写者持有bucket_id的锁，先把它在旧表里对应的bucket迁过来
+    void migrate_for_write(BucketList* bucket_list, size_t bucket_id) {
+        BucketList* old_list = old_bucket_list_.load(std::memory_order_acquire);
+        if (old_list == nullptr) {
+            return;
+        }
+        size_t old_bucket_id = bucket_id & (old_list->bucket_count() - 1);
+        if (!is_forward(old_list->get_head(old_bucket_id))) {
+            migrate_bucket(old_list, bucket_list, old_bucket_id);
+        }
+    }
+
+    // 写者在放锁之后顺路迁移migrate_batch_个bucket
+    void help_migrate() {
+        if (old_bucket_list_.load(std::memory_order_relaxed) == nullptr) {
+            return;
+        }
+        size_t migrate_count = migrate_count_.load(std::memory_order_relaxed);
+        size_t batch = migrate_batch_.load(std::memory_order_relaxed);
+        for (size_t k = 0; k < batch; ++k) {
+            size_t i = migrate_cursor_.fetch_add(1, std::memory_order_relaxed);
+            if (i >= migrate_count) {
+                break;
+            }
+            lock_bucket_id(i);
+            // 拿锁之前迁移可能已经结束，甚至开始了下一轮
+            BucketList* old_list = old_bucket_list_.load(std::memory_order_acquire);
+            if (old_list && i < old_list->bucket_count() && !is_forward(old_list->get_head(i))) {
+                migrate_bucket(old_list, get_bucket_list(), i);
+            }
+            unlock_bucket(i);
+        }
+        if (migrated_.load(std::memory_order_acquire) >= migrate_count) {
+            finish_migration();
+        }
+    }
+
+    // 写者发现负载超过阈值时分配新表，开始增量迁移
+    void start_resize() {
+        // 有for_each在遍历或者上一轮迁移还没结束时一定不会扩容，不加锁直接返回，
+        // 否则推迟扩容期间每次插入都要lock_all一遍。加锁之后还会再检查一次
+        if (scanners_.load() != 0 || old_bucket_list_.load(std::memory_order_acquire) != nullptr) {
+            return;
+        }
+        lock_all();
+        BucketList* retired_list = nullptr;
+        // 可能已经被别的写者扩容了，或者上一轮迁移还没结束，或者有for_each正在遍历
+        if (old_bucket_list_.load(std::memory_order_relaxed) == nullptr && scanners_.load() == 0 &&
+                size() >= load_factor_cnt_threshold_.load(std::memory_order_relaxed)) {
+            BucketList* old_list = get_bucket_list();
+            size_t old_count = old_list->bucket_count();
+            auto* new_list = create_bucket_list(old_count << 1);
+            rehash_count_.fetch_add(1, std::memory_order_relaxed);
+            migrate_cursor_.store(0, std::memory_order_relaxed);
+            migrated_.store(0, std::memory_order_relaxed);
+            migrate_count_.store(old_count, std::memory_order_relaxed);
+            load_factor_cnt_threshold_.store((old_count << 1) * load_factor_, std::memory_order_relaxed);
+            // 先发布旧表再发布新表，读到新表的读者一定能读到旧表
+            old_bucket_list_.store(old_list, std::memory_order_release);
+            bucket_list_.store(new_list, std::memory_order_release);
+            // striped模式下旧bucket i和新bucket i、i+old_count要落在同一个stripe
+            bool sync = migrate_batch_.load(std::memory_order_relaxed) == 0 ||
+                    (StripedLock && old_count % SEGMENT_LOCK_STRIPES != 0);
+            if (sync) {
+                retired_list = finish_migration_locked();
+            }
+        }
+        unlock_all();
+        if (retired_list) {
+            retired_list->retire();
+        }
+    }
+
+    // 调用者持有所有写锁，迁移剩下的bucket，返回需要回收的旧表
+    BucketList* finish_migration_locked() {
+        BucketList* old_list = old_bucket_list_.load(std::memory_order_relaxed);
+        if (old_list == nullptr) {
+            return nullptr;
+        }
+        BucketList* new_list = get_bucket_list();
+        for (size_t i = 0; i < old_list->bucket_count(); ++i) {
+            if (!is_forward(old_list->get_head(i))) {
+                migrate_bucket(old_list, new_list, i);
+            }
+        }
+        old_bucket_list_.store(nullptr, std::memory_order_release);
+        return old_list;
+    }
+
+    void finish_migration() {
+        lock_all();
+        BucketList* old_list = old_bucket_list_.load(std::memory_order_relaxed);
+        // 只有迁移完的那一轮才能结束，migrated_可能已经属于下一轮
+        if (old_list && migrated_.load(std::memory_order_relaxed) >= old_list->bucket_count()) {
+            old_bucket_list_.store(nullptr, std::memory_order_release);
+        } else {
+            old_list = nullptr;
+        }
+        unlock_all();
+        if (old_list) {
+            old_list->retire();
+        }
+    }
 private:
     std::mutex m_;
     std::atomic<BucketList*> bucket_list_ = {nullptr};
-    size_t size_ = {0};
+    std::atomic<size_t> size_ = {0};
     size_t max_size_ = {0};
     float load_factor_;
-    size_t load_factor_cnt_threshold_;
+    std::atomic<size_t> load_factor_cnt_threshold_ = {0};
+    // 只在StripedLock模式下使用
+    std::array<SpinLock, StripedLock ? SEGMENT_LOCK_STRIPES : 0> locks_;
+    // 增量迁移的状态，old_bucket_list_为空表示没有进行中的迁移
+    std::atomic<BucketList*> old_bucket_list_ = {nullptr};
+    std::atomic<size_t> migrate_cursor_ = {0};
+    std::atomic<size_t> migrated_ = {0};
+    std::atomic<size_t> migrate_count_ = {0};
+    std::atomic<size_t> migrate_batch_ = {CONCURRENT_HASHMAP_MIGRATE_BATCH};
+    // 正在for_each的线程数，不为0时推迟扩容
+    std::atomic<int> scanners_ = {0};
+    std::atomic<size_t> rehash_count_ = {0};
+    StripedCounter* size_counter_ = {nullptr};
+    // 这个segment的node和bucket list，retire之后不进全局retired链表
+    typename ReclaimPolicy::Cohort cohort_;
 };
 
+// 使用bucket锁的链表segment，可以作为ConcurrentHashMap的Segment参数
+template <
+    typename KeyType,
+    typename ValueType,
+    typename HashFn,
+    uint8_t ShardBits,
+    typename Allocator = std::allocator<uint8_t>,
+    typename ReclaimPolicy = HazptrReclaimPolicy>
+using ConcurrentHashMapStripedSegment =
+    ConcurrentHashMapSegment<KeyType, ValueType, HashFn, ShardBits, Allocator, ReclaimPolicy, true>;
+
 } // namespace
 
 
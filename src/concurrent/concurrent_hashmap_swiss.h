@@ -0,0 +1,632 @@
+#pragma once
+
+// TODO
+// 1 16个control byte一组，SSE2并行匹配 done
+// 2 entry内联存储在slot数组中 done
+// 3 读者用hazptr保护整张表，无锁 done
+// 4 tombstone的复用
+
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "concurrent_hashmap_detail.h"
+
+namespace rcu {
+
+// 超过这个比例(包括tombstone)就扩容，open addressing的load factor不能超过1
+#ifndef SWISS_MAX_LOAD_FACTOR
+#define SWISS_MAX_LOAD_FACTOR 0.875
+#endif
+
+namespace swiss {
+
+// control byte: 最高位为1表示空槽，否则低7位为hash的h2
+constexpr int8_t CTRL_EMPTY = -128;   // 0b10000000
+constexpr int8_t CTRL_DELETED = -2;   // 0b11111110
+constexpr size_t GROUP_WIDTH = 16;
+
+inline uint64_t mix_hash(uint64_t hash) {
+    // std::hash<int>是恒等函数，打散之后高7位才能区分key
+    return hash * 0x9E3779B97F4A7C15UL;
+}
+
+inline int8_t h2(uint64_t mixed_hash) {
+    return static_cast<int8_t>(mixed_hash >> 57);
+}
+
+// 一组16个control byte的匹配结果，每个bit对应一个slot
+class BitMask {
+public:
+    explicit BitMask(uint32_t mask) : _mask(mask) {}
+    explicit operator bool() const {
+        return _mask != 0;
+    }
+    int lowest() const {
+        return __builtin_ctz(_mask);
+    }
+    BitMask& operator++() {
+        _mask &= _mask - 1;
+        return *this;
+    }
+private:
+    uint32_t _mask;
+};
+
+// 和写者并发的读：写者只会把EMPTY改成h2、把h2改成DELETED，读到旧值只会多probe或者少看到一个刚插入的key
+class Group {
+public:
+    explicit Group(const int8_t* ctrl) {
+#ifdef __SSE2__
+        _ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+        for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+            _ctrl[i] = __atomic_load_n(ctrl + i, __ATOMIC_RELAXED);
+        }
+#endif
+        // 和写者发布control byte的release配对，之后读slot内容
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    BitMask match(int8_t hash) const {
+#ifdef __SSE2__
+        auto match = _mm_set1_epi8(hash);
+        return BitMask(_mm_movemask_epi8(_mm_cmpeq_epi8(match, _ctrl)));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+            mask |= static_cast<uint32_t>(_ctrl[i] == hash) << i;
+        }
+        return BitMask(mask);
+#endif
+    }
+    BitMask match_empty() const {
+        return match(CTRL_EMPTY);
+    }
+    // 最高位为0的是有效的entry
+    BitMask match_full() const {
+#ifdef __SSE2__
+        return BitMask(~_mm_movemask_epi8(_ctrl) & 0xFFFF);
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+            mask |= static_cast<uint32_t>(_ctrl[i] >= 0) << i;
+        }
+        return BitMask(mask);
+#endif
+    }
+private:
+#ifdef __SSE2__
+    __m128i _ctrl;
+#else
+    int8_t _ctrl[GROUP_WIDTH];
+#endif
+};
+
+} // namespace swiss
+
+/** Swiss table风格的segment，可以替换ConcurrentHashMapSegment。
+ *
+ *  control byte和entry分开存放，entry内联在slot数组里，不再每个key分配一个node。
+ *  每16个control byte为一组，查找时一次SSE2比较一组，大部分情况只访问1个group + 1个slot。
+ *  slot发布之后不再修改：erase只把control byte标成DELETED，覆盖写会在新的slot上插入再删除旧的，
+ *  所以读者只需要用一个hazptr保护整张表，slot里的对象等表被回收时才析构。
+ *  写者之间用m_互斥，tombstone在rehash时清理。
+ *  注意erase和覆盖写之后旧的key/value仍然留在slot里，直到下一次rehash换表、旧表被回收时才析构，
+ *  value持有大块内存或者其它资源时，释放会推迟到rehash。
+ *  表的保护和回收通过ReclaimPolicy，和链表segment相同。
+ */
+template <
+    typename KeyType,
+    typename ValueType,
+    typename HashFn,
+    uint8_t ShardBits,
+    typename Allocator = std::allocator<uint8_t>,
+    typename ReclaimPolicy = HazptrReclaimPolicy>
+class ConcurrentHashMapSwissSegment {
+public:
+    using Holder = ValueHolder<KeyType, ValueType>;
+    using Domain = typename ReclaimPolicy::Domain;
+    using ReclaimHolder = typename ReclaimPolicy::Holder;
+    // emplace先把key/value构造在Node上，再移动到slot里
+    struct Node {
+        template <typename...Args>
+        explicit Node(Args&&... args) : value_holder_(std::forward<Args>(args)...) {
+        }
+        template <typename...Args>
+        static Node* create(Args&&... args) {
+            return allocator_new<Node, Allocator>(std::forward<Args>(args)...);
+        }
+        static void destroy(Node* node) {
+            allocator_delete<Node, Allocator>(node);
+        }
+        Holder value_holder_;
+    };
+    class BucketList : public ReclaimPolicy::template Node<BucketList> {
+    public:
+        explicit BucketList(size_t capacity) {
+            capacity_ = std::max(nextPowTwo(capacity), swiss::GROUP_WIDTH);
+            ctrl_ = static_cast<int8_t*>(aligned_alloc(swiss::GROUP_WIDTH, capacity_));
+            memset(ctrl_, swiss::CTRL_EMPTY, capacity_);
+            slots_ = static_cast<Holder*>(aligned_alloc(alignof(Holder) > 64 ? alignof(Holder) : 64,
+                        (capacity_ * sizeof(Holder) + 63) & ~static_cast<size_t>(63)));
+        }
+        ~BucketList() {
+            // DELETED的slot上的对象也还没有析构
+            for (size_t i = 0; i < capacity_; ++i) {
+                if (ctrl_[i] != swiss::CTRL_EMPTY) {
+                    slots_[i].~Holder();
+                }
+            }
+            free(ctrl_);
+            free(slots_);
+        }
+        // ctrl_和slots_要按group对齐，仍然用aligned_alloc；BucketList本身走Allocator
+        static BucketList* create(size_t capacity) {
+            return allocator_new<BucketList, Allocator>(capacity);
+        }
+        static void destroy(BucketList* list) {
+            allocator_delete<BucketList, Allocator>(list);
+        }
+        void reclaim() override {
+            destroy(this);
+        }
+        size_t bucket_count() const {
+            return capacity_;
+        }
+        size_t group_mask() const {
+            return capacity_ / swiss::GROUP_WIDTH - 1;
+        }
+        // slot的内容构造完之后才能发布control byte
+        void publish(size_t index, int8_t ctrl) {
+            __atomic_store_n(&ctrl_[index], ctrl, __ATOMIC_RELEASE);
+        }
+        bool is_full(size_t index) const {
+            return __atomic_load_n(&ctrl_[index], __ATOMIC_ACQUIRE) >= 0;
+        }
+        // 返回key所在的slot，找不到返回-1
+        template <typename K>
+        int64_t find(uint64_t mixed_hash, const K& key) const {
+            size_t group = mixed_hash & group_mask();
+            int8_t h2 = swiss::h2(mixed_hash);
+            for (size_t step = 1; step <= group_mask() + 1; ++step) {
+                swiss::Group g(ctrl_ + group * swiss::GROUP_WIDTH);
+                for (auto mask = g.match(h2); mask; ++mask) {
+                    size_t index = group * swiss::GROUP_WIDTH + mask.lowest();
+                    if (slots_[index].key == key) {
+                        return index;
+                    }
+                }
+                if (g.match_empty()) {
+                    return -1;
+                }
+                // 三角数probe，group数是2的幂时能遍历所有group
+                group = (group + step) & group_mask();
+            }
+            return -1;
+        }
+        // 找到index所在的group要探测几个group，1表示就在第一个group里
+        size_t probe_length(uint64_t mixed_hash, size_t index) const {
+            size_t group = mixed_hash & group_mask();
+            size_t target = index / swiss::GROUP_WIDTH;
+            size_t step = 1;
+            for (; group != target && step <= group_mask(); ++step) {
+                group = (group + step) & group_mask();
+            }
+            return step;
+        }
+        // 第一个EMPTY的slot，tombstone不复用，因为可能还有读者在读它
+        int64_t find_empty(uint64_t mixed_hash) const {
+            size_t group = mixed_hash & group_mask();
+            for (size_t step = 1; step <= group_mask() + 1; ++step) {
+                swiss::Group g(ctrl_ + group * swiss::GROUP_WIDTH);
+                auto mask = g.match_empty();
+                if (mask) {
+                    return group * swiss::GROUP_WIDTH + mask.lowest();
+                }
+                group = (group + step) & group_mask();
+            }
+            return -1;
+        }
+    public:
+        size_t capacity_ = {0};
+        int8_t* ctrl_ = {nullptr};
+        Holder* slots_ = {nullptr};
+    };
+    class Iterator {
+    public:
+        Iterator() {}
+        explicit Iterator(Domain& manager) : holder_bucket(manager) {}
+        ~Iterator() {}
+
+        void init(BucketList* bucket_list) {
+            bucket_list_ = bucket_list;
+            index_ = 0;
+            advanceIfEmpty();
+        }
+
+        const ValueType& operator*() const {
+            DCHECK(bucket_list_);
+            return bucket_list_->slots_[index_].value;
+        }
+
+        const ValueType* operator->() const {
+            DCHECK(bucket_list_);
+            return &bucket_list_->slots_[index_].value;
+        }
+
+        const KeyType& key() const {
+            return bucket_list_->slots_[index_].key;
+        }
+
+        bool at_end() const {
+            return bucket_list_ == nullptr;
+        }
+
+        void advanceIfEmpty() {
+            while (index_ < bucket_list_->bucket_count() && !bucket_list_->is_full(index_)) {
+                index_++;
+            }
+            if (index_ >= bucket_list_->bucket_count()) {
+                // 到达末尾，和cend()相等
+                holder_bucket.reset();
+                bucket_list_ = nullptr;
+                index_ = 0;
+            }
+        }
+
+        // 前置操作重载
+        const Iterator& operator++() {
+            DCHECK(bucket_list_);
+            index_++;
+            advanceIfEmpty();
+            return *this;
+        }
+
+        // 后置操作重载
+        Iterator operator++(int) {
+            auto prev = *this;
+            ++*this;
+            return prev;
+        }
+
+        bool operator==(const Iterator& o) const {
+            return bucket_list_ == o.bucket_list_ && index_ == o.index_;
+        }
+
+        bool operator!=(const Iterator& o) const {
+            return !(*this == o);
+        }
+
+        // 副本用自己的hazptr保护同一张表，原来的iterator一直持有保护，不需要重新校验
+        Iterator& operator=(const Iterator& o) {
+            holder_bucket.set_manager(o.holder_bucket.manager());
+            bucket_list_ = o.bucket_list_;
+            index_ = o.index_;
+            holder_bucket.reset(bucket_list_);
+            return *this;
+        }
+
+        Iterator(const Iterator& o) : holder_bucket(o.holder_bucket.manager()) {
+            bucket_list_ = o.bucket_list_;
+            index_ = o.index_;
+            holder_bucket.reset(bucket_list_);
+        }
+
+        Iterator(Iterator&& o) {
+            bucket_list_ = o.bucket_list_;
+            index_ = o.index_;
+            holder_bucket.swap(o.holder_bucket);
+        }
+
+        Iterator& operator=(Iterator&& o) {
+            bucket_list_ = o.bucket_list_;
+            index_ = o.index_;
+            holder_bucket.swap(o.holder_bucket);
+            return *this;
+        }
+    private:
+        BucketList* bucket_list_ = {nullptr};
+        size_t index_ = {0};
+        ReclaimHolder holder_bucket;
+        friend class ConcurrentHashMapSwissSegment;
+    };
+public:
+    ConcurrentHashMapSwissSegment(size_t buckets_count, float load_factor,
+            Domain& manager = ReclaimPolicy::default_domain()) : cohort_(manager) {
+        bucket_list_ = create_bucket_list(buckets_count);
+        set_load_factor(load_factor);
+    }
+
+    // 当前的表直接释放；扩容和clear换下来的旧表挂在cohort_上，cohort_析构时一次扫描批量回收
+    ~ConcurrentHashMapSwissSegment() {
+        BucketList::destroy(get_bucket_list());
+    }
+
+    Iterator cbegin() {
+        Iterator iter(hazptr_manager());
+        iter.init(iter.holder_bucket.get_protected(bucket_list_));
+        return iter;
+    }
+
+    Iterator cend() {
+        return Iterator();
+    }
+
+    size_t size() { return size_.load(std::memory_order_relaxed); }
+    bool empty() { return size() == 0; }
+
+    template <typename Key, typename Value>
+    bool insert(uint64_t hash, Key&& key, Value&& value) {
+        std::lock_guard<std::mutex> g(m_);
+        return insert_internal(hash, std::forward<Key>(key), std::forward<Value>(value));
+    }
+
+    // 接管node，成功或失败都由segment释放
+    // key和node里的key相同，链表segment的接口需要它，这里不用
+    bool emplace(uint64_t hash, const KeyType& /*key*/, Node* new_node) {
+        std::unique_ptr<Node, void (*)(Node*)> guard(new_node, &Node::destroy);
+        std::lock_guard<std::mutex> g(m_);
+        return insert_internal(hash,
+                std::move(new_node->value_holder_.key),
+                std::move(new_node->value_holder_.value));
+    }
+
+    // 语义和链表segment的update相同，非inplace_updatable的value写到新的slot里
+    template <typename K, typename Fn>
+    UpdateResult update(uint64_t hash, const K& key, Fn&& fn, bool insert_if_absent) {
+        std::lock_guard<std::mutex> g(m_);
+        BucketList* bucket_list = get_bucket_list();
+        int64_t index = bucket_list->find(swiss::mix_hash(hash >> ShardBits), key);
+        if (index < 0) {
+            if (!insert_if_absent) {
+                return UpdateResult::NOT_FOUND;
+            }
+            ValueType value = ValueType();
+            fn(value);
+            insert_internal(hash, KeyType(key), std::move(value));
+            return UpdateResult::INSERTED;
+        }
+        Holder& holder = bucket_list->slots_[index];
+        ValueType value = holder.value;
+        if (!fn(value)) {
+            return UpdateResult::UNCHANGED;
+        }
+        if constexpr (inplace_updatable<ValueType>()) {
+            __atomic_store(&holder.value, &value, __ATOMIC_RELEASE);
+        } else {
+            // insert_internal可能rehash，先把key拷出来
+            insert_internal(hash, KeyType(holder.key), std::move(value));
+        }
+        return UpdateResult::UPDATED;
+    }
+
+    template <typename K>
+    bool erase(uint64_t hash, const K& key) {
+        return erase_if(hash, key, [](const ValueType&) { return true; });
+    }
+
+    template <typename K, typename Pred>
+    bool erase_if(uint64_t hash, const K& key, Pred&& pred) {
+        std::lock_guard<std::mutex> g(m_);
+        BucketList* bucket_list = get_bucket_list();
+        int64_t index = bucket_list->find(swiss::mix_hash(hash >> ShardBits), key);
+        if (index < 0 || !pred(bucket_list->slots_[index].value)) {
+            return false;
+        }
+        // 对象留给读者继续读，表被回收时才析构
+        bucket_list->publish(index, swiss::CTRL_DELETED);
+        add_size(-1);
+        return true;
+    }
+
+    // 和链表segment相同，cursor按slot计数，每个bucket算GROUP_WIDTH个slot
+    template <typename Fn>
+    size_t visit_buckets(size_t cursor, size_t max_buckets, Fn&& fn) {
+        ReclaimHolder holder(hazptr_manager());
+        BucketList* bucket_list = holder.get_protected(bucket_list_);
+        size_t mask = bucket_list->bucket_count() - 1;
+        for (size_t i = 0; i < max_buckets * swiss::GROUP_WIDTH; ++i, ++cursor) {
+            size_t index = cursor & mask;
+            if (bucket_list->is_full(index) &&
+                    !fn(bucket_list->slots_[index].key, bucket_list->slots_[index].value)) {
+                return cursor;
+            }
+        }
+        return cursor;
+    }
+
+    template <typename K>
+    bool find(size_t hash, Iterator& iter, const K& key) {
+        iter.holder_bucket.set_manager(hazptr_manager());
+        BucketList* bucket_list = iter.holder_bucket.get_protected(bucket_list_);
+        int64_t index = bucket_list->find(swiss::mix_hash(hash >> ShardBits), key);
+        if (index < 0) {
+            iter.holder_bucket.reset();
+            return false;
+        }
+        iter.bucket_list_ = bucket_list;
+        iter.index_ = index;
+        return true;
+    }
+
+    // 把所有有效的entry复制到新表，同时清理tombstone
+    // 批量查找的三步，含义和链表segment相同：预取第一个group的control byte，再预取对应的slot
+    void prefetch_bucket(size_t hash, Iterator& iter) {
+        iter.holder_bucket.set_manager(hazptr_manager());
+        BucketList* bucket_list = iter.holder_bucket.get_protected(bucket_list_);
+        iter.bucket_list_ = bucket_list;
+        iter.index_ = (swiss::mix_hash(hash >> ShardBits) & bucket_list->group_mask()) * swiss::GROUP_WIDTH;
+        __builtin_prefetch(bucket_list->ctrl_ + iter.index_);
+    }
+
+    void prefetch_node(Iterator& iter) {
+        __builtin_prefetch(iter.bucket_list_->slots_ + iter.index_);
+    }
+
+    template <typename K>
+    bool find_prefetched(size_t hash, Iterator& iter, const K& key) {
+        int64_t index = iter.bucket_list_->find(swiss::mix_hash(hash >> ShardBits), key);
+        if (index < 0) {
+            return false;
+        }
+        iter.index_ = index;
+        return true;
+    }
+
+    /** 遍历整个segment，fn(const KeyType&, const ValueType&)。
+     *  遍历的是开始时的那张表，rehash不影响；但非inplace_updatable的value更新会换slot，
+     *  遍历期间被更新的key可能访问到两次或者访问不到。
+     */
+    template <typename Fn>
+    void for_each(Fn&& fn) {
+        for (auto iter = cbegin(); !iter.at_end(); ++iter) {
+            fn(iter.key(), *iter);
+        }
+    }
+
+    // reserve()直接调用，和写者并发，需要加锁
+    void rehash(size_t new_bucket_cnt) {
+        std::lock_guard<std::mutex> g(m_);
+        rehash_locked(new_bucket_cnt);
+    }
+
+    float get_load_factor() const {
+        return max_load_factor_;
+    }
+
+    void set_load_factor(float load_factor) {
+        std::lock_guard<std::mutex> g(m_);
+        max_load_factor_ = std::min(load_factor, static_cast<float>(SWISS_MAX_LOAD_FACTOR));
+        used_threshold_ = get_bucket_list()->bucket_count() * max_load_factor_;
+    }
+
+    // 开放寻址的探测序列跨越整个表，没法按bucket增量迁移，扩容总是一次完成
+    void set_migrate_batch(size_t) {}
+
+    void clear() {
+        std::lock_guard<std::mutex> g(m_);
+        auto old_bucket_list = get_bucket_list();
+        bucket_list_.store(create_bucket_list(old_bucket_list->bucket_count()), std::memory_order_release);
+        add_size(-static_cast<int64_t>(size()));
+        used_ = 0;
+        old_bucket_list->retire();
+    }
+
+    BucketList* get_bucket_list() {
+        return bucket_list_.load(std::memory_order_relaxed);
+    }
+
+    void set_size_counter(StripedCounter* size_counter) {
+        size_counter_ = size_counter;
+    }
+
+    BucketList* create_bucket_list(size_t capacity) {
+        BucketList* list = BucketList::create(capacity);
+        list->set_cohort(&cohort_);
+        return list;
+    }
+
+    Domain& hazptr_manager() {
+        return cohort_.manager();
+    }
+
+    // 不加锁统计，longest_chain是最长的探测group数
+    SegmentStats stats() {
+        SegmentStats stats;
+        stats.size = size();
+        stats.rehash_count = rehash_count_.load(std::memory_order_relaxed);
+        ReclaimHolder holder(hazptr_manager());
+        BucketList* bucket_list = holder.get_protected(bucket_list_);
+        stats.bucket_count = bucket_list->bucket_count();
+        stats.load_factor = static_cast<double>(stats.size) / stats.bucket_count;
+        for (size_t i = 0; i < stats.bucket_count; ++i) {
+            if (bucket_list->is_full(i)) {
+                uint64_t mixed_hash = swiss::mix_hash(HashFn()(bucket_list->slots_[i].key) >> ShardBits);
+                stats.longest_chain = std::max(stats.longest_chain, bucket_list->probe_length(mixed_hash, i));
+            }
+        }
+        return stats;
+    }
+
+    void lock_all() {
+        m_.lock();
+    }
+
+    void unlock_all() {
+        m_.unlock();
+    }
+private:
+    // 调用者持有m_
+    void rehash_locked(size_t new_bucket_cnt) {
+        BucketList* old_bucket_list = get_bucket_list();
+        // 至少要能放下现有的entry
+        size_t min_capacity = static_cast<size_t>(size() / max_load_factor_) + 1;
+        auto* new_bucket_list = create_bucket_list(std::max(new_bucket_cnt, min_capacity));
+        rehash_count_.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = 0; i < old_bucket_list->bucket_count(); ++i) {
+            if (!old_bucket_list->is_full(i)) {
+                continue;
+            }
+            // 旧表上可能还有读者，只能复制
+            const Holder& holder = old_bucket_list->slots_[i];
+            uint64_t mixed_hash = swiss::mix_hash(HashFn()(holder.key) >> ShardBits);
+            int64_t index = new_bucket_list->find_empty(mixed_hash);
+            DCHECK(index >= 0);
+            new (&new_bucket_list->slots_[index]) Holder(holder.key, holder.value);
+            new_bucket_list->ctrl_[index] = swiss::h2(mixed_hash);
+        }
+        used_ = size();
+        used_threshold_ = new_bucket_list->bucket_count() * max_load_factor_;
+        bucket_list_.store(new_bucket_list, std::memory_order_release);
+        old_bucket_list->retire();
+    }
+
+    void add_size(int64_t delta) {
+        size_.fetch_add(delta, std::memory_order_relaxed);
+        if (size_counter_) {
+            size_counter_->add(delta);
+        }
+    }
+
+    template <typename Key, typename Value>
+    bool insert_internal(uint64_t hash, Key&& key, Value&& value) {
+        if (used_ + 1 > used_threshold_) {
+            // tombstone太多时原地清理，否则扩容一倍
+            size_t capacity = get_bucket_list()->bucket_count();
+            rehash_locked(size() + 1 > capacity / 2 ? capacity << 1 : capacity);
+        }
+        BucketList* bucket_list = get_bucket_list();
+        uint64_t mixed_hash = swiss::mix_hash(hash >> ShardBits);
+        int64_t old_index = bucket_list->find(mixed_hash, key);
+        int64_t index = bucket_list->find_empty(mixed_hash);
+        DCHECK(index >= 0);
+        new (&bucket_list->slots_[index]) Holder(std::forward<Key>(key), std::forward<Value>(value));
+        bucket_list->publish(index, swiss::h2(mixed_hash));
+        used_++;
+        if (old_index >= 0) {
+            // 新值已经可见，再删除旧值
+            bucket_list->publish(old_index, swiss::CTRL_DELETED);
+        } else {
+            add_size(1);
+        }
+        return true;
+    }
+private:
+    std::mutex m_;
+    std::atomic<BucketList*> bucket_list_ = {nullptr};
+    std::atomic<size_t> size_ = {0};
+    // 有效entry + tombstone的数量
+    size_t used_ = {0};
+    size_t used_threshold_ = {0};
+    float max_load_factor_ = {SWISS_MAX_LOAD_FACTOR};
+    std::atomic<size_t> rehash_count_ = {0};
+    StripedCounter* size_counter_ = {nullptr};
+    // 换下来的旧表，retire之后不进全局retired链表
+    typename ReclaimPolicy::Cohort cohort_;
+};
+
+} // namespace
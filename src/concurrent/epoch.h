@@ -0,0 +1,166 @@
+#pragma once
+
+// TODO
+// 1 EBR读临界区(EpochGuard) done
+// 2 QSBR quiescent_state done
+// 3 线程退出后record复用，未释放的对象交给下一个使用者 done
+// 4 hashmap/queue接入
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+
+#include "debug.h"
+
+namespace rcu {
+
+#ifndef EPOCH_RECLAIM_THRESHOLD
+#define EPOCH_RECLAIM_THRESHOLD 64
+#endif
+
+class EpochDomain;
+EpochDomain& get_default_epoch_domain();
+
+// 被retire的对象，记录retire时的全局epoch
+struct EpochRetired {
+    void* ptr = {nullptr};
+    void (*deleter)(void*) = {nullptr};
+    uint64_t epoch = {0};
+};
+
+// 每个线程在每个domain上有一个record，线程退出后record可以被别的线程复用
+class alignas(hardware_destructive_interference_size) EpochRecord {
+public:
+    EpochRecord* next = {nullptr};
+    std::atomic<bool> active {true};
+    // 0表示线程不在读临界区(offline)，否则为进入临界区时看到的全局epoch
+    std::atomic<uint64_t> epoch {0};
+    // 读临界区的嵌套深度，只有owner线程访问
+    int depth = {0};
+    // 本线程retire了但还不能释放的对象，owner线程和synchronize都会访问，用retired_mutex保护
+    std::mutex retired_mutex;
+    std::vector<EpochRetired> retired;
+    // retired.size()，owner线程退出临界区时不加锁检查
+    std::atomic<size_t> retired_num {0};
+};
+
+// 存活的domain，线程退出时只把record还给还活着的domain
+class EpochRegistry {
+public:
+    static EpochRegistry& instance() {
+        static EpochRegistry instance;
+        return instance;
+    }
+public:
+    std::mutex mutex;
+    std::unordered_map<uint64_t, EpochDomain*> domains;
+    uint64_t next_id = {1};
+};
+
+// 线程本地的 domain -> record 映射，线程退出时把record还给domain
+// domain可能先于线程析构，地址也可能被新的domain复用，所以用id区分
+class EpochThreadCache {
+    struct Entry {
+        EpochDomain* domain;
+        uint64_t id;
+        EpochRecord* record;
+    };
+public:
+    static EpochThreadCache& instance() {
+        static thread_local EpochThreadCache instance;
+        return instance;
+    }
+    ~EpochThreadCache();
+    EpochRecord* get_record(EpochDomain* domain);
+private:
+    EpochDomain* _last_domain = {nullptr};
+    uint64_t _last_id = {0};
+    EpochRecord* _last_record = {nullptr};
+    std::vector<Entry> _records;
+};
+
+/** Epoch based reclamation domain.
+ *
+ *  读者有两种用法：
+ *  1. EBR: 用EpochGuard包住读临界区，退出临界区后不再持有任何被保护的指针
+ *  2. QSBR: thread_online()之后周期性调用quiescent_state()，声明此刻不持有任何指针，
+ *     不再读的时候调用thread_offline()
+ *  被retire的对象在所有读者都越过retire时的epoch之后立即释放，不依赖定时器。
+ *  domain必须比使用它的线程活得更久，一般直接使用get_default_epoch_domain()。
+ */
+class EpochDomain {
+public:
+    EpochDomain();
+    ~EpochDomain();
+    // 禁止拷贝和移动
+    EpochDomain(EpochDomain&&) = delete;
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(EpochDomain&&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    void read_lock();
+    void read_unlock();
+
+    void thread_online() { read_lock(); }
+    void thread_offline() { read_unlock(); }
+    void quiescent_state();
+
+    template <typename T, typename D = std::default_delete<T>>
+    void retire(T* ptr);
+
+    // 尝试释放当前线程retire的对象，返回还剩多少个没有释放
+    size_t reclaim();
+    // 等待所有已经进入临界区的读者退出，然后释放所有线程retire的对象，
+    // 包括retire之后一直没有再进入domain的线程留下的
+    void synchronize();
+
+    uint64_t current_epoch() const {
+        return _global_epoch.load(std::memory_order_acquire);
+    }
+    uint64_t id() const {
+        return _id;
+    }
+private:
+    friend class EpochThreadCache;
+    EpochRecord* acquire_record();
+    void release_record(EpochRecord* rec);
+    uint64_t min_active_epoch();
+    size_t reclaim(EpochRecord* rec);
+    size_t reclaim(EpochRecord* rec, uint64_t min_epoch);
+    void retire(void* ptr, void (*deleter)(void*));
+private:
+    uint64_t _id = {0};
+    std::atomic<uint64_t> _global_epoch = {1};
+    std::atomic<EpochRecord*> _record_list = {nullptr};
+    std::atomic<int> _record_count = {0};
+};
+
+// RAII的读临界区，可以嵌套，拷贝时临界区也会延长到副本析构
+class EpochGuard {
+public:
+    explicit EpochGuard(EpochDomain& domain = get_default_epoch_domain()) : _domain(&domain) {
+        _domain->read_lock();
+    }
+    EpochGuard(const EpochGuard& other) : _domain(other._domain) {
+        _domain->read_lock();
+    }
+    EpochGuard& operator=(const EpochGuard& other) {
+        if (_domain != other._domain) {
+            other._domain->read_lock();
+            _domain->read_unlock();
+            _domain = other._domain;
+        }
+        return *this;
+    }
+    ~EpochGuard() {
+        _domain->read_unlock();
+    }
+private:
+    EpochDomain* _domain;
+};
+
+} // namespace
+
+#include "epoch.hpp"
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <limits>
+
+namespace rcu {
+
+inline EpochDomain& get_default_epoch_domain() {
+    static EpochDomain domain;
+    return domain;
+}
+
+inline EpochThreadCache::~EpochThreadCache() {
+    auto& registry = EpochRegistry::instance();
+    // 持有锁，保证归还record的过程中domain不会被析构
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    for (auto& item : _records) {
+        auto iter = registry.domains.find(item.id);
+        if (iter != registry.domains.end() && iter->second == item.domain) {
+            item.domain->release_record(item.record);
+        }
+    }
+    _records.clear();
+}
+
+inline EpochRecord* EpochThreadCache::get_record(EpochDomain* domain) {
+    if (likely(domain == _last_domain && domain->id() == _last_id)) {
+        return _last_record;
+    }
+    EpochRecord* rec = nullptr;
+    for (auto& item : _records) {
+        if (item.domain == domain) {
+            if (item.id == domain->id()) {
+                rec = item.record;
+            } else {
+                // 旧domain已经析构，新domain复用了同一个地址
+                item.id = domain->id();
+                item.record = rec = domain->acquire_record();
+            }
+            break;
+        }
+    }
+    if (rec == nullptr) {
+        rec = domain->acquire_record();
+        _records.push_back({domain, domain->id(), rec});
+    }
+    _last_domain = domain;
+    _last_id = domain->id();
+    _last_record = rec;
+    return rec;
+}
+
+inline EpochDomain::EpochDomain() {
+    auto& registry = EpochRegistry::instance();
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    _id = registry.next_id++;
+    registry.domains.emplace(_id, this);
+}
+
+inline EpochDomain::~EpochDomain() {
+    {
+        auto& registry = EpochRegistry::instance();
+        std::lock_guard<std::mutex> guard(registry.mutex);
+        registry.domains.erase(_id);
+    }
+    EpochRecord* next = nullptr;
+    for (auto* rec = _record_list.load(std::memory_order_acquire); rec != nullptr; rec = next) {
+        next = rec->next;
+        for (auto& item : rec->retired) {
+            item.deleter(item.ptr);
+        }
+        delete rec;
+    }
+}
+
+inline EpochRecord* EpochDomain::acquire_record() {
+    for (auto* rec = _record_list.load(std::memory_order_acquire); rec != nullptr; rec = rec->next) {
+        bool active = rec->active.load(std::memory_order_relaxed);
+        if (!active && rec->active.compare_exchange_strong(
+                            active,
+                            true,
+                            std::memory_order_acquire,
+                            std::memory_order_relaxed)) {
+            // 复用退出线程的record，它没释放完的对象由当前线程继续负责
+            return rec;
+        }
+    }
+    auto* rec = new EpochRecord();
+    rec->next = _record_list.load(std::memory_order_relaxed);
+    while (!_record_list.compare_exchange_weak(
+                rec->next,
+                rec,
+                std::memory_order_release,
+                std::memory_order_relaxed)) {
+    }
+    _record_count.fetch_add(1, std::memory_order_relaxed);
+    return rec;
+}
+
+inline void EpochDomain::release_record(EpochRecord* rec) {
+    DCHECK(rec->depth == 0);
+    rec->depth = 0;
+    rec->epoch.store(0, std::memory_order_release);
+    if (rec->retired_num.load(std::memory_order_relaxed) > 0) {
+        reclaim(rec);
+    }
+    rec->active.store(false, std::memory_order_release);
+}
+
+inline void EpochDomain::read_lock() {
+    auto* rec = EpochThreadCache::instance().get_record(this);
+    if (rec->depth++ > 0) {
+        return;
+    }
+    rec->epoch.store(_global_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    // 和reclaim里的fence配对：要么回收线程看到了我们的epoch，要么我们看到被替换后的新指针
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+inline void EpochDomain::read_unlock() {
+    auto* rec = EpochThreadCache::instance().get_record(this);
+    DCHECK(rec->depth > 0);
+    if (--rec->depth > 0) {
+        return;
+    }
+    rec->epoch.store(0, std::memory_order_release);
+    if (rec->retired_num.load(std::memory_order_relaxed) > 0) {
+        reclaim(rec);
+    }
+}
+
+inline void EpochDomain::quiescent_state() {
+    auto* rec = EpochThreadCache::instance().get_record(this);
+    if (rec->depth > 0) {
+        rec->epoch.store(_global_epoch.load(std::memory_order_acquire), std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    if (rec->retired_num.load(std::memory_order_relaxed) > 0) {
+        reclaim(rec);
+    }
+}
+
+template <typename T, typename D>
+inline void EpochDomain::retire(T* ptr) {
+    retire(static_cast<void*>(ptr), [](void* p) {
+        D()(static_cast<T*>(p));
+    });
+}
+
+inline void EpochDomain::retire(void* ptr, void (*deleter)(void*)) {
+    auto* rec = EpochThreadCache::instance().get_record(this);
+    // 调用者已经把ptr从共享结构上摘掉，推进全局epoch，之后进入临界区的读者看不到ptr
+    uint64_t epoch = _global_epoch.fetch_add(1, std::memory_order_acq_rel);
+    size_t retired_num = 0;
+    {
+        std::lock_guard<std::mutex> guard(rec->retired_mutex);
+        rec->retired.push_back({ptr, deleter, epoch});
+        retired_num = rec->retired.size();
+        rec->retired_num.store(retired_num, std::memory_order_relaxed);
+    }
+    if (rec->depth == 0 || retired_num >= EPOCH_RECLAIM_THRESHOLD) {
+        reclaim(rec);
+    }
+}
+
+inline uint64_t EpochDomain::min_active_epoch() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t min_epoch = std::numeric_limits<uint64_t>::max();
+    for (auto* rec = _record_list.load(std::memory_order_acquire); rec != nullptr; rec = rec->next) {
+        uint64_t epoch = rec->epoch.load(std::memory_order_acquire);
+        if (epoch != 0 && epoch < min_epoch) {
+            min_epoch = epoch;
+        }
+    }
+    return min_epoch;
+}
+
+inline size_t EpochDomain::reclaim(EpochRecord* rec) {
+    return reclaim(rec, min_active_epoch());
+}
+
+inline size_t EpochDomain::reclaim(EpochRecord* rec, uint64_t min_epoch) {
+    std::vector<EpochRetired> ready;
+    size_t left = 0;
+    {
+        std::lock_guard<std::mutex> guard(rec->retired_mutex);
+        auto& retired = rec->retired;
+        for (size_t i = 0; i < retired.size(); ++i) {
+            if (retired[i].epoch < min_epoch) {
+                ready.push_back(retired[i]);
+            } else {
+                retired[left++] = retired[i];
+            }
+        }
+        retired.resize(left);
+        rec->retired_num.store(left, std::memory_order_relaxed);
+    }
+    // deleter里可能再retire，不能持有锁
+    for (auto& item : ready) {
+        item.deleter(item.ptr);
+    }
+    return left;
+}
+
+inline size_t EpochDomain::reclaim() {
+    return reclaim(EpochThreadCache::instance().get_record(this));
+}
+
+inline void EpochDomain::synchronize() {
+    auto* rec = EpochThreadCache::instance().get_record(this);
+    DCHECK(rec->depth == 0);
+    uint64_t target = _global_epoch.fetch_add(1, std::memory_order_acq_rel);
+    uint64_t min_epoch = 0;
+    while ((min_epoch = min_active_epoch()) <= target) {
+        std::this_thread::yield();
+    }
+    // 别的线程retire之后可能不再进入domain，它们的对象也在这里释放
+    for (auto* r = _record_list.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+        if (r->retired_num.load(std::memory_order_relaxed) > 0) {
+            reclaim(r, min_epoch);
+        }
+    }
+}
+
+} // namespace
@@ -7,24 +7,40 @@
 // 4 memory barrier done
 // 5 List HashMap的应用
 // 6 public改成private，使用friend class
+// 7 非对称屏障：读者只用编译器屏障，回收者用membarrier done
+// 8 回收时hazard指针放到线程本地的有序数组里二分查找，不再用unordered_set done
+// 9 默认使用线程本地的record缓存，线程退出时还给全局链表 done
+// 10 HazptrArray一次申请多个record done
+// 11 retired链表按线程分片，回收可以交给后台线程或者自定义executor done
+// 12 HazptrCohort：同一个owner的对象单独挂链表，owner析构时一次扫描批量回收 done
+// 13 多个HazptrManager domain，每个domain自己的回收阈值，容器可以指定domain done
+// 14 回收统计：record占用、待回收对象数、每次扫描的回收数和耗时、最老的retired对象等了多久 done
+// 15 debug模式：报告长时间保护同一个指针的record done
+// 16 HazptrReclaimPolicy，容器可以换成urcu等别的回收策略 done
 
 #include <atomic>
-#include <unordered_set>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 namespace rcu {
 
+// asymmetric memory barrier，为false时读者和回收者都用seq_cst fence
 #ifndef HAZPTR_AMB
 #define HAZPTR_AMB true
 #endif
 
+// 为true时holder的record优先从线程本地缓存拿，缓存空了才遍历全局链表
 #ifndef USE_THREAD_LOCAL_CACHE
-#define USE_THREAD_LOCAL_CACHE false
+#define USE_THREAD_LOCAL_CACHE true
 #endif
 
 #ifndef HAZPTR_RECORD_CACHE_SIZE
 #define HAZPTR_RECORD_CACHE_SIZE 10
 #endif
 
+// 默认domain的回收阈值，别的domain通过HazptrDomainOptions设置
 #ifndef HAZPTR_SCAN_MULT
 #define HAZPTR_SCAN_MULT 2
 #endif
@@ -33,6 +49,26 @@ namespace rcu {
 #define HAZPTR_SCAN_THRESHOLD 5
 #endif
 
+// retired链表的分片数，每个线程固定push到其中一个
+#ifndef HAZPTR_RETIRED_SHARDS
+#define HAZPTR_RETIRED_SHARDS 8
+#endif
+
+// cohort自己回收的最小retired对象数，每次回收都有一次heavy fence，不能太小
+#ifndef HAZPTR_COHORT_THRESHOLD
+#define HAZPTR_COHORT_THRESHOLD 64
+#endif
+
+// 后台回收线程没有被唤醒时的扫描间隔
+#ifndef HAZPTR_RECLAIM_INTERVAL_MS
+#define HAZPTR_RECLAIM_INTERVAL_MS 100
+#endif
+
+// 一个record保护同一个指针超过这么多秒时打WARNING，0表示不检查
+#ifndef HAZPTR_PIN_REPORT_SECONDS
+#define HAZPTR_PIN_REPORT_SECONDS 0
+#endif
+
 
 template<typename T>
 class DoubleLinkedList {
@@ -58,29 +94,63 @@ public:
     int count = {0};
 };
 
+/** 非对称屏障。读者在保护指针时只需要light(编译器屏障)，
+ *  回收者在扫描hazard record之前调用heavy，让进程内所有正在运行的线程都执行一次完整的内存屏障。
+ *  heavy优先用membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED)，内核不支持时在x86上退化成mprotect触发的IPI，
+ *  都不可用(或HAZPTR_AMB为false)时两边都是seq_cst fence。
+ */
+enum class HeavyFenceType {
+    // 0必须是对称的fence：静态初始化之前读到的也是安全的
+    SYMMETRIC = 0,
+    MEMBARRIER,
+    MPROTECT
+};
+HeavyFenceType heavy_fence_type();
+void asymmetric_thread_fence_light();
+void asymmetric_thread_fence_heavy();
+
+class HazptrCohort;
+
 class HazptrObj {
 public:
     const void* get_ptr() {
         return this;
     }
     virtual ~HazptrObj() {}
+    // 没有被保护之后由HazptrManager调用，默认delete，自定义allocator分配的对象重载这里
+    virtual void reclaim() {
+        delete this;
+    }
+    // 设置之后retire的对象挂到cohort上，不进全局的retired链表。必须在retire之前设置
+    void set_cohort(HazptrCohort* cohort) {
+        _cohort = cohort;
+    }
 public:
     HazptrObj* next = {nullptr};
+    HazptrCohort* _cohort = {nullptr};
 };
 
 class HazptrPrivate;
 class HazptrManager;
 HazptrManager& get_default_manager();
 
+namespace detail {
+class HazardScanBuffer;
+} // namespace detail
+
 class HazptrRecord {
 public:
     void clear() {
-        realptr.store(nullptr);
+        realptr.store(nullptr, std::memory_order_release);
     }
 public:
     HazptrRecord* next {nullptr};
     std::atomic<bool> active {true};
     std::atomic<const void*> realptr {nullptr};
+    // 只在打开pin检查时由扫描线程更新：上一次扫描看到的指针和第一次看到它的时间
+    std::atomic<const void*> pinned_ptr {nullptr};
+    std::atomic<uint64_t> pinned_since_ns {0};
+    std::atomic<bool> pin_reported {false};
 };
 
 class HazptrPool {
@@ -91,45 +161,58 @@ public:
         }
         return _record_cache[--_available_cnt];
     }
+    // 线程退出时把缓存的record标记为空闲，别的线程遍历全局链表时可以重用
     ~HazptrPool() {
         LOG(NOTICE) << "~HazptrPool() thread_id:" << std::this_thread::get_id();
-        for (int i = 0; i < _available_cnt.load(); ++i) {
+        for (int i = 0; i < _available_cnt; ++i) {
             auto* p = _record_cache[i];
              _record_cache[i] = nullptr;
              p->active.store(false, std::memory_order_release);
         }
         _available_cnt = 0;
     }
-    void release_to_pool(HazptrRecord* rec) {
+    // 缓存满了返回false，由调用方把record还给全局链表
+    bool release_to_pool(HazptrRecord* rec) {
         if (_available_cnt < HAZPTR_RECORD_CACHE_SIZE) {
             _record_cache[_available_cnt++] = rec;
+            return true;
         }
+        return false;
     }
 
     void reset() {
         _available_cnt = 0;
     }
 private:
-    std::atomic<int> _available_cnt = {0};
+    // 只有本线程访问，不需要atomic
+    int _available_cnt = {0};
     HazptrRecord* _record_cache[HAZPTR_RECORD_CACHE_SIZE];
 };
 
 class HazptrPrivate {
 public:
     static HazptrPrivate& instance() {
-        static thread_local class HazptrPrivate instance;
-        return instance;
+        return *instance_or_null();
+    }
+    // 线程退出、thread_local析构之后返回nullptr，比如析构更晚的thread_local对象里还有holder
+    static HazptrPrivate* instance_or_null() {
+        static thread_local bool destroyed = false;
+        if (destroyed) {
+            return nullptr;
+        }
+        static thread_local class HazptrPrivate instance(&destroyed);
+        return &instance;
     }
 public:
-    HazptrPrivate() {
+    explicit HazptrPrivate(bool* destroyed = nullptr) : _destroyed(destroyed) {
         _manager = &get_default_manager();
     }
     ~HazptrPrivate();
     HazptrRecord* get_cached_rec() {
         return pool.get_from_pool();
     }
-    void free_cached_rec(HazptrRecord* rec) {
-        pool.release_to_pool(rec);
+    bool free_cached_rec(HazptrRecord* rec) {
+        return pool.release_to_pool(rec);
     }
 
     void push(HazptrObj* node);
@@ -143,53 +226,209 @@ public:
     DoubleLinkedList<HazptrObj> priv_list;
     HazptrPool pool;
     HazptrManager* _manager = {nullptr};
+    bool* _destroyed = {nullptr};
 };
 
 
 template<typename T>
 class HazptrNode : public HazptrObj {
 public:
-    void retire() {
-        HazptrPrivate::instance().push(this);
-    }
+    // 设置了cohort时挂到cohort上，manager参数不起作用
+    void retire(HazptrManager& manager = get_default_manager());
     virtual ~HazptrNode() {}
 private:
 };
 
+// 执行回收任务的executor，比如把任务投递到绑在低优先级核上的线程池
+using HazptrExecutor = std::function<void(std::function<void()>)>;
+
+struct HazptrDomainOptions {
+    // retired对象个数同时达到scan_threshold和scan_mult倍的record个数时才回收
+    int scan_threshold = {HAZPTR_SCAN_THRESHOLD};
+    int scan_mult = {HAZPTR_SCAN_MULT};
+    // 大于0时，扫描和stats()检查每个record，保护同一个指针超过这么多秒的打一次WARNING
+    uint32_t pin_report_seconds = {HAZPTR_PIN_REPORT_SECONDS};
+};
+
+struct HazptrStats {
+    // 全局链表上的record，被holder或者线程缓存占用的，正在保护指针的
+    int records = {0};
+    int records_active = {0};
+    int records_protecting = {0};
+    // 保护同一个指针超过pin_report_seconds的record，没有打开pin检查时为0
+    int records_pinned = {0};
+    // 还没回收的retired对象，包括这个domain里cohort上的；默认domain线程私有链表上还没交出来的不算
+    int64_t retired_pending = {0};
+    // 最老的还没回收的retired对象已经等了多久，没有时为0
+    uint64_t oldest_retired_ms = {0};
+    uint64_t scans = {0};
+    uint64_t reclaimed = {0};
+    uint64_t last_scan_reclaimed = {0};
+    uint64_t last_scan_ns = {0};
+    uint64_t max_scan_ns = {0};
+};
+
+/** 管理hazard record和retired对象，一个HazptrManager就是一个domain。
+ *
+ *  retired对象按线程分片挂在HAZPTR_RETIRED_SHARDS个链表上，retire的线程之间不竞争同一个CAS。
+ *  默认由达到阈值的retire线程同步回收；设置了executor或者启动了后台回收线程之后，
+ *  retire线程只投递一个回收任务，回收的延迟不再落在业务线程上。
+ *
+ *  每个domain有自己的record链表和retired链表，回收时只扫描本domain的record。
+ *  保护和retire必须用同一个domain：在别的domain里保护的指针，这个domain回收时看不到。
+ *  get_default_manager()之外的domain不使用线程本地的record缓存和私有retired链表，
+ *  适合record很少的小结构，不用跟着大容器一起扫描几百个record。
+ *
+ *  stats()不加任何会阻塞retire、保护和回收的锁，可以在线上定时读取：
+ *  计数都是按分片维护的atomic，时间戳按"分片从空变成非空"的粒度记录，oldest_retired_ms是近似值。
+ */
 class HazptrManager {
 public:
+    explicit HazptrManager(const HazptrDomainOptions& options = HazptrDomainOptions()) : _options(options) {}
     ~HazptrManager();
+    HazptrManager(const HazptrManager&) = delete;
+    HazptrManager& operator=(const HazptrManager&) = delete;
+
+    const HazptrDomainOptions& options() const {
+        return _options;
+    }
     bool reached_threshold(int rcount);
-    void append(HazptrObj* head, HazptrObj* tail, int count);
+    // since_ns是这批对象最早retire的时间，0表示现在
+    void append(HazptrObj* head, HazptrObj* tail, int count, uint64_t since_ns = 0);
     void tryBulkReclaim();
     void bulkReclaim();
     HazptrRecord* acquire_record();
+    // 一次申请n个record，线程缓存不够时只遍历一次全局链表
+    void acquire_records(HazptrRecord** recs, int n);
     void release_record(HazptrRecord* rec);
+    // 所有分片里还没被回收线程认领的retired对象个数
+    int retired_count();
+    HazptrStats stats();
+
+    // 达到阈值时把bulkReclaim投递给executor，传空的executor恢复同步回收
+    void set_executor(HazptrExecutor executor);
+    // 启动一个后台回收线程，达到阈值时唤醒，没有唤醒时每interval_ms扫描一次
+    void start_reclaimer(uint32_t interval_ms = HAZPTR_RECLAIM_INTERVAL_MS);
+    void stop_reclaimer();
 
     void reset() {
         _hazptr_list.store(nullptr);
-        _retired_list.store(nullptr);
+        for (auto& shard : _retired) {
+            shard.list.store(nullptr);
+            shard.count.store(0);
+            shard.pending.store(0);
+            shard.oldest_ns.store(0);
+        }
         _hazptr_count.store(0);
-        _retired_count.store(0);
     }
 private:
+    friend class HazptrCohort;
+
+    struct alignas(64) RetiredShard {
+        std::atomic<HazptrObj*> list = {nullptr};
+        // 被回收线程认领之后清零，用来判断是否达到阈值
+        std::atomic<int> count = {0};
+        // 链表上实际的对象个数，回收之后才减
+        std::atomic<int> pending = {0};
+        // 链表从空变成非空的时间，survivor挂回来时取更早的
+        std::atomic<uint64_t> oldest_ns = {0};
+    };
+
+    // 一次扫描结束，回收了reclaimed个对象
+    void record_scan(uint64_t reclaimed, uint64_t start_ns);
+    // 返回这个record是不是已经保护ptr超过pin_report_seconds
+    bool check_pinned(HazptrRecord* rec, const void* ptr, uint64_t now_ns);
+    void register_cohort(HazptrCohort* cohort);
+    void unregister_cohort(HazptrCohort* cohort);
+
+    HazptrPrivate* thread_cache();
+    RetiredShard& local_shard();
+    // heavy fence之后收集所有record上的hazard指针
+    void collect_hazards(detail::HazardScanBuffer& hazards);
+    void run_reclaimer(uint32_t interval_ms);
+private:
+    HazptrDomainOptions _options;
     std::atomic<HazptrRecord*> _hazptr_list = {nullptr};
-    std::atomic<HazptrObj*> _retired_list = {nullptr};
-    std::atomic<int> _retired_count = {0};
+    RetiredShard _retired[HAZPTR_RETIRED_SHARDS];
     std::atomic<int> _hazptr_count = {0};
+
+    // 已经投递了回收任务还没开始执行，避免每个达到阈值的线程都投递一次
+    std::atomic<bool> _reclaim_pending = {false};
+    std::mutex _executor_mutex;
+    HazptrExecutor _executor;
+
+    std::mutex _reclaimer_mutex;
+    std::condition_variable _reclaimer_cond;
+    std::thread _reclaimer;
+    bool _reclaimer_stop = {false};
+    bool _reclaim_requested = {false};
+
+    std::atomic<uint64_t> _scans = {0};
+    std::atomic<uint64_t> _reclaimed = {0};
+    std::atomic<uint64_t> _last_scan_reclaimed = {0};
+    std::atomic<uint64_t> _last_scan_ns = {0};
+    std::atomic<uint64_t> _max_scan_ns = {0};
+    // 只在cohort构造、析构和stats()时加锁
+    std::mutex _cohort_mutex;
+    HazptrCohort* _cohorts = {nullptr};
 };
 
-class HazptrHolder {
+/** 一组属于同一个owner(比如一个hashmap segment)的retired对象。
+ *
+ *  set_cohort之后的对象retire时挂到cohort自己的链表上，达到阈值时cohort单独做一次回收，
+ *  不和全局retired链表里别的对象混在一起。owner析构时cohort析构：只扫描一次hazard record，
+ *  链表上的对象以及回收过程中级联retire的对象(比如node析构时释放的next)都按这一次的结果回收。
+ *  owner析构之后不会有新的读者再保护它的对象，所以一次扫描的结果对级联retire的对象也成立；
+ *  仍然被保护的对象清掉cohort之后交给domain的retired链表，析构不等待读者。
+ *  这些对象之后被domain回收时如果级联retire了仍然指向这个cohort的对象就会访问已经析构的cohort，
+ *  所以owner析构时读者不能还持有会级联释放别的对象的指针。
+ */
+class HazptrCohort {
 public:
-    HazptrHolder() {
-        _manager = &get_default_manager();
-        _rec = _manager->acquire_record();
+    explicit HazptrCohort(HazptrManager& manager = get_default_manager());
+    ~HazptrCohort();
+    HazptrCohort(const HazptrCohort&) = delete;
+    HazptrCohort& operator=(const HazptrCohort&) = delete;
+
+    void push(HazptrObj* obj);
+    // 回收没有被保护的对象，被保护的放回链表
+    void reclaim();
+    int retired_count() const {
+        return _count.load(std::memory_order_acquire);
+    }
+    HazptrManager& manager() const {
+        return *_manager;
     }
+private:
+    friend class HazptrManager;
+
+    void push_list(HazptrObj* head, HazptrObj* tail, int count, uint64_t since_ns);
+private:
+    HazptrManager* _manager;
+    std::atomic<HazptrObj*> _list = {nullptr};
+    // 和RetiredShard一样，_count被认领时清零，_pending回收之后才减
+    std::atomic<int> _count = {0};
+    std::atomic<int> _pending = {0};
+    std::atomic<uint64_t> _oldest_ns = {0};
+    // 析构过程中级联retire的对象只挂链表，由析构函数统一回收
+    std::atomic<bool> _closing = {false};
+    // manager上的cohort链表，由_cohort_mutex保护
+    HazptrCohort* _prev = {nullptr};
+    HazptrCohort* _next = {nullptr};
+};
+
+class HazptrHolder {
+public:
+    // record延迟到第一次保护时再申请，只用来比较的iterator(比如cend())不需要record
+    HazptrHolder() : _manager(&get_default_manager()) {}
+    explicit HazptrHolder(HazptrManager& manager) : _manager(&manager) {}
 
     ~HazptrHolder() {
-        _rec->clear();
-        if (_manager) {
-            _manager->release_record(_rec);
+        if (_rec) {
+            _rec->clear();
+            if (_manager) {
+                _manager->release_record(_rec);
+            }
         }
     }
     void swap(HazptrHolder& other) {
@@ -197,13 +436,29 @@ public:
         std::swap(_rec, other._rec);
     }
 
+    HazptrManager& manager() const {
+        return *_manager;
+    }
+    // 换到另一个domain，已经申请的record还给原来的domain，之前的保护失效
+    void set_manager(HazptrManager& manager) {
+        if (_manager != &manager) {
+            HazptrHolder holder(manager);
+            swap(holder);
+        }
+    }
+
     template<typename T>
     void reset(const T* ptr) {
-        _rec->realptr.store(ptr);
+        if (ptr == nullptr && _rec == nullptr) {
+            return;
+        }
+        record()->realptr.store(ptr, std::memory_order_release);
     }
 
     void reset() {
-        _rec->realptr.store(nullptr);
+        if (_rec) {
+            _rec->realptr.store(nullptr, std::memory_order_release);
+        }
     }
 
     template<typename T>
@@ -212,9 +467,75 @@ public:
     template<typename T>
     T* get_protected(const std::atomic<T*>& src);
 
+private:
+    template <uint8_t N>
+    friend class HazptrArray;
+
+    HazptrRecord* record() {
+        if (_rec == nullptr) {
+            _rec = _manager->acquire_record();
+        }
+        return _rec;
+    }
 private:
     HazptrManager* _manager;
-    HazptrRecord* _rec;
+    HazptrRecord* _rec = {nullptr};
+};
+
+/** 构造时一次申请N个record的一组holder，用于一次遍历要同时保护多个指针的场景，
+ *  比如hashmap遍历时的bucket数组+当前节点+下一个节点。
+ *  和单个HazptrHolder不同，record在构造时就申请好，只用来比较的对象不要用它。
+ */
+template <uint8_t N>
+class HazptrArray {
+public:
+    explicit HazptrArray(HazptrManager& manager = get_default_manager()) {
+        HazptrRecord* recs[N];
+        manager.acquire_records(recs, N);
+        for (uint8_t i = 0; i < N; ++i) {
+            _holders[i]._manager = &manager;
+            _holders[i]._rec = recs[i];
+        }
+    }
+    HazptrArray(const HazptrArray&) = delete;
+    HazptrArray& operator=(const HazptrArray&) = delete;
+
+    HazptrHolder& operator[](uint8_t i) {
+        return _holders[i];
+    }
+    static constexpr uint8_t size() {
+        return N;
+    }
+private:
+    HazptrHolder _holders[N];
+};
+
+/** 容器的回收策略，作为ConcurrentHashMap的ReclaimPolicy参数，默认用hazptr。
+ *  容器只通过这几个类型访问回收机制：
+ *  Node<T>是被回收对象的基类(set_cohort/retire/reclaim)，Holder保护读者正在访问的指针，
+ *  Cohort是容器自己的retired对象分组，Domain是Holder和Cohort所属的domain。
+ *  urcu的实现见urcu_policy.h。
+ */
+struct HazptrReclaimPolicy {
+    using Domain = HazptrManager;
+    using Holder = HazptrHolder;
+    using Cohort = HazptrCohort;
+    template <typename T>
+    using Node = HazptrNode<T>;
+
+    // hazptr不需要注册线程，也不需要报告静止状态。
+    // 用户提供的构造和析构让`ThreadScope scope;`不会被当成unused variable
+    struct ThreadScope {
+        ThreadScope() {}
+        ~ThreadScope() {}
+    };
+    static void quiescent_state() {}
+    // 容器的对象挂在自己的cohort上，析构时已经同步回收，不需要等
+    static void barrier() {}
+
+    static Domain& default_domain() {
+        return get_default_manager();
+    }
 };
 
 } // namespace
@@ -1,17 +1,203 @@
 #pragma once
 
+#include <linux/membarrier.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
 namespace rcu {
 
+namespace detail {
+
+inline HeavyFenceType init_heavy_fence() {
+    if (!HAZPTR_AMB) {
+        return HeavyFenceType::SYMMETRIC;
+    }
+#ifdef __NR_membarrier
+    // 先查询再注册，注册之后PRIVATE_EXPEDITED才能用
+    long cmds = syscall(__NR_membarrier, MEMBARRIER_CMD_QUERY, 0);
+    if (cmds > 0 && (cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+            syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0) {
+        LOG(NOTICE) << "hazptr heavy fence: membarrier";
+        return HeavyFenceType::MEMBARRIER;
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    LOG(NOTICE) << "hazptr heavy fence: mprotect";
+    return HeavyFenceType::MPROTECT;
+#else
+    // 别的架构上TLB flush不一定发IPI
+    LOG(WARNING) << "hazptr heavy fence: membarrier unavailable, fallback to symmetric fence";
+    return HeavyFenceType::SYMMETRIC;
+#endif
+}
+
+// 把一个脏页改成只读，内核要给所有运行过本进程线程的cpu发IPI刷TLB，IPI处理时cpu执行了完整的屏障
+inline void mprotect_fence() {
+    static std::mutex mutex;
+    static char* page = [] {
+        void* p = mmap(nullptr, getpagesize(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return p == MAP_FAILED ? nullptr : static_cast<char*>(p);
+    }();
+    if (page == nullptr) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return;
+    }
+    std::lock_guard<std::mutex> g(mutex);
+    mprotect(page, getpagesize(), PROT_READ | PROT_WRITE);
+    // 写一次保证页在TLB里是脏的，降权限时一定要刷
+    __atomic_add_fetch(page, 1, __ATOMIC_SEQ_CST);
+    mprotect(page, getpagesize(), PROT_READ);
+}
+
+inline uint64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// retired对象的时间戳，0表示没有
+inline uint64_t min_since(uint64_t a, uint64_t b) {
+    return a == 0 ? b : (b == 0 ? a : std::min(a, b));
+}
+
+inline void update_oldest(std::atomic<uint64_t>& oldest, uint64_t since) {
+    uint64_t cur = oldest.load(std::memory_order_relaxed);
+    while ((cur == 0 || since < cur) &&
+            !oldest.compare_exchange_weak(cur, since, std::memory_order_relaxed)) {
+    }
+}
+
+/** bulkReclaim收集hazard指针用的数组，每个线程一份，容量只增不减，回收时不再malloc。
+ *  对象的析构里可能又retire触发嵌套的bulkReclaim，嵌套的那一层用临时数组。
+ */
+class HazardScanBuffer {
+public:
+    HazardScanBuffer() {
+        // 线程退出时别的thread_local析构里还可能回收，那时线程本地的数组可能已经析构
+        if (!in_use() && (_hazards = thread_buffer()) != nullptr) {
+            in_use() = true;
+            _owner = true;
+        } else {
+            _hazards = &_local;
+        }
+        _hazards->clear();
+    }
+    ~HazardScanBuffer() {
+        if (_owner) {
+            in_use() = false;
+        }
+    }
+    void add(const void* ptr) {
+        if (ptr != nullptr) {
+            _hazards->push_back(ptr);
+        }
+    }
+    // 收集完之后排序，之后每个retired对象是一次二分查找
+    void seal() {
+        std::sort(_hazards->begin(), _hazards->end());
+        _hazards->erase(std::unique(_hazards->begin(), _hazards->end()), _hazards->end());
+    }
+    void clear() {
+        _hazards->clear();
+    }
+    bool contains(const void* ptr) const {
+        return !_hazards->empty() && std::binary_search(_hazards->begin(), _hazards->end(), ptr);
+    }
+    size_t size() const {
+        return _hazards->size();
+    }
+private:
+    struct ThreadBuffer {
+        ~ThreadBuffer() {
+            *destroyed = true;
+        }
+        std::vector<const void*> hazards;
+        bool* destroyed;
+    };
+    static std::vector<const void*>* thread_buffer() {
+        static thread_local bool destroyed = false;
+        if (destroyed) {
+            return nullptr;
+        }
+        static thread_local ThreadBuffer buffer{{}, &destroyed};
+        return &buffer.hazards;
+    }
+    static bool& in_use() {
+        static thread_local bool flag = false;
+        return flag;
+    }
+private:
+    std::vector<const void*>* _hazards = {nullptr};
+    std::vector<const void*> _local;
+    bool _owner = {false};
+};
+
+} // namespace detail
+
+inline HeavyFenceType heavy_fence_type() {
+    static HeavyFenceType type = detail::init_heavy_fence();
+    return type;
+}
+
+inline void asymmetric_thread_fence_light() {
+    if (heavy_fence_type() == HeavyFenceType::SYMMETRIC) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    } else {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+}
+
+inline void asymmetric_thread_fence_heavy() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    switch (heavy_fence_type()) {
+    case HeavyFenceType::MEMBARRIER:
+        if (syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) != 0) {
+            // 注册成功之后不应该失败，退化成mprotect
+            detail::mprotect_fence();
+        }
+        break;
+    case HeavyFenceType::MPROTECT:
+        detail::mprotect_fence();
+        break;
+    case HeavyFenceType::SYMMETRIC:
+        break;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
 inline HazptrManager& get_default_manager() {
     static HazptrManager manager;
     return manager;
 }
 
+template<typename T>
+void HazptrNode<T>::retire(HazptrManager& manager) {
+    if (this->_cohort) {
+        this->_cohort->push(this);
+        return;
+    }
+    HazptrPrivate* priv = HazptrPrivate::instance_or_null();
+    if (priv && priv->_manager == &manager) {
+        priv->push(this);
+    } else {
+        // 别的domain和线程退出阶段的retire直接放到domain的分片链表
+        manager.append(this, this, 1);
+        manager.tryBulkReclaim();
+    }
+}
+
 inline HazptrPrivate::~HazptrPrivate() {
     LOG(NOTICE) << "~HazptrPrivate() thread_id:" << std::this_thread::get_id();
     if (priv_list.count > 0) {
         pushAlltoDomain();
     }
+    if (_destroyed) {
+        *_destroyed = true;
+    }
 }
 
 inline void HazptrPrivate::push(HazptrObj* node) {
@@ -22,22 +208,27 @@ inline void HazptrPrivate::push(HazptrObj* node) {
 }
 
 inline void HazptrPrivate::pushAlltoDomain() {
-    _manager->append(priv_list.head, priv_list.tail, priv_list.count);
-    priv_list.clear();
+    if (priv_list.count > 0) {
+        _manager->append(priv_list.head, priv_list.tail, priv_list.count);
+        priv_list.clear();
+    }
     _manager->tryBulkReclaim();
 }
 
 inline HazptrManager::~HazptrManager() {
     LOG(NOTICE) << "~HazptrManager()";
+    stop_reclaimer();
     { // free all remaining retired objects
         HazptrObj* next = nullptr;
-        HazptrObj* p = _retired_list.exchange(nullptr);
-        while (p) {
-            for (; p != nullptr; p = next) {
-                next = p->next;
-                delete p;
+        for (auto& shard : _retired) {
+            HazptrObj* p = shard.list.exchange(nullptr);
+            while (p) {
+                for (; p != nullptr; p = next) {
+                    next = p->next;
+                    p->reclaim();
+                }
+                p = shard.list.exchange(nullptr);
             }
-            p = _retired_list.exchange(nullptr);
         }
     }
 
@@ -53,141 +244,510 @@ inline HazptrManager::~HazptrManager() {
 
 inline bool HazptrManager::reached_threshold(int retire_cnt) {
     bool ret =  (
-      retire_cnt >= HAZPTR_SCAN_THRESHOLD &&
-      retire_cnt >= HAZPTR_SCAN_MULT * _hazptr_count.load(std::memory_order_acquire));
+      retire_cnt >= _options.scan_threshold &&
+      retire_cnt >= _options.scan_mult * _hazptr_count.load(std::memory_order_acquire));
       //LOG(NOTICE) << "reached_threshold: " << ret;
     return ret;
 }
 
+inline HazptrPrivate* HazptrManager::thread_cache() {
+    if (!USE_THREAD_LOCAL_CACHE) {
+        return nullptr;
+    }
+    HazptrPrivate* priv = HazptrPrivate::instance_or_null();
+    // 线程缓存里只放default manager的record
+    return (priv && priv->_manager == this) ? priv : nullptr;
+}
+
 inline HazptrRecord* HazptrManager::acquire_record() {
-    HazptrRecord* rec = nullptr;
-    if (USE_THREAD_LOCAL_CACHE) {
-        rec = HazptrPrivate::instance().get_cached_rec();
+    HazptrPrivate* priv = thread_cache();
+    if (priv) {
+        HazptrRecord* rec = priv->get_cached_rec();
         if (rec != nullptr) {
             return rec;
         }
-    } else {
-        for (rec = _hazptr_list.load(std::memory_order_seq_cst); rec != nullptr; rec = rec->next) {
-            bool active = rec->active.load(std::memory_order_seq_cst);
-            if (!active) {
-                if (!rec->active.compare_exchange_strong(
-                        active, 
-                        true, 
-                        std::memory_order_release, 
-                        std::memory_order_relaxed)) {
-                    continue;
-                }
-                //LOG(NOTICE) << "HazptrManager acquire_record get from hazptr_list " << rec;
-                return rec;
+    }
+    HazptrRecord* rec = nullptr;
+    acquire_records(&rec, 1);
+    return rec;
+}
+
+inline void HazptrManager::acquire_records(HazptrRecord** recs, int n) {
+    int got = 0;
+    HazptrPrivate* priv = thread_cache();
+    while (priv && got < n) {
+        HazptrRecord* rec = priv->get_cached_rec();
+        if (rec == nullptr) {
+            break;
+        }
+        recs[got++] = rec;
+    }
+    // 重用别的线程还回来(包括线程退出时交还)的record
+    for (HazptrRecord* rec = _hazptr_list.load(std::memory_order_acquire); rec != nullptr && got < n; rec = rec->next) {
+        bool active = rec->active.load(std::memory_order_acquire);
+        if (!active) {
+            if (!rec->active.compare_exchange_strong(
+                    active, 
+                    true, 
+                    std::memory_order_release, 
+                    std::memory_order_relaxed)) {
+                continue;
             }
+            //LOG(NOTICE) << "HazptrManager acquire_record get from hazptr_list " << rec;
+            recs[got++] = rec;
         }
     }
-    rec = new HazptrRecord();
-    rec->next = _hazptr_list.load(std::memory_order_seq_cst);
-    //_hazptr_list.store(rec);
-    while(!_hazptr_list.compare_exchange_weak(
-                rec->next, 
-                rec, 
-                std::memory_order_release, 
-                std::memory_order_acquire)) {
+    for (; got < n; ++got) {
+        HazptrRecord* rec = new HazptrRecord();
+        rec->next = _hazptr_list.load(std::memory_order_seq_cst);
+        //_hazptr_list.store(rec);
+        while(!_hazptr_list.compare_exchange_weak(
+                    rec->next, 
+                    rec, 
+                    std::memory_order_release, 
+                    std::memory_order_acquire)) {
+        }
+        LOG(NOTICE) << "HazptrManager acquire_record allocate new HazptrRecord:" << rec;
+        _hazptr_count.fetch_add(1);
+        recs[got] = rec;
     }
-    LOG(NOTICE) << "HazptrManager acquire_record allocate new HazptrRecord:" << _hazptr_list.load();
-    _hazptr_count.fetch_add(1);
-
-    return rec;
 }
 
-void HazptrManager::release_record(HazptrRecord* rec) {
-    if (USE_THREAD_LOCAL_CACHE) {
-        HazptrPrivate::instance().free_cached_rec(rec);
-    } else {
-        rec->active.store(false, std::memory_order_seq_cst);
+inline void HazptrManager::release_record(HazptrRecord* rec) {
+    HazptrPrivate* priv = thread_cache();
+    if (priv && priv->free_cached_rec(rec)) {
+        return;
     }
+    // 线程缓存满了或者已经析构，直接还给全局链表
+    rec->active.store(false, std::memory_order_release);
     // rec一旦分配就不会从全局链表释放
     //_hazptr_count.fetch_sub(1); 
 }
 
-void HazptrManager::bulkReclaim() {
-    //为什么要加fence?
-    std::atomic_thread_fence(std::memory_order_seq_cst);
+inline HazptrManager::RetiredShard& HazptrManager::local_shard() {
+    // 按线程轮流分配，pthread_t的低位是对齐的，直接取模分布不均匀
+    static std::atomic<size_t> next_id = {0};
+    static thread_local size_t id = next_id.fetch_add(1, std::memory_order_relaxed) % HAZPTR_RETIRED_SHARDS;
+    return _retired[id];
+}
+
+inline int HazptrManager::retired_count() {
+    int count = 0;
+    for (auto& shard : _retired) {
+        count += shard.count.load(std::memory_order_acquire);
+    }
+    return count;
+}
+
+inline void HazptrManager::bulkReclaim() {
     // 很容易出错的地方：一定要先读取retired_list，再读取hazptr_list
-    HazptrObj* p = _retired_list.exchange(nullptr, std::memory_order_seq_cst);
-    std::unordered_set<const void*> set;
-    HazptrRecord* h = _hazptr_list.load(std::memory_order_seq_cst);
-    int cnt = 0;
-    for (; h != nullptr; h = h->next) {
-        //LOG(NOTICE) << "HazptrManager bulkReclaim got a protected ptr:" << h->realptr;
-        set.insert(h->realptr);
-        cnt++;
+    HazptrObj* lists[HAZPTR_RETIRED_SHARDS];
+    bool empty = true;
+    uint64_t since = 0;
+    for (int i = 0; i < HAZPTR_RETIRED_SHARDS; ++i) {
+        // 先取时间戳再摘链表，中间挂上来的对象会被一起摘走
+        uint64_t oldest = _retired[i].oldest_ns.exchange(0, std::memory_order_relaxed);
+        lists[i] = _retired[i].list.exchange(nullptr, std::memory_order_acq_rel);
+        if (lists[i] != nullptr) {
+            since = detail::min_since(since, oldest);
+            empty = false;
+        }
+    }
+    // 后台线程定时扫描时经常是空的，不用发heavy fence
+    if (empty) {
+        return;
     }
-    //LOG(NOTICE) << "HazptrManager bulkReclaim hazptr_rec_size:" << cnt << " set_size:" << set.size();
+    uint64_t start_ns = detail::steady_ns();
+    detail::HazardScanBuffer hazards;
+    collect_hazards(hazards);
     DoubleLinkedList<HazptrObj> left_list;
     HazptrObj* next = nullptr;
     int object_count = 0;
-    for (; p != nullptr; p = next) {
-        object_count++;
-        next = p->next;
-        if (set.count(p->get_ptr()) > 0) {
-            left_list.push(p);
-            //LOG(NOTICE) << "HazptrManager return the protected object " << p;
-        } else {
-            //LOG(NOTICE) << "HazptrManager delete object safely " << p;
-            delete p;
+    for (int i = 0; i < HAZPTR_RETIRED_SHARDS; ++i) {
+        int shard_count = 0;
+        for (HazptrObj* p = lists[i]; p != nullptr; p = next) {
+            shard_count++;
+            next = p->next;
+            if (hazards.contains(p->get_ptr())) {
+                left_list.push(p);
+                //LOG(NOTICE) << "HazptrManager return the protected object " << p;
+            } else {
+                //LOG(NOTICE) << "HazptrManager delete object safely " << p;
+                p->reclaim();
+            }
         }
+        _retired[i].pending.fetch_sub(shard_count, std::memory_order_relaxed);
+        object_count += shard_count;
     }
     //LOG(NOTICE) << "HazptrManager bulkReclaim object_count " << object_count << " -> " << left_list.count;
     if (left_list.count > 0) {
         // 不能直接修改_retire_list，因为回收的时候也有别的线程在修改_retire_list
-        // _retired_count.store(left_count);
-        // _retired_list.exchange(left_list.head, std::memory_order_seq_cst);
-        append(left_list.head, left_list.tail, left_list.count);
+        // 被保护的对象带着原来的时间戳挂回去，读者一直不放开时oldest_retired_ms会一直增长
+        append(left_list.head, left_list.tail, left_list.count, since);
+    }
+    record_scan(object_count - left_list.count, start_ns);
+}
+
+inline void HazptrManager::record_scan(uint64_t reclaimed, uint64_t start_ns) {
+    uint64_t scan_ns = detail::steady_ns() - start_ns;
+    _scans.fetch_add(1, std::memory_order_relaxed);
+    _reclaimed.fetch_add(reclaimed, std::memory_order_relaxed);
+    _last_scan_reclaimed.store(reclaimed, std::memory_order_relaxed);
+    _last_scan_ns.store(scan_ns, std::memory_order_relaxed);
+    uint64_t max_ns = _max_scan_ns.load(std::memory_order_relaxed);
+    while (scan_ns > max_ns &&
+            !_max_scan_ns.compare_exchange_weak(max_ns, scan_ns, std::memory_order_relaxed)) {
     }
 }
 
+inline bool HazptrManager::check_pinned(HazptrRecord* rec, const void* ptr, uint64_t now_ns) {
+    if (ptr == nullptr || ptr != rec->pinned_ptr.load(std::memory_order_relaxed)) {
+        // 换了指针重新计时。两次检查之间放开又保护了同一个指针的，看起来和一直保护一样
+        rec->pinned_ptr.store(ptr, std::memory_order_relaxed);
+        rec->pinned_since_ns.store(now_ns, std::memory_order_relaxed);
+        rec->pin_reported.store(false, std::memory_order_relaxed);
+        return false;
+    }
+    // 多个线程同时检查时now_ns可能比记录的时间早
+    uint64_t since_ns = rec->pinned_since_ns.load(std::memory_order_relaxed);
+    if (now_ns < since_ns || now_ns - since_ns < _options.pin_report_seconds * 1000000000UL) {
+        return false;
+    }
+    // 每次保护只报告一次
+    if (!rec->pin_reported.exchange(true, std::memory_order_relaxed)) {
+        LOG(WARNING) << "hazptr record " << rec << " has pinned " << ptr
+            << " for " << (now_ns - since_ns) / 1000000 << "ms";
+    }
+    return true;
+}
 
-void HazptrManager::append(HazptrObj* head, HazptrObj* tail, int count) {
-    // 为什么要加fence?
-    std::atomic_thread_fence(std::memory_order_seq_cst);
-    tail->next = _retired_list.load(std::memory_order_seq_cst);
-    //_retired_list.store(head);
-    while(!_retired_list.compare_exchange_weak(
-                tail->next, 
-                head, 
-                std::memory_order_release, 
-                std::memory_order_acquire)) {
+inline HazptrStats HazptrManager::stats() {
+    HazptrStats stats;
+    uint64_t now_ns = detail::steady_ns();
+    uint64_t oldest = 0;
+    for (auto& shard : _retired) {
+        stats.retired_pending += shard.pending.load(std::memory_order_relaxed);
+        if (shard.list.load(std::memory_order_relaxed) != nullptr) {
+            oldest = detail::min_since(oldest, shard.oldest_ns.load(std::memory_order_relaxed));
+        }
+    }
+    {
+        std::lock_guard<std::mutex> g(_cohort_mutex);
+        for (HazptrCohort* cohort = _cohorts; cohort != nullptr; cohort = cohort->_next) {
+            stats.retired_pending += cohort->_pending.load(std::memory_order_relaxed);
+            if (cohort->_list.load(std::memory_order_relaxed) != nullptr) {
+                oldest = detail::min_since(oldest, cohort->_oldest_ns.load(std::memory_order_relaxed));
+            }
+        }
+    }
+    // 计数的加减不在同一个时刻，并发时可能短暂为负
+    stats.retired_pending = std::max(stats.retired_pending, int64_t(0));
+    if (oldest != 0 && now_ns > oldest) {
+        stats.oldest_retired_ms = (now_ns - oldest) / 1000000;
+    }
+    uint32_t pin_seconds = _options.pin_report_seconds;
+    for (HazptrRecord* rec = _hazptr_list.load(std::memory_order_acquire); rec != nullptr; rec = rec->next) {
+        const void* ptr = rec->realptr.load(std::memory_order_acquire);
+        stats.records++;
+        stats.records_active += rec->active.load(std::memory_order_relaxed);
+        stats.records_protecting += (ptr != nullptr);
+        if (pin_seconds > 0 && check_pinned(rec, ptr, now_ns)) {
+            stats.records_pinned++;
+        }
+    }
+    stats.scans = _scans.load(std::memory_order_relaxed);
+    stats.reclaimed = _reclaimed.load(std::memory_order_relaxed);
+    stats.last_scan_reclaimed = _last_scan_reclaimed.load(std::memory_order_relaxed);
+    stats.last_scan_ns = _last_scan_ns.load(std::memory_order_relaxed);
+    stats.max_scan_ns = _max_scan_ns.load(std::memory_order_relaxed);
+    return stats;
+}
+
+inline void HazptrManager::register_cohort(HazptrCohort* cohort) {
+    std::lock_guard<std::mutex> g(_cohort_mutex);
+    cohort->_next = _cohorts;
+    if (_cohorts) {
+        _cohorts->_prev = cohort;
+    }
+    _cohorts = cohort;
+}
+
+inline void HazptrManager::unregister_cohort(HazptrCohort* cohort) {
+    std::lock_guard<std::mutex> g(_cohort_mutex);
+    if (cohort->_prev) {
+        cohort->_prev->_next = cohort->_next;
+    } else {
+        _cohorts = cohort->_next;
+    }
+    if (cohort->_next) {
+        cohort->_next->_prev = cohort->_prev;
     }
-    _retired_count.fetch_add(count);
+    cohort->_prev = nullptr;
+    cohort->_next = nullptr;
 }
 
-void HazptrManager::tryBulkReclaim() {
-    // 可能很多个线程同时达到阈值，触发bulk reclaim, 所以不能直接store
-    //_retired_count.store(0);
-    int retire_cnt = _retired_count.load(std::memory_order_acquire);
+
+inline void HazptrManager::collect_hazards(detail::HazardScanBuffer& hazards) {
+    // 读者保护指针时只有编译器屏障，realptr的store可能还在读者cpu的store buffer里，
+    // heavy fence之后所有读者已经发布的realptr都可见，之后才发布的读者一定能读到对象已经被摘掉
+    asymmetric_thread_fence_heavy();
+    // 不用unordered_set：每个record一次malloc，每个retired对象一次hash探测
+    hazards.clear();
+    uint32_t pin_seconds = _options.pin_report_seconds;
+    uint64_t now_ns = pin_seconds > 0 ? detail::steady_ns() : 0;
+    HazptrRecord* h = _hazptr_list.load(std::memory_order_acquire);
+    int cnt = 0;
+    for (; h != nullptr; h = h->next) {
+        //LOG(NOTICE) << "HazptrManager bulkReclaim got a protected ptr:" << h->realptr;
+        const void* ptr = h->realptr.load(std::memory_order_acquire);
+        hazards.add(ptr);
+        if (pin_seconds > 0) {
+            check_pinned(h, ptr, now_ns);
+        }
+        cnt++;
+    }
+    hazards.seal();
+    //LOG(NOTICE) << "HazptrManager bulkReclaim hazptr_rec_size:" << cnt << " hazards_size:" << hazards.size();
+}
+
+inline void HazptrManager::append(HazptrObj* head, HazptrObj* tail, int count, uint64_t since_ns) {
+    RetiredShard& shard = local_shard();
+    // 发布之前加，回收线程减的时候一定已经加过
+    shard.pending.fetch_add(count, std::memory_order_relaxed);
+    // 发布之后tail随时可能被回收，不能再读tail->next
+    HazptrObj* prev = shard.list.load(std::memory_order_acquire);
     do {
-        int hazptr_cnt = _hazptr_count.load(std::memory_order_acquire);
-        if (retire_cnt < HAZPTR_SCAN_THRESHOLD || retire_cnt < HAZPTR_SCAN_MULT * hazptr_cnt) {
-            LOG(NOTICE) << "tryBulkReclaim retired_count not enough: " << retire_cnt;
+        if (prev == nullptr) {
+            // 分片从空变成非空，之前的时间戳已经被回收线程取走
+            shard.oldest_ns.store(since_ns ? since_ns : detail::steady_ns(), std::memory_order_relaxed);
+        }
+        tail->next = prev;
+    } while (!shard.list.compare_exchange_weak(
+                prev,
+                head,
+                std::memory_order_release,
+                std::memory_order_acquire));
+    if (since_ns) {
+        detail::update_oldest(shard.oldest_ns, since_ns);
+    }
+    shard.count.fetch_add(count, std::memory_order_release);
+}
+
+inline void HazptrManager::tryBulkReclaim() {
+    int retire_cnt = retired_count();
+    if (!reached_threshold(retire_cnt)) {
+        LOG(NOTICE) << "tryBulkReclaim retired_count not enough: " << retire_cnt;
+        return;
+    }
+    // 可能很多个线程同时达到阈值，只有认领到计数的线程去回收
+    int claimed = 0;
+    for (auto& shard : _retired) {
+        claimed += shard.count.exchange(0, std::memory_order_acq_rel);
+    }
+    if (claimed == 0) {
+        return;
+    }
+    if (_reclaim_pending.exchange(true, std::memory_order_acq_rel)) {
+        // 已经有一个投递出去的任务，它会把这次的对象一起回收
+        return;
+    }
+    HazptrExecutor executor;
+    {
+        std::lock_guard<std::mutex> g(_executor_mutex);
+        executor = _executor;
+    }
+    if (!executor) {
+        _reclaim_pending.store(false, std::memory_order_release);
+        bulkReclaim();
+        return;
+    }
+    executor([this] {
+        _reclaim_pending.store(false, std::memory_order_release);
+        bulkReclaim();
+    });
+}
+
+inline void HazptrManager::set_executor(HazptrExecutor executor) {
+    std::lock_guard<std::mutex> g(_executor_mutex);
+    _executor = std::move(executor);
+}
+
+inline void HazptrManager::start_reclaimer(uint32_t interval_ms) {
+    std::lock_guard<std::mutex> g(_reclaimer_mutex);
+    if (_reclaimer.joinable()) {
+        return;
+    }
+    _reclaimer_stop = false;
+    _reclaimer = std::thread([this, interval_ms] { run_reclaimer(interval_ms); });
+    // 回收任务交给后台线程：只唤醒它，不在调用方线程执行
+    set_executor([this](std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> g(_reclaimer_mutex);
+            if (!_reclaimer_stop) {
+                _reclaim_requested = true;
+                _reclaimer_cond.notify_one();
+                return;
+            }
+        }
+        // stop_reclaimer之前拿到的executor，后台线程已经退出，在调用方线程执行
+        task();
+    });
+}
+
+inline void HazptrManager::stop_reclaimer() {
+    std::thread reclaimer;
+    {
+        std::lock_guard<std::mutex> g(_reclaimer_mutex);
+        if (!_reclaimer.joinable()) {
             return;
         }
-    } while(!_retired_count.compare_exchange_weak(
-                    retire_cnt, 
-                    0, 
-                    std::memory_order_release, 
-                    std::memory_order_acquire));
+        _reclaimer_stop = true;
+        _reclaimer_cond.notify_one();
+        reclaimer.swap(_reclaimer);
+    }
+    reclaimer.join();
+    set_executor(nullptr);
+    // 退出前最后一次唤醒可能没有执行
+    _reclaim_pending.store(false, std::memory_order_release);
+}
+
+inline void HazptrManager::run_reclaimer(uint32_t interval_ms) {
+    LOG(NOTICE) << "HazptrManager reclaimer start, interval_ms:" << interval_ms;
+    std::unique_lock<std::mutex> lock(_reclaimer_mutex);
+    while (!_reclaimer_stop) {
+        _reclaimer_cond.wait_for(lock, std::chrono::milliseconds(interval_ms), [this] {
+            return _reclaimer_stop || _reclaim_requested;
+        });
+        _reclaim_requested = false;
+        lock.unlock();
+        _reclaim_pending.store(false, std::memory_order_release);
+        bulkReclaim();
+        lock.lock();
+    }
+    LOG(NOTICE) << "HazptrManager reclaimer stop";
+}
+
 
-    bulkReclaim();
+inline HazptrCohort::HazptrCohort(HazptrManager& manager) : _manager(&manager) {
+    _manager->register_cohort(this);
 }
 
+inline void HazptrCohort::push_list(HazptrObj* head, HazptrObj* tail, int count, uint64_t since_ns) {
+    // 和HazptrManager::append相同
+    _pending.fetch_add(count, std::memory_order_relaxed);
+    HazptrObj* prev = _list.load(std::memory_order_acquire);
+    do {
+        if (prev == nullptr) {
+            _oldest_ns.store(since_ns ? since_ns : detail::steady_ns(), std::memory_order_relaxed);
+        }
+        tail->next = prev;
+    } while (!_list.compare_exchange_weak(
+                prev,
+                head,
+                std::memory_order_release,
+                std::memory_order_acquire));
+    if (since_ns) {
+        detail::update_oldest(_oldest_ns, since_ns);
+    }
+    _count.fetch_add(count, std::memory_order_release);
+}
+
+inline void HazptrCohort::push(HazptrObj* obj) {
+    if (_closing.load(std::memory_order_relaxed)) {
+        // 只有析构线程在retire，不需要CAS和计数
+        obj->next = _list.load(std::memory_order_relaxed);
+        _list.store(obj, std::memory_order_relaxed);
+        return;
+    }
+    push_list(obj, obj, 1, 0);
+    int count = _count.load(std::memory_order_acquire);
+    if (count >= HAZPTR_COHORT_THRESHOLD && _manager->reached_threshold(count) &&
+            !_closing.load(std::memory_order_relaxed)) {
+        reclaim();
+    }
+}
+
+inline void HazptrCohort::reclaim() {
+    // 和tryBulkReclaim一样，认领到计数的线程才回收
+    if (_count.exchange(0, std::memory_order_acq_rel) == 0) {
+        return;
+    }
+    // 一定要先摘下链表，再扫描hazard record
+    uint64_t since = _oldest_ns.exchange(0, std::memory_order_relaxed);
+    HazptrObj* p = _list.exchange(nullptr, std::memory_order_acq_rel);
+    if (p == nullptr) {
+        return;
+    }
+    uint64_t start_ns = detail::steady_ns();
+    detail::HazardScanBuffer hazards;
+    _manager->collect_hazards(hazards);
+    DoubleLinkedList<HazptrObj> left_list;
+    HazptrObj* next = nullptr;
+    int object_count = 0;
+    for (; p != nullptr; p = next) {
+        next = p->next;
+        object_count++;
+        if (hazards.contains(p->get_ptr())) {
+            left_list.push(p);
+        } else {
+            // 级联retire的对象挂回_list，下一次回收时重新扫描
+            p->reclaim();
+        }
+    }
+    _pending.fetch_sub(object_count, std::memory_order_relaxed);
+    if (left_list.count > 0) {
+        push_list(left_list.head, left_list.tail, left_list.count, since);
+    }
+    _manager->record_scan(object_count - left_list.count, start_ns);
+}
+
+inline HazptrCohort::~HazptrCohort() {
+    // 析构期间的对象不再计入manager的统计
+    _manager->unregister_cohort(this);
+    _closing.store(true, std::memory_order_relaxed);
+    HazptrObj* p = _list.exchange(nullptr, std::memory_order_acq_rel);
+    if (p == nullptr) {
+        return;
+    }
+    uint64_t start_ns = detail::steady_ns();
+    int reclaimed = 0;
+    detail::HazardScanBuffer hazards;
+    _manager->collect_hazards(hazards);
+    DoubleLinkedList<HazptrObj> left_list;
+    HazptrObj* next = nullptr;
+    while (p != nullptr) {
+        for (; p != nullptr; p = next) {
+            next = p->next;
+            if (hazards.contains(p->get_ptr())) {
+                // cohort马上就没了，交给domain之后按普通对象回收
+                p->set_cohort(nullptr);
+                left_list.push(p);
+            } else {
+                p->reclaim();
+                reclaimed++;
+            }
+        }
+        // 回收过程中级联retire的对象，用同一次扫描的结果
+        p = _list.exchange(nullptr, std::memory_order_acq_rel);
+    }
+    _manager->record_scan(reclaimed, start_ns);
+    if (left_list.count > 0) {
+        // 只扫描一次，还被读者保护的对象挂到domain的retired链表，不在析构里等读者
+        _manager->append(left_list.head, left_list.tail, left_list.count);
+        LOG(NOTICE) << "~HazptrCohort hand over protected objects to domain, count:" << left_list.count;
+    }
+}
 
 template<typename T>
 bool HazptrHolder::try_protect(T* &p, const std::atomic<T*>& src) {
-    _rec->realptr.store(p, std::memory_order_seq_cst);
-    // 为什么要加fence?
-    std::atomic_thread_fence(std::memory_order_seq_cst);
-    T* latest_p = src.load(std::memory_order_seq_cst);
+    HazptrRecord* rec = record();
+    rec->realptr.store(p, std::memory_order_release);
+    // store和下面的load之间需要StoreLoad屏障，由回收者的heavy fence补上
+    asymmetric_thread_fence_light();
+    T* latest_p = src.load(std::memory_order_acquire);
     if (p != latest_p) {
         p = latest_p;
-        _rec->realptr.store(nullptr);
+        rec->realptr.store(nullptr, std::memory_order_relaxed);
         return false;
     }
     return true;
@@ -0,0 +1,196 @@
+#pragma once
+
+// TODO
+// 1 Harris-Michael有序链表，多个写者无锁并发add/remove done
+// 2 next指针的最低位做删除标记，遍历时用hazptr保护prev和curr done
+// 3 contains不帮忙摘除，遇到被标记的节点也能继续往后走
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include "concurrent/hazptr.h"
+#include "concurrent/thread_slab_allocator.h"
+
+namespace rcu {
+
+/** 有序单链表实现的set，多个线程可以同时add/remove/contains，替代只能单写者的SWMRListSet。
+ *
+ *  remove分两步：先CAS把curr->next的最低位置上删除标记(逻辑删除，remove的线性化点)，
+ *  再CAS把prev->next从curr改成curr->next(物理摘除)。摘除失败时由后面经过这个节点的find帮忙摘除，
+ *  摘除成功的线程独占这个node，负责retire。
+ *  被标记的node的next不会再被修改，所以新节点不会插到已经逻辑删除的节点后面。
+ *
+ *  find一边走一边用两个hazptr保护prev和curr：curr发布之后要确认prev->next仍然等于curr，
+ *  prev被标记或者curr被摘除时确认失败，从链表头重新开始。
+ *  所有原子操作都是acquire/release，hazptr自己的StoreLoad屏障由回收者的heavy fence补上。
+ *
+ *  T需要支持<和==，node从线程本地的slab free list分配，retire的node挂在链表自己的cohort上。
+ */
+template<typename T, typename Allocator = ThreadSlabAllocator<uint8_t>>
+class LockFreeListSet {
+private:
+    struct Node : public HazptrNode<Node> {
+        template <typename... Args>
+        explicit Node(Args&&... args) : element(std::forward<Args>(args)...) {}
+
+        template <typename... Args>
+        static Node* create(Args&&... args) {
+            return new (Allocator().allocate(sizeof(Node))) Node(std::forward<Args>(args)...);
+        }
+        static void destroy(Node* node) {
+            node->~Node();
+            Allocator().deallocate(reinterpret_cast<uint8_t*>(node), sizeof(Node));
+        }
+        void reclaim() override {
+            destroy(this);
+        }
+
+        T element;
+        // 最低位是删除标记
+        std::atomic<Node*> next = {nullptr};
+    };
+
+    static bool is_marked(Node* p) {
+        return reinterpret_cast<uintptr_t>(p) & 1;
+    }
+    static Node* get_marked(Node* p) {
+        return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(p) | 1);
+    }
+    static Node* get_unmarked(Node* p) {
+        return reinterpret_cast<Node*>(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(1));
+    }
+
+public:
+    LockFreeListSet(LockFreeListSet const&) = delete;
+    LockFreeListSet& operator=(LockFreeListSet const&) = delete;
+
+    explicit LockFreeListSet(HazptrManager& manager = get_default_manager()) : _cohort(manager) {
+    }
+
+    // 调用者保证析构时没有并发操作，已经retire的node由_cohort析构时回收
+    ~LockFreeListSet() {
+        Node* node = _head.load(std::memory_order_acquire);
+        while (node) {
+            Node* next = get_unmarked(node->next.load(std::memory_order_relaxed));
+            Node::destroy(node);
+            node = next;
+        }
+    }
+
+    // 已经存在时返回false
+    bool add(const T& data) {
+        HazptrArray<2> holders(_cohort.manager());
+        Node* node = nullptr;
+        while (true) {
+            std::atomic<Node*>* prev = nullptr;
+            Node* curr = nullptr;
+            if (find(data, holders, prev, curr)) {
+                if (node) {
+                    Node::destroy(node);
+                }
+                return false;
+            }
+            if (node == nullptr) {
+                node = Node::create(data);
+                node->set_cohort(&_cohort);
+            }
+            node->next.store(curr, std::memory_order_relaxed);
+            // prev所在的node被标记或者中间插入了新节点时失败，重新找位置
+            if (prev->compare_exchange_weak(curr, node,
+                        std::memory_order_release, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    // 不存在时返回false
+    bool remove(const T& data) {
+        HazptrArray<2> holders(_cohort.manager());
+        while (true) {
+            std::atomic<Node*>* prev = nullptr;
+            Node* curr = nullptr;
+            if (!find(data, holders, prev, curr)) {
+                return false;
+            }
+            Node* next = curr->next.load(std::memory_order_acquire);
+            if (is_marked(next)) {
+                // 被别的remove抢先标记了，重新找一次，确认是不是又被add回来了
+                continue;
+            }
+            if (!curr->next.compare_exchange_weak(next, get_marked(next),
+                        std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                continue;
+            }
+            Node* expected = curr;
+            if (prev->compare_exchange_strong(expected, next,
+                        std::memory_order_release, std::memory_order_relaxed)) {
+                holders[1].reset();
+                curr->retire();
+            } else {
+                // 摘除失败，再走一遍find把它摘下来，保证返回之后链表上没有这个节点
+                find(data, holders, prev, curr);
+            }
+            return true;
+        }
+    }
+
+    /** 和SWMRListSet不同，prev被修改时一定重新开始，不会返回过期的结果。
+     *  走的是和add/remove一样的find，遇到被标记的节点帮忙摘除：
+     *  被标记节点的后继不能靠确认prev->next来保护(它可能已经不在链表上)，不摘除的话只能从头开始。
+     */
+    bool contains(const T& data) {
+        HazptrArray<2> holders(_cohort.manager());
+        std::atomic<Node*>* prev = nullptr;
+        Node* curr = nullptr;
+        return find(data, holders, prev, curr);
+    }
+
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    /** 找到第一个不小于data的未标记节点curr，prev指向前驱的next(或者_head)，
+     *  返回时holders[0]保护prev所在的node，holders[1]保护curr。
+     *  路上遇到的被标记节点顺手摘除，摘除成功的线程负责retire。
+     */
+    bool find(const T& data, HazptrArray<2>& holders, std::atomic<Node*>*& prev, Node*& curr) {
+    try_again:
+        prev = &_head;
+        curr = prev->load(std::memory_order_acquire);
+        while (true) {
+            if (curr == nullptr) {
+                return false;
+            }
+            // 确认失败说明prev被标记或者curr已经不是prev的后继
+            if (!holders[1].try_protect(curr, *prev)) {
+                goto try_again;
+            }
+            Node* next = curr->next.load(std::memory_order_acquire);
+            if (is_marked(next)) {
+                Node* unmarked = get_unmarked(next);
+                Node* expected = curr;
+                if (!prev->compare_exchange_strong(expected, unmarked,
+                            std::memory_order_release, std::memory_order_relaxed)) {
+                    goto try_again;
+                }
+                holders[1].reset();
+                curr->retire();
+                curr = unmarked;
+                continue;
+            }
+            if (!(curr->element < data)) {
+                return curr->element == data;
+            }
+            prev = &curr->next;
+            curr = next;
+            holders[0].swap(holders[1]);
+        }
+    }
+
+private:
+    HazptrCohort _cohort;
+    std::atomic<Node*> _head = {nullptr};
+};
+
+} // namespace
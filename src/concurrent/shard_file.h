@@ -0,0 +1,105 @@
+#pragma once
+
+// TODO
+// 1 header + shard切片 done
+// 2 按shard记录dirty，增量msync done
+// 3 文件大小只增不减 done
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <memory>
+
+#include "debug.h"
+
+namespace rcu {
+
+constexpr uint64_t SHARD_FILE_MAGIC = 0x5243555348415244UL; // "RCUSHARD"
+constexpr uint32_t SHARD_FILE_VERSION = 1;
+
+// 文件头，独占第一个page
+struct ShardFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t elem_size;
+    uint64_t num_per_shard;
+    uint64_t shard_num;
+    uint64_t shard_bytes;
+};
+
+/** File backed storage of ConcurrentVector shards.
+ *
+ *  文件布局: | header(1 page) | shard 0 | shard 1 | ... |
+ *  一次性预留max_shard_num个shard的地址空间，文件随着shard的创建按需ftruncate扩大，
+ *  所以shard的地址固定，进程重启后重新mmap就能直接读到上次的数据。
+ *  数据写入的是MAP_SHARED的页面，checkpoint()只msync被标记为dirty的shard。
+ */
+class ShardFile {
+public:
+    ShardFile() = default;
+    ~ShardFile();
+    // 禁止拷贝和移动
+    ShardFile(ShardFile&&) = delete;
+    ShardFile(const ShardFile&) = delete;
+    ShardFile& operator=(ShardFile&&) = delete;
+    ShardFile& operator=(const ShardFile&) = delete;
+
+    // 文件不存在时创建，存在时校验elem_size和num_per_shard，成功返回0
+    int open(const std::string& path, size_t elem_size, size_t num_per_shard, size_t max_shard_num);
+    void close();
+
+    // 返回第shard_id个shard的地址，多个线程对同一个shard_id调用会得到同一块内存
+    void* create_shard(size_t shard_id);
+    void* get_shard(size_t shard_id) const {
+        return _base + _data_offset + shard_id * _shard_bytes;
+    }
+    // 记录已经发布到table上的shard数量，checkpoint时落盘
+    void set_shard_num(size_t shard_num);
+
+    void mark_dirty(size_t shard_id) {
+        auto& word = _dirty[shard_id >> 6];
+        uint64_t bit = 1UL << (shard_id & 63);
+        // 先读再写，避免写热点shard时反复写同一个cache line
+        if ((word.load(std::memory_order_relaxed) & bit) == 0) {
+            word.fetch_or(bit, std::memory_order_relaxed);
+        }
+    }
+    bool is_dirty(size_t shard_id) const {
+        return (_dirty[shard_id >> 6].load(std::memory_order_relaxed) >> (shard_id & 63)) & 1;
+    }
+
+    /** 增量checkpoint，返回flush的shard数量，出错返回-1。
+     *  写者先mark_dirty再写，所以dirty位清除之前标记过的写者可能还没写完：
+     *  wait_writers在清除dirty之后、msync之前调用，等这些写者写完(比如EpochDomain::synchronize)。
+     *  不传时调用者要保证写完之后才mark_dirty，否则写入可能落在msync之后，又没有被重新标记。
+     */
+    int checkpoint(const std::function<void()>& wait_writers = nullptr);
+
+    size_t shard_num() const {
+        return _header ? _header->shard_num : 0;
+    }
+    size_t max_shard_num() const {
+        return _max_shard_num;
+    }
+    bool is_open() const {
+        return _base != nullptr;
+    }
+private:
+    int ensure_file_size(size_t bytes);
+private:
+    int _fd = {-1};
+    char* _base = {nullptr};
+    ShardFileHeader* _header = {nullptr};
+    size_t _data_offset = {0};
+    size_t _shard_bytes = {0};
+    size_t _max_shard_num = {0};
+    size_t _mapped_bytes = {0};
+    size_t _file_bytes = {0};
+    std::mutex _mutex;
+    std::unique_ptr<std::atomic<uint64_t>[]> _dirty;
+};
+
+} // namespace
+
+#include "shard_file.hpp"
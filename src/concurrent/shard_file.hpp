@@ -0,0 +1,165 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+
+namespace rcu {
+
+inline ShardFile::~ShardFile() {
+    close();
+}
+
+inline int ShardFile::open(const std::string& path, size_t elem_size, size_t num_per_shard, size_t max_shard_num) {
+    if (is_open()) {
+        LOG(WARNING) << "ShardFile already opened, path:" << path;
+        return -1;
+    }
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t shard_bytes = (num_per_shard * elem_size + page_size - 1) & ~(page_size - 1);
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        LOG(WARNING) << "open shard file failed, path:" << path << " error:" << strerror(errno);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        LOG(WARNING) << "fstat shard file failed, path:" << path << " error:" << strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    size_t mapped_bytes = page_size + max_shard_num * shard_bytes;
+    // 预留全部地址空间，超出文件大小的部分在ftruncate之前不会被访问
+    void* base = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        LOG(WARNING) << "mmap shard file failed, path:" << path << " error:" << strerror(errno);
+        ::close(fd);
+        return -1;
+    }
+    _fd = fd;
+    _base = static_cast<char*>(base);
+    _header = reinterpret_cast<ShardFileHeader*>(_base);
+    _data_offset = page_size;
+    _shard_bytes = shard_bytes;
+    _max_shard_num = max_shard_num;
+    _mapped_bytes = mapped_bytes;
+    _file_bytes = st.st_size;
+    _dirty.reset(new std::atomic<uint64_t>[(max_shard_num + 63) / 64]());
+
+    if (_file_bytes == 0) {
+        if (ensure_file_size(page_size) != 0) {
+            close();
+            return -1;
+        }
+        _header->magic = SHARD_FILE_MAGIC;
+        _header->version = SHARD_FILE_VERSION;
+        _header->elem_size = elem_size;
+        _header->num_per_shard = num_per_shard;
+        _header->shard_num = 0;
+        _header->shard_bytes = shard_bytes;
+        return 0;
+    }
+    if (_file_bytes < page_size ||
+            _header->magic != SHARD_FILE_MAGIC ||
+            _header->version != SHARD_FILE_VERSION ||
+            _header->elem_size != elem_size ||
+            _header->num_per_shard != num_per_shard ||
+            _header->shard_bytes != shard_bytes ||
+            _header->shard_num > max_shard_num ||
+            _file_bytes < page_size + _header->shard_num * shard_bytes) {
+        LOG(WARNING) << "shard file header mismatch, path:" << path;
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+inline void ShardFile::close() {
+    if (_base) {
+        munmap(_base, _mapped_bytes);
+        _base = nullptr;
+        _header = nullptr;
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+inline int ShardFile::ensure_file_size(size_t bytes) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (_file_bytes >= bytes) {
+        return 0;
+    }
+    if (ftruncate(_fd, bytes) != 0) {
+        LOG(WARNING) << "ftruncate shard file failed, bytes:" << bytes << " error:" << strerror(errno);
+        return -1;
+    }
+    _file_bytes = bytes;
+    return 0;
+}
+
+inline void* ShardFile::create_shard(size_t shard_id) {
+    if (shard_id >= _max_shard_num) {
+        LOG(WARNING) << "shard file is full, shard_id:" << shard_id << " max_shard_num:" << _max_shard_num;
+        return nullptr;
+    }
+    // 新扩出来的文件内容为0，和堆上创建shard时memset的效果一样
+    if (ensure_file_size(_data_offset + (shard_id + 1) * _shard_bytes) != 0) {
+        return nullptr;
+    }
+    return get_shard(shard_id);
+}
+
+inline void ShardFile::set_shard_num(size_t shard_num) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    if (_header->shard_num < shard_num) {
+        _header->shard_num = shard_num;
+    }
+}
+
+inline int ShardFile::checkpoint(const std::function<void()>& wait_writers) {
+    int flushed = 0;
+    size_t shard_num = 0;
+    {
+        // 和set_shard_num并发
+        std::lock_guard<std::mutex> guard(_mutex);
+        shard_num = _header->shard_num;
+    }
+    // 先清除所有dirty再等写者，之后标记的写入留给下次checkpoint
+    std::vector<uint64_t> dirty((shard_num + 63) / 64);
+    for (size_t word_id = 0; word_id < dirty.size(); ++word_id) {
+        dirty[word_id] = _dirty[word_id].exchange(0, std::memory_order_acq_rel);
+    }
+    if (wait_writers) {
+        wait_writers();
+    }
+    for (size_t word_id = 0; word_id < dirty.size(); ++word_id) {
+        uint64_t& bits = dirty[word_id];
+        while (bits) {
+            size_t shard_id = word_id * 64 + __builtin_ctzl(bits);
+            if (msync(get_shard(shard_id), _shard_bytes, MS_SYNC) != 0) {
+                LOG(WARNING) << "msync shard failed, shard_id:" << shard_id << " error:" << strerror(errno);
+                // 还没flush的shard重新标记为dirty
+                for (size_t i = word_id; i < dirty.size(); ++i) {
+                    _dirty[i].fetch_or(dirty[i], std::memory_order_relaxed);
+                }
+                return -1;
+            }
+            bits &= bits - 1;
+            flushed++;
+        }
+    }
+    if (msync(_base, _data_offset, MS_SYNC) != 0) {
+        LOG(WARNING) << "msync shard file header failed, error:" << strerror(errno);
+        return -1;
+    }
+    return flushed;
+}
+
+} // namespace
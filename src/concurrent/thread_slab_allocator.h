@@ -0,0 +1,275 @@
+#pragma once
+
+// TODO
+// 1 按16字节分级的线程本地free list done
+// 2 线程退出时把free list还给全局 done
+// 3 slab归还给操作系统
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// 每次向系统申请的slab大小
+#ifndef SLAB_ALLOCATOR_SLAB_SIZE
+#define SLAB_ALLOCATOR_SLAB_SIZE (64 * 1024)
+#endif
+
+// 超过这个大小的直接走malloc
+#ifndef SLAB_ALLOCATOR_MAX_SIZE
+#define SLAB_ALLOCATOR_MAX_SIZE 256
+#endif
+
+// 线程缓存和全局depot之间一次搬运的对象个数
+#ifndef SLAB_ALLOCATOR_BATCH
+#define SLAB_ALLOCATOR_BATCH 64
+#endif
+
+namespace rcu {
+
+namespace slab {
+
+constexpr size_t ALIGN = 16;
+constexpr size_t NUM_CLASSES = SLAB_ALLOCATOR_MAX_SIZE / ALIGN;
+
+inline size_t size_class(size_t bytes) {
+    return bytes ? (bytes + ALIGN - 1) / ALIGN - 1 : 0;
+}
+
+inline size_t class_size(size_t cls) {
+    return (cls + 1) * ALIGN;
+}
+
+struct FreeObject {
+    FreeObject* next;
+};
+
+class FreeList {
+public:
+    void push(void* p) {
+        auto* obj = static_cast<FreeObject*>(p);
+        obj->next = head;
+        head = obj;
+        count++;
+    }
+    void* pop() {
+        FreeObject* obj = head;
+        head = obj->next;
+        count--;
+        return obj;
+    }
+    // 从头部摘下n个对象
+    FreeList split(size_t n) {
+        FreeList list;
+        while (list.count < n && head) {
+            list.push(pop());
+        }
+        return list;
+    }
+    void append(FreeList& other) {
+        while (other.head) {
+            push(other.pop());
+        }
+    }
+    bool empty() const {
+        return head == nullptr;
+    }
+public:
+    FreeObject* head = {nullptr};
+    size_t count = {0};
+};
+
+/** 全局的free对象仓库，每个size class一把锁。
+ *  线程缓存空了从这里批量拿，攒多了批量还回来；这里也空了就切一个新的slab。
+ *  slab一旦申请就不再还给操作系统。
+ */
+class SlabDepot {
+public:
+    // 故意不析构：静态对象析构之后还可能有线程在退出时归还内存
+    static SlabDepot& instance() {
+        static SlabDepot* depot = new SlabDepot;
+        return *depot;
+    }
+
+    FreeList fetch(size_t cls) {
+        auto& c = _classes[cls];
+        std::lock_guard<std::mutex> g(c.lock);
+        if (c.list.empty()) {
+            carve(cls, c.list);
+        }
+        return c.list.split(SLAB_ALLOCATOR_BATCH);
+    }
+
+    void release(size_t cls, FreeList& list) {
+        auto& c = _classes[cls];
+        std::lock_guard<std::mutex> g(c.lock);
+        c.list.append(list);
+    }
+
+    void* allocate(size_t cls) {
+        auto& c = _classes[cls];
+        std::lock_guard<std::mutex> g(c.lock);
+        if (c.list.empty()) {
+            carve(cls, c.list);
+        }
+        return c.list.pop();
+    }
+
+    void deallocate(size_t cls, void* p) {
+        auto& c = _classes[cls];
+        std::lock_guard<std::mutex> g(c.lock);
+        c.list.push(p);
+    }
+
+    size_t slab_count() {
+        std::lock_guard<std::mutex> g(_slab_lock);
+        return _slabs.size();
+    }
+private:
+    void carve(size_t cls, FreeList& list) {
+        char* slab = static_cast<char*>(malloc(SLAB_ALLOCATOR_SLAB_SIZE));
+        if (slab == nullptr) {
+            throw std::bad_alloc();
+        }
+        {
+            // 记下来只是为了让leak检查认为slab可达
+            std::lock_guard<std::mutex> g(_slab_lock);
+            _slabs.push_back(slab);
+        }
+        size_t size = class_size(cls);
+        for (size_t offset = 0; offset + size <= SLAB_ALLOCATOR_SLAB_SIZE; offset += size) {
+            list.push(slab + offset);
+        }
+    }
+private:
+    struct alignas(64) Class {
+        std::mutex lock;
+        FreeList list;
+    };
+    Class _classes[NUM_CLASSES];
+    std::mutex _slab_lock;
+    std::vector<void*> _slabs;
+};
+
+class ThreadSlabCache {
+public:
+    // 线程退出、thread_local析构之后返回nullptr，调用方直接走depot
+    static ThreadSlabCache* instance() {
+        static thread_local bool destroyed = false;
+        if (destroyed) {
+            return nullptr;
+        }
+        static thread_local ThreadSlabCache cache(&destroyed);
+        return &cache;
+    }
+
+    explicit ThreadSlabCache(bool* destroyed) : _destroyed(destroyed) {}
+
+    ~ThreadSlabCache() {
+        for (size_t cls = 0; cls < NUM_CLASSES; ++cls) {
+            if (!_lists[cls].empty()) {
+                SlabDepot::instance().release(cls, _lists[cls]);
+            }
+        }
+        *_destroyed = true;
+    }
+
+    void* allocate(size_t cls) {
+        auto& list = _lists[cls];
+        if (list.empty()) {
+            list = SlabDepot::instance().fetch(cls);
+        }
+        return list.pop();
+    }
+
+    // hazptr回收的线程不一定是分配的线程，攒多了还给depot，避免内存堆在一个线程里
+    void deallocate(size_t cls, void* p) {
+        auto& list = _lists[cls];
+        list.push(p);
+        if (list.count >= 2 * SLAB_ALLOCATOR_BATCH) {
+            FreeList batch = list.split(SLAB_ALLOCATOR_BATCH);
+            SlabDepot::instance().release(cls, batch);
+        }
+    }
+private:
+    FreeList _lists[NUM_CLASSES];
+    bool* _destroyed;
+};
+
+} // namespace slab
+
+/** 无状态的allocator，小对象从线程本地的slab free list分配，可以作为ConcurrentHashMap的Allocator参数。
+ *
+ *  分配和释放都不加锁，线程缓存空了或者攒多了才和全局depot批量交换一次。
+ *  适合node频繁插入删除的场景；代价是释放的内存只会回到free list，不会还给操作系统。
+ */
+template <typename T = uint8_t>
+class ThreadSlabAllocator {
+public:
+    using value_type = T;
+    template <typename U>
+    struct rebind {
+        using other = ThreadSlabAllocator<U>;
+    };
+
+    ThreadSlabAllocator() = default;
+    template <typename U>
+    ThreadSlabAllocator(const ThreadSlabAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes > SLAB_ALLOCATOR_MAX_SIZE || alignof(T) > slab::ALIGN) {
+            void* p = malloc(bytes);
+            if (p == nullptr) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(p);
+        }
+        size_t cls = slab::size_class(bytes);
+        auto* cache = slab::ThreadSlabCache::instance();
+        return static_cast<T*>(cache ? cache->allocate(cls) : slab::SlabDepot::instance().allocate(cls));
+    }
+
+    // 大块内存直接拿calloc的全0页，不用逐个清零
+    T* allocate_zeroed(size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes > SLAB_ALLOCATOR_MAX_SIZE || alignof(T) > slab::ALIGN) {
+            void* p = calloc(n, sizeof(T));
+            if (p == nullptr) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(p);
+        }
+        T* p = allocate(n);
+        memset(static_cast<void*>(p), 0, bytes);
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) {
+        size_t bytes = n * sizeof(T);
+        if (bytes > SLAB_ALLOCATOR_MAX_SIZE || alignof(T) > slab::ALIGN) {
+            free(p);
+            return;
+        }
+        size_t cls = slab::size_class(bytes);
+        auto* cache = slab::ThreadSlabCache::instance();
+        if (cache) {
+            cache->deallocate(cls, p);
+        } else {
+            slab::SlabDepot::instance().deallocate(cls, p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const ThreadSlabAllocator<U>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const ThreadSlabAllocator<U>&) const {
+        return false;
+    }
+};
+
+} // namespace
@@ -0,0 +1,209 @@
+#pragma once
+
+// TODO
+// 1 QSBR和memb两种flavor的回收策略，可以作为ConcurrentHashMap的ReclaimPolicy参数 done
+// 2 读者iterator跨线程传递时报错
+
+#include <atomic>
+
+#ifndef _LGPL_SOURCE
+// 和main/route_rcu.c一样，读端的函数内联进来，不走函数调用
+#define _LGPL_SOURCE
+#endif
+#include <urcu/urcu-qsbr.h>
+#include <urcu/urcu-memb.h>
+
+// 两个flavor的call-rcu.h共用一个include guard，第二个flavor的声明没有展开，这里统一补上
+extern "C" {
+void urcu_qsbr_call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head));
+void urcu_qsbr_barrier(void);
+void urcu_memb_call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head));
+void urcu_memb_barrier(void);
+}
+
+namespace rcu {
+
+/** QSBR：读端没有任何指令，代价是每个注册的线程要定期调用quiescent_state()，
+ *  或者在长时间阻塞之前thread_offline()，否则grace period结束不了，retire的对象一直不回收。
+ *  两次quiescent_state()之间读到的指针都有效。
+ */
+struct UrcuQsbrFlavor {
+    static void read_lock() { urcu_qsbr_read_lock(); }
+    static void read_unlock() { urcu_qsbr_read_unlock(); }
+    static void quiescent_state() { urcu_qsbr_quiescent_state(); }
+    static void thread_offline() { urcu_qsbr_thread_offline(); }
+    static void thread_online() { urcu_qsbr_thread_online(); }
+    static void register_thread() { urcu_qsbr_register_thread(); }
+    static void unregister_thread() { urcu_qsbr_unregister_thread(); }
+    static void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head*)) {
+        urcu_qsbr_call_rcu(head, func);
+    }
+    // 在线的线程相当于一直在读临界区里，等grace period之前要先offline
+    static void barrier() {
+        bool online = urcu_qsbr_read_ongoing();
+        if (online) {
+            urcu_qsbr_thread_offline();
+        }
+        urcu_qsbr_barrier();
+        if (online) {
+            urcu_qsbr_thread_online();
+        }
+    }
+};
+
+/** memb：读端只有一次TLS计数器的读写，内核支持membarrier时没有fence，
+ *  不需要报告静止状态，读临界区就是Holder的生命周期。
+ */
+struct UrcuMembFlavor {
+    static void read_lock() { urcu_memb_read_lock(); }
+    static void read_unlock() { urcu_memb_read_unlock(); }
+    static void quiescent_state() {}
+    static void thread_offline() {}
+    static void thread_online() {}
+    static void register_thread() { urcu_memb_register_thread(); }
+    static void unregister_thread() { urcu_memb_unregister_thread(); }
+    static void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head*)) {
+        urcu_memb_call_rcu(head, func);
+    }
+    static void barrier() { urcu_memb_barrier(); }
+};
+
+// urcu的grace period是进程全局的，domain只是给容器的接口占位
+template <typename Flavor>
+class UrcuDomain {
+public:
+    static UrcuDomain& instance() {
+        static UrcuDomain domain;
+        return domain;
+    }
+};
+
+/** 和HazptrHolder接口相同，生命周期就是一个读临界区，可以嵌套。
+ *  指针不需要逐个发布，get_protected只是一次acquire load，reset/swap什么都不做。
+ *  临界区属于构造它的线程，iterator不能交给别的线程使用。
+ */
+template <typename Flavor>
+class UrcuHolder {
+public:
+    UrcuHolder() {
+        Flavor::read_lock();
+    }
+    explicit UrcuHolder(UrcuDomain<Flavor>&) : UrcuHolder() {}
+    ~UrcuHolder() {
+        Flavor::read_unlock();
+    }
+    UrcuHolder(const UrcuHolder&) = delete;
+    UrcuHolder& operator=(const UrcuHolder&) = delete;
+
+    template <typename T>
+    T* get_protected(const std::atomic<T*>& src) {
+        return src.load(std::memory_order_acquire);
+    }
+    template <typename T>
+    void reset(const T*) {}
+    void reset() {}
+    void swap(UrcuHolder&) {}
+    void set_manager(UrcuDomain<Flavor>&) {}
+    UrcuDomain<Flavor>& manager() const {
+        return UrcuDomain<Flavor>::instance();
+    }
+};
+
+// 对象直接交给call_rcu，不需要按owner分组
+template <typename Flavor>
+class UrcuCohort {
+public:
+    explicit UrcuCohort(UrcuDomain<Flavor>& = UrcuDomain<Flavor>::instance()) {}
+    UrcuCohort(const UrcuCohort&) = delete;
+    UrcuCohort& operator=(const UrcuCohort&) = delete;
+
+    UrcuDomain<Flavor>& manager() {
+        return UrcuDomain<Flavor>::instance();
+    }
+};
+
+struct UrcuHead {
+    struct rcu_head rcu;
+};
+
+/** 被回收对象的基类，和HazptrNode一样重载reclaim()。
+ *  retire之后等一个grace period，在urcu的call_rcu线程上调用reclaim()，
+ *  reclaim里级联retire别的对象是安全的。
+ */
+template <typename Flavor>
+class UrcuObj : private UrcuHead {
+public:
+    virtual ~UrcuObj() {}
+    virtual void reclaim() {
+        delete this;
+    }
+    void set_cohort(UrcuCohort<Flavor>*) {}
+    void retire() {
+        Flavor::call_rcu(&rcu, &UrcuObj::do_reclaim);
+    }
+    // 已经回收的对象个数，默认只有一个call_rcu线程在写，没有竞争
+    static uint64_t reclaimed_count() {
+        return _reclaimed.load(std::memory_order_acquire);
+    }
+private:
+    static void do_reclaim(struct rcu_head* head) {
+        // rcu是UrcuHead的第一个成员，地址相同
+        static_cast<UrcuObj*>(reinterpret_cast<UrcuHead*>(head))->reclaim();
+        _reclaimed.fetch_add(1, std::memory_order_release);
+    }
+    static inline std::atomic<uint64_t> _reclaimed = {0};
+};
+
+// 线程使用urcu policy的容器(读和写)之前注册，析构时注销
+template <typename Flavor>
+class UrcuThreadScope {
+public:
+    UrcuThreadScope() {
+        Flavor::register_thread();
+    }
+    ~UrcuThreadScope() {
+        Flavor::unregister_thread();
+    }
+    UrcuThreadScope(const UrcuThreadScope&) = delete;
+    UrcuThreadScope& operator=(const UrcuThreadScope&) = delete;
+};
+
+/** 用urcu回收的ReclaimPolicy，接口见HazptrReclaimPolicy。
+ *
+ *  和hazptr的区别：
+ *  读者不发布指针也没有fence，读完一条很长的链表也只是普通的load；
+ *  容器析构之后retire的对象仍在call_rcu线程上异步回收，需要等回收完成时调用barrier()；
+ *  所有访问容器的线程都要在ThreadScope里，QSBR还要定期quiescent_state()。
+ */
+template <typename Flavor>
+struct UrcuReclaimPolicy {
+    using Domain = UrcuDomain<Flavor>;
+    using Holder = UrcuHolder<Flavor>;
+    using Cohort = UrcuCohort<Flavor>;
+    template <typename T>
+    using Node = UrcuObj<Flavor>;
+    using ThreadScope = UrcuThreadScope<Flavor>;
+
+    static void quiescent_state() {
+        Flavor::quiescent_state();
+    }
+    /** 等之前retire的对象全部回收完，不能在Holder的生命周期内调用。
+     *  reclaim里级联retire的对象(比如bucket list释放链表头)在这一轮barrier开始之后才交给call_rcu，
+     *  所以重复到某一轮没有回收任何对象为止。
+     */
+    static void barrier() {
+        uint64_t before = 0;
+        do {
+            before = UrcuObj<Flavor>::reclaimed_count();
+            Flavor::barrier();
+        } while (UrcuObj<Flavor>::reclaimed_count() != before);
+    }
+    static Domain& default_domain() {
+        return Domain::instance();
+    }
+};
+
+using UrcuQsbrPolicy = UrcuReclaimPolicy<UrcuQsbrFlavor>;
+using UrcuMembPolicy = UrcuReclaimPolicy<UrcuMembFlavor>;
+
+} // namespace
@@ -6,25 +6,129 @@
 // 5 retire_list done
 // 5 destructor done
 // 6 benchmark done
+// 7 Table改用EpochDomain回收 done
+// 8 并行的for_each/fill_n/copy_n done
+// 9 shard使用mmap文件持久化 done
+// 10 copy-on-write的版本快照 done
+// 11 retire_list侵入式链表、批量retire done
+// 12 临界区内不加guard的读取get_unguarded done
 
 #pragma once
 
 #include <memory>
+#include <new>
 #include <algorithm>
 #include <bitset>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <cstring>
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "debug.h"
+#include "epoch.h"
+#include "shard_file.h"
 
 constexpr size_t CACHELINE_SIZE = 64;
 
 namespace rcu {
 
+// 超过这么多字节的fill_n/copy_n使用non-temporal store，避免把别的热数据挤出cache
+#ifndef CONCURRENT_VECTOR_NT_THRESHOLD
+#define CONCURRENT_VECTOR_NT_THRESHOLD (1UL << 20)
+#endif
+
+namespace detail {
+
+template <typename IT, typename T>
+constexpr bool is_contiguous_iterator_v =
+    std::is_pointer_v<IT> ||
+    (!std::is_same_v<T, bool> &&
+     (std::is_same_v<IT, typename std::vector<T>::iterator> ||
+      std::is_same_v<IT, typename std::vector<T>::const_iterator>));
+
+inline int resolve_threads(int threads) {
+#ifdef _OPENMP
+    if (threads <= 0) {
+        threads = omp_get_max_threads();
+    }
+#endif
+    return std::max(threads, 1);
+}
+
+template <typename T>
+inline void fill_range(T* begin, T* end, const T& value, bool non_temporal) {
+#ifdef __SSE2__
+    if constexpr (std::is_trivially_copyable_v<T> && 16 % sizeof(T) == 0) {
+        if (non_temporal) {
+            // 先写到16字节对齐，中间部分用streaming store，最后补齐尾部
+            T* p = begin;
+            while (p != end && (reinterpret_cast<uintptr_t>(p) & 15) != 0) {
+                *p++ = value;
+            }
+            alignas(16) T pattern[16 / sizeof(T)];
+            std::fill(pattern, pattern + 16 / sizeof(T), value);
+            __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern));
+            for (; end - p >= static_cast<ptrdiff_t>(16 / sizeof(T)); p += 16 / sizeof(T)) {
+                _mm_stream_si128(reinterpret_cast<__m128i*>(p), v);
+            }
+            std::fill(p, end, value);
+            return;
+        }
+    }
+#endif
+    std::fill(begin, end, value);
+}
+
+template <typename T>
+inline void copy_range(const T* src, T* begin, T* end, bool non_temporal) {
+    static_assert(std::is_trivially_copyable_v<T>, "copy_range requires trivially copyable T");
+#ifdef __SSE2__
+    if (non_temporal) {
+        T* p = begin;
+        while (p != end && (reinterpret_cast<uintptr_t>(p) & 15) != 0) {
+            *p++ = *src++;
+        }
+        size_t bytes = (end - p) * sizeof(T);
+        auto* d = reinterpret_cast<char*>(p);
+        auto* s = reinterpret_cast<const char*>(src);
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(d + i), v);
+        }
+        if (i < bytes) {
+            __builtin_memcpy(d + i, s + i, bytes - i);
+        }
+        return;
+    }
+#endif
+    __builtin_memcpy(begin, src, (end - begin) * sizeof(T));
+}
+
+// streaming store是弱序的，发布数据之前需要sfence
+inline void store_fence(bool non_temporal) {
+#ifdef __SSE2__
+    if (non_temporal) {
+        _mm_sfence();
+    }
+#endif
+}
+
+} // namespace detail
+
 template <typename T>
 inline T* get_ptr(uint64_t tagged_ptr) {
     return reinterpret_cast<T*>(tagged_ptr & 0x0000FFFFFFFFFFFFUL);
 }
 
-uint16_t get_tag(uint64_t tagged_ptr) {
+inline uint16_t get_tag(uint64_t tagged_ptr) {
     return tagged_ptr >> 48;
 }
 
@@ -36,19 +140,62 @@ inline uint64_t make_tagged_ptr(T* ptr, uint16_t tag) {
     return reinterpret_cast<uint64_t>(ptr) | (static_cast<uint64_t>(tag) << 48);
 }
 
+// 继承RetireListHook的对象直接用自己的retire_next挂到RetireList上，retire时不再分配Node
+struct RetireListHook {
+    RetireListHook* retire_next = {nullptr};
+};
+
 template <typename T, typename D = std::default_delete<T>>
 class RetireList {
 public:
-    struct Node {
+    static constexpr bool INTRUSIVE = std::is_base_of_v<RetireListHook, T>;
+    // 非侵入式的对象需要包一层Node
+    struct Node : public RetireListHook {
         T* data = {nullptr};
-        Node* next = {nullptr};    
+    };
+    /** 调用者本地攒的一批对象，retire(batch)一次CAS挂到RetireList上。
+     *  只能被一个线程使用。
+     */
+    class Batch {
+    public:
+        Batch() = default;
+        ~Batch() {
+            DCHECK(_head == nullptr);
+        }
+        void add(T* data) {
+            RetireListHook* hook = RetireList::make_hook(data);
+            hook->retire_next = _head;
+            if (_head == nullptr) {
+                _tail = hook;
+            }
+            _head = hook;
+            _size++;
+        }
+        size_t size() const {
+            return _size;
+        }
+        bool empty() const {
+            return _head == nullptr;
+        }
+    private:
+        friend class RetireList;
+        RetireListHook* _head = {nullptr};
+        RetireListHook* _tail = {nullptr};
+        size_t _size = {0};
     };
 public:
     inline RetireList() noexcept {
     }
+    // 调用者保证析构时没有并发的retire
+    inline ~RetireList() noexcept {
+        auto* head = get_ptr<RetireListHook>(_head.exchange(0, std::memory_order_acquire));
+        if (head) {
+            delete_list(head);
+        }
+    }
     uint16_t get_current_timestamp() {
         ::timespec spec;
-        ::clock_gettime(CLOCK_MONOTONIC, &spec);
+        ::clock_gettime(CLOCK_MONOTONIC_COARSE, &spec);
         // 按照64s一个时间单位
         return spec.tv_sec >> 6;
     }
@@ -57,17 +204,28 @@ public:
         return static_cast<uint16_t>(get_tag(head) - now) > 1;
     }
     void retire(T* data) {
-        auto* new_node = new Node;
-        new_node->data = data;
+        RetireListHook* hook = make_hook(data);
+        // 每次都读时钟(COARSE走vDSO，很便宜)：缓存的时间戳在retire不频繁的线程上可能过期很久，
+        // 和别的线程刚push的head比较会被当成已经过期，把读者还在用的对象一起删掉
         uint16_t now = get_current_timestamp();
         try_gc(now);
-        push(new_node, now);
+        push(hook, hook, now);
+    }
+    void retire(Batch& batch) {
+        if (batch.empty()) {
+            return;
+        }
+        // 一批只读一次时钟，一次CAS
+        uint16_t now = get_current_timestamp();
+        try_gc(now);
+        push(batch._head, batch._tail, now);
+        batch._head = batch._tail = nullptr;
+        batch._size = 0;
     }
     void try_gc(uint16_t now) {
         uint64_t old_head = _head.load(std::memory_order_acquire);
         if (expire(old_head, now)) {
             auto* head = try_drop(old_head);
-            LOG(NOTICE) << "head expired do gc..." << head;
             if (head) {
                 delete_list(head);
             }
@@ -76,53 +234,66 @@ public:
     void force_gc() {
         uint64_t old_head = _head.load(std::memory_order_acquire);
         auto* head = try_drop(old_head);
-        LOG(NOTICE) << "force gc..." << head;
         if (head) {
-            delete_list(head);
+            int cnt = delete_list(head);
+            LOG(NOTICE) << "force gc, delete " << cnt << " nodes";
         }
     }
 
 private:
-    void push(Node* new_node, uint16_t now) noexcept {
-        uint64_t new_head_tagged_ptr = make_tagged_ptr(new_node, now); 
-        uint64_t old_head_tagged_ptr = _head.load();
-        new_node->next = get_ptr<Node>(old_head_tagged_ptr);
+    static RetireListHook* make_hook(T* data) {
+        if constexpr (INTRUSIVE) {
+            return data;
+        } else {
+            auto* node = new Node;
+            node->data = data;
+            return node;
+        }
+    }
+    // 把[first, last]这一段链表挂到头部
+    void push(RetireListHook* first, RetireListHook* last, uint16_t now) noexcept {
+        uint64_t new_head_tagged_ptr = make_tagged_ptr(first, now); 
+        uint64_t old_head_tagged_ptr = _head.load(std::memory_order_relaxed);
         do {
-            new_node->next = get_ptr<Node>(old_head_tagged_ptr);
+            last->retire_next = get_ptr<RetireListHook>(old_head_tagged_ptr);
         } while(!_head.compare_exchange_weak(
                                 old_head_tagged_ptr,
                                 new_head_tagged_ptr, 
                                 std::memory_order_release, 
-                                std::memory_order_acquire));
+                                std::memory_order_relaxed));
     }
-    Node* try_drop(uint64_t old_head) noexcept {
+    RetireListHook* try_drop(uint64_t old_head) noexcept {
         uint64_t old_head_tagged_ptr = old_head;
         uint64_t new_head_tagged_ptr = 0;
-        Node* head = nullptr;
+        RetireListHook* head = nullptr;
         if(_head.compare_exchange_weak(
                                 old_head_tagged_ptr,
                                 new_head_tagged_ptr,
-                                std::memory_order_release,
-                                std::memory_order_acquire)) {
-            head = get_ptr<Node>(old_head_tagged_ptr);
+                                std::memory_order_acquire,
+                                std::memory_order_relaxed)) {
+            head = get_ptr<RetireListHook>(old_head_tagged_ptr);
         }
         return head;
     }
-    void delete_list(Node* head) {
-        Node* next = nullptr;
+    int delete_list(RetireListHook* head) {
+        RetireListHook* next = nullptr;
         int cnt = 0;
         for (; head != nullptr; head = next) {
-            next = head->next;
-            D()(head->data);
-            delete head;
+            next = head->retire_next;
+            if constexpr (INTRUSIVE) {
+                D()(static_cast<T*>(head));
+            } else {
+                auto* node = static_cast<Node*>(head);
+                D()(node->data);
+                delete node;
+            }
             cnt++;
         }
-        LOG(NOTICE) << "delete_list -> " << cnt << " nodes";
+        return cnt;
     }
-    Node* get_head() {
+    RetireListHook* get_head() {
         uint64_t head_tagged_ptr = _head.load(std::memory_order_acquire);
-        auto* node = get_ptr<Node>(head_tagged_ptr);
-        return node;
+        return get_ptr<RetireListHook>(head_tagged_ptr);
     }
     // 禁止拷贝和移动
     inline RetireList(RetireList&&) = delete;
@@ -136,6 +307,10 @@ private:
 template <typename T>
 class ConcurrentVector {
     struct Table {
+        // shards之后紧跟每个shard的版本号，等于ConcurrentVector::_version时可以原地写
+        std::atomic<uint64_t>* versions() {
+            return reinterpret_cast<std::atomic<uint64_t>*>(shards + shard_num);
+        }
         size_t shard_num;
         T* shards[0];
     };
@@ -145,14 +320,14 @@ class ConcurrentVector {
         }
     };
     struct Meta {
-        size_t get_shard_id(size_t index) {
+        size_t get_shard_id(size_t index) const {
             return index >> shard_bit;
         }
-        size_t get_shard_offset(size_t index) {
+        size_t get_shard_offset(size_t index) const {
             return index & (num_per_shard - 1);
         }
         // 容纳size个元素需要多少个分片
-        size_t require_shard_num(size_t size) {
+        size_t require_shard_num(size_t size) const {
             return get_shard_id(size-1) + 1;
         }
         size_t num_per_shard = {0};
@@ -160,73 +335,253 @@ class ConcurrentVector {
     };
     class Snapshot {
     public:
-        Snapshot(Table* table, Meta meta) : 
-                _table(table), _meta(meta) {
+        // 先进入读临界区再读取table，保证table在Snapshot的生命周期内不会被释放
+        Snapshot(ConcurrentVector* owner) :
+                _guard(*owner->_domain),
+                _table(owner->_table.load(std::memory_order_acquire)),
+                _meta(owner->_meta),
+                _owner(owner) {
+        }
+        // 调用者已经在读临界区内拿到了table
+        Snapshot(ConcurrentVector* owner, Table* table) :
+                _guard(*owner->_domain), _table(table), _meta(owner->_meta), _owner(owner) {
         }
-        T& operator[](size_t index) {
+        // 只读，不标记dirty也不复制shard
+        const T& operator[](size_t index) const {
             DCHECK(_table);
             DCHECK(_table->shards);
             auto shard_id = _meta.get_shard_id(index);
             auto offset = _meta.get_shard_offset(index);
             return _table->shards[shard_id][offset];
         }
-        const T& operator[](size_t index) const {
+        // 返回可写的引用，文件持久化时标记shard为dirty，shard被版本快照共享时先复制一份
+        T& writable(size_t index) {
             DCHECK(_table);
             DCHECK(_table->shards);
             auto shard_id = _meta.get_shard_id(index);
             auto offset = _meta.get_shard_offset(index);
-            return _table.load()->shards[shard_id][offset];
+            return _owner->writable_shard(shard_id)[offset];
         }
 
+        // callback(begin, end)在[start_index, end_index)覆盖的每个shard上调用一次
+        // 只能用来读，写入请使用writable、fill_n、copy_n，否则版本快照会看到写入
         template<typename C>
-        void for_each(size_t start_index, size_t end_index, C&& callback) {
+        void for_each(size_t start_index, size_t end_index, C&& callback) const {
             DCHECK(_table);
-            DCHECK(_table->shards);
-
+            if (start_index >= end_index) {
+                return;
+            }
             auto start_shard_id = _meta.get_shard_id(start_index);
-            auto start_offset = _meta.get_shard_offset(start_index);
-            auto end_shard_id = _meta.get_shard_id(end_index);
-            auto end_offset = _meta.get_shard_offset(end_index);
-            T** shards = _table->shards;
-
-            //std::cout << "for_each -> " << start_index << "," << end_index << std::endl;
-
-            callback(shards[start_shard_id] + start_offset, shards[start_shard_id] + _meta.num_per_shard);
-
-            for (auto shard_id = start_shard_id + 1; shard_id != end_shard_id; ++shard_id) {
-                callback(shards[shard_id] + 0, shards[shard_id] + _meta.num_per_shard);
+            auto end_shard_id = _meta.get_shard_id(end_index - 1);
+            for (auto shard_id = start_shard_id; shard_id <= end_shard_id; ++shard_id) {
+                visit_shard<false>(shard_id, start_index, end_index, [&](size_t, T* begin, T* end) {
+                    callback(begin, end);
+                });
             }
+        }
 
-            if (start_shard_id < end_shard_id && end_offset > 0) {
-                callback(shards[end_shard_id] + 0, shards[end_shard_id] + end_offset);
+        template<typename C>
+        void for_each_writable(size_t start_index, size_t end_index, C&& callback) {
+            if (start_index >= end_index) {
+                return;
             }
+            auto start_shard_id = _meta.get_shard_id(start_index);
+            auto end_shard_id = _meta.get_shard_id(end_index - 1);
+            for (auto shard_id = start_shard_id; shard_id <= end_shard_id; ++shard_id) {
+                visit_shard<true>(shard_id, start_index, end_index, [&](size_t, T* begin, T* end) {
+                    callback(begin, end);
+                });
+            }
+        }
+
+        // shard之间并行执行，callback必须是线程安全的，threads<=0时使用OpenMP默认线程数
+        template<typename C>
+        void parallel_for_each(size_t start_index, size_t end_index, C&& callback, int threads = 0) const {
+            parallel_visit<false>(start_index, end_index, threads, [&](size_t, T* begin, T* end) {
+                callback(begin, end);
+            });
         }
+
         void fill_n(size_t start_index, size_t length, const T& value) {
             DCHECK(_table);
-            DCHECK(_table->shards);
+            bool non_temporal = length * sizeof(T) >= CONCURRENT_VECTOR_NT_THRESHOLD;
+            for_each_writable(start_index, start_index + length, [&](T* iter, T* end) {
+                detail::fill_range(iter, end, value, non_temporal);
+            });
+            detail::store_fence(non_temporal);
+        }
 
-            for_each(start_index, start_index + length, [&value](T* iter, T* end) {
-                std::fill(iter, end, value);
+        void parallel_fill_n(size_t start_index, size_t length, const T& value, int threads = 0) {
+            DCHECK(_table);
+            bool non_temporal = length * sizeof(T) >= CONCURRENT_VECTOR_NT_THRESHOLD;
+            parallel_visit<true>(start_index, start_index + length, threads, [&](size_t, T* begin, T* end) {
+                detail::fill_range(begin, end, value, non_temporal);
+                detail::store_fence(non_temporal);
             });
         }
 
         template<typename IT>
         void copy_n(IT iter, size_t length, size_t start_index) {
             DCHECK(_table);
-            DCHECK(_table->shards);
+            if constexpr (std::is_trivially_copyable_v<T> && detail::is_contiguous_iterator_v<IT, T>) {
+                const T* src = length > 0 ? &*iter : nullptr;
+                bool non_temporal = length * sizeof(T) >= CONCURRENT_VECTOR_NT_THRESHOLD;
+                for_each_writable(start_index, start_index + length, [&](T* begin, T* end) {
+                    detail::copy_range(src, begin, end, non_temporal);
+                    src += end - begin;
+                });
+                detail::store_fence(non_temporal);
+            } else {
+                for_each_writable(start_index, start_index + length, [&](T* begin, T* end) {
+                    size_t l = (end - begin);
+                    std::copy_n(iter, l, begin);
+                    iter += l;
+                });
+            }
+        }
 
-            for_each(start_index, start_index + length, [&](T* begin, T* end) {
-                size_t l = (end - begin);
-                std::copy_n(iter, l, begin);
-                iter += l;
+        // IT必须是随机访问迭代器
+        template<typename IT>
+        void parallel_copy_n(IT iter, size_t length, size_t start_index, int threads = 0) {
+            DCHECK(_table);
+            bool non_temporal = length * sizeof(T) >= CONCURRENT_VECTOR_NT_THRESHOLD;
+            parallel_visit<true>(start_index, start_index + length, threads, [&](size_t index, T* begin, T* end) {
+                auto src = iter + (index - start_index);
+                if constexpr (std::is_trivially_copyable_v<T> && detail::is_contiguous_iterator_v<IT, T>) {
+                    detail::copy_range(&*src, begin, end, non_temporal);
+                    detail::store_fence(non_temporal);
+                } else {
+                    std::copy_n(src, end - begin, begin);
+                }
             });
         }
+
+        // 通过for_each直接写入时，需要调用者标记[start_index, end_index)为dirty
+        void mark_dirty(size_t start_index, size_t end_index) {
+            auto* file = _owner->_file.get();
+            if (!file || start_index >= end_index) {
+                return;
+            }
+            auto end_shard_id = _meta.get_shard_id(end_index - 1);
+            for (auto shard_id = _meta.get_shard_id(start_index); shard_id <= end_shard_id; ++shard_id) {
+                file->mark_dirty(shard_id);
+            }
+        }
+    private:
+        // callback(index, begin, end)，index是begin对应的下标
+        template<bool WRITE, typename C>
+        void visit_shard(size_t shard_id, size_t start_index, size_t end_index, C&& callback) const {
+            size_t shard_begin = shard_id << _meta.shard_bit;
+            size_t lo = std::max(start_index, shard_begin) - shard_begin;
+            size_t hi = std::min(end_index, shard_begin + _meta.num_per_shard) - shard_begin;
+            T* shard = WRITE ? _owner->writable_shard(shard_id) : _table->shards[shard_id];
+            callback(shard_begin + lo, shard + lo, shard + hi);
+        }
+
+        template<bool WRITE, typename C>
+        void parallel_visit(size_t start_index, size_t end_index, int threads, C&& callback) const {
+            DCHECK(_table);
+            if (start_index >= end_index) {
+                return;
+            }
+            // 读者的EpochGuard由当前线程持有，worker线程只在parallel区域内访问table
+            int64_t start_shard_id = _meta.get_shard_id(start_index);
+            int64_t end_shard_id = _meta.get_shard_id(end_index - 1);
+            int num_threads = detail::resolve_threads(threads);
+            #pragma omp parallel for schedule(static) num_threads(num_threads)
+            for (int64_t shard_id = start_shard_id; shard_id <= end_shard_id; ++shard_id) {
+                visit_shard<WRITE>(shard_id, start_index, end_index, callback);
+            }
+        }
     private:
+        EpochGuard _guard;
         Table* _table = {nullptr};
         Meta _meta;
+        ConcurrentVector* _owner = {nullptr};
+    };
+
+    // 版本快照的数据，被所有VersionedSnapshot副本共享
+    struct VersionData {
+        std::atomic<int> refs = {1};
+        uint64_t version = {0};
+        std::vector<T*> shards;
+    };
+public:
+    /** Point-in-time read-only view.
+     *
+     *  创建时只复制shard指针，O(shards)；之后对live vector某个shard的第一次写入会先复制这个shard，
+     *  所以快照看到的数据不再变化。最后一个副本析构时释放只被这个版本引用的shard。
+     *  VersionedSnapshot不能比ConcurrentVector活得更久。
+     */
+    class VersionedSnapshot {
+    public:
+        VersionedSnapshot() = default;
+        VersionedSnapshot(ConcurrentVector* owner, VersionData* data) :
+                _owner(owner), _data(data), _meta(owner->_meta) {
+        }
+        VersionedSnapshot(const VersionedSnapshot& other) :
+                _owner(other._owner), _data(other._data), _meta(other._meta) {
+            if (_data) {
+                _data->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        VersionedSnapshot& operator=(const VersionedSnapshot& other) {
+            if (this != &other) {
+                reset();
+                _owner = other._owner;
+                _data = other._data;
+                _meta = other._meta;
+                if (_data) {
+                    _data->refs.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            return *this;
+        }
+        ~VersionedSnapshot() {
+            reset();
+        }
+        void reset() {
+            if (_data && _data->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                _owner->release_version(_data);
+            }
+            _data = nullptr;
+        }
+        bool valid() const {
+            return _data != nullptr;
+        }
+        uint64_t version() const {
+            return _data->version;
+        }
+        size_t capacity() const {
+            return _data->shards.size() * _meta.num_per_shard;
+        }
+        const T& operator[](size_t index) const {
+            DCHECK(_data);
+            return _data->shards[_meta.get_shard_id(index)][_meta.get_shard_offset(index)];
+        }
+        // callback(const T* begin, const T* end)
+        template<typename C>
+        void for_each(size_t start_index, size_t end_index, C&& callback) const {
+            if (start_index >= end_index) {
+                return;
+            }
+            auto end_shard_id = _meta.get_shard_id(end_index - 1);
+            for (auto shard_id = _meta.get_shard_id(start_index); shard_id <= end_shard_id; ++shard_id) {
+                size_t shard_begin = shard_id << _meta.shard_bit;
+                size_t lo = std::max(start_index, shard_begin) - shard_begin;
+                size_t hi = std::min(end_index, shard_begin + _meta.num_per_shard) - shard_begin;
+                const T* shard = _data->shards[shard_id];
+                callback(shard + lo, shard + hi);
+            }
+        }
+    private:
+        ConcurrentVector* _owner = {nullptr};
+        VersionData* _data = {nullptr};
+        Meta _meta;
     };
 public:
-    inline ConcurrentVector(size_t num_per_shard = 1024) noexcept;
+    inline ConcurrentVector(size_t num_per_shard = 1024,
+                EpochDomain& domain = get_default_epoch_domain()) noexcept;
     inline ~ConcurrentVector() noexcept;
     // 禁止拷贝和移动
     inline ConcurrentVector(ConcurrentVector&&) = delete;
@@ -234,25 +589,61 @@ public:
     inline ConcurrentVector& operator=(ConcurrentVector&&) = delete;
     inline ConcurrentVector& operator=(const ConcurrentVector&) = delete;
 
+    /** 只读，写入请使用writable/ensure，否则checkpoint和版本快照感知不到。
+     *  每次调用都进出一次读临界区(线程本地查找record、一次seq_cst fence)，
+     *  热点循环里请复用同一个Snapshot，或者在临界区内使用get_unguarded。
+     */
     const T& operator[](size_t index) const {
         return snapshot()[index];
     }
-
-    T& operator[](size_t index) {
-        return snapshot()[index];
+    // 调用者已经在_domain的读临界区内(持有EpochGuard/Snapshot，或者QSBR模式下online)，不再进入临界区
+    const T& get_unguarded(size_t index) const {
+        Table* table = _table.load(std::memory_order_acquire);
+        DCHECK(_meta.get_shard_id(index) < table->shard_num);
+        return table->shards[_meta.get_shard_id(index)][_meta.get_shard_offset(index)];
+    }
+    // index必须小于capacity，不扩容
+    T& writable(size_t index) {
+        return snapshot().writable(index);
     }
     void reserve(size_t size) {
         auto shard_num = _meta.require_shard_num(size);
+        EpochGuard guard(*_domain);
         ensure_table(shard_num);
     }
     T& ensure(size_t index) {
         auto shard_id = _meta.get_shard_id(index);
         auto offset = _meta.get_shard_offset(index);
-        return ensure_table(shard_id + 1)->shards[shard_id][offset];
+        EpochGuard guard(*_domain);
+        ensure_table(shard_id + 1);
+        return writable_shard(shard_id)[offset];
+    }
+
+    /** 创建copy-on-write的版本快照，文件持久化模式下不支持，返回invalid的快照。
+     *  会等待已经进入读临界区的线程离开，所以调用线程不能持有Snapshot/EpochGuard。
+     *  和版本快照并发的写入必须通过Snapshot进行：vector上的writable/ensure返回的T&
+     *  不在临界区保护之内，写入可能落在快照里，被复制过的旧shard也可能已经释放。
+     */
+    VersionedSnapshot versioned_snapshot();
+
+    /** 使用文件作为shard的存储，必须在第一次写入之前调用。
+     *  文件已存在时直接映射上次的数据，读者可以立即访问；
+     *  max_size为文件能容纳的最大元素个数，超过之后扩容(reserve/ensure/fill_n等)抛出std::bad_alloc。
+     *  成功返回0。
+     */
+    int attach_file(const std::string& path, size_t max_size);
+    /** 把上次checkpoint之后写过的shard刷到磁盘，返回flush的shard数，出错返回-1。
+     *  会等待已经进入读临界区的写者离开，调用线程不能持有Snapshot/EpochGuard。
+     *  通过Snapshot的写入都在临界区内，不会丢；vector上的writable/ensure返回的T&在临界区之外，
+     *  和checkpoint并发写入时，写完之后要调用mark_dirty。
+     */
+    int checkpoint();
+    void mark_dirty(size_t start_index, size_t end_index) {
+        snapshot().mark_dirty(start_index, end_index);
     }
 
     template<typename C>
-    void for_each(size_t start_index, size_t end_index, C&& callback) {
+    void for_each(size_t start_index, size_t end_index, C&& callback) const {
         snapshot().for_each(start_index, end_index, std::forward<C>(callback));
     }
 
@@ -264,60 +655,97 @@ public:
     void copy_n(IT iter, size_t length, size_t start_index) {
         reserved_snapshot(start_index+length).copy_n(iter, length, start_index);
     }
+
+    template<typename C>
+    void parallel_for_each(size_t start_index, size_t end_index, C&& callback, int threads = 0) const {
+        snapshot().parallel_for_each(start_index, end_index, std::forward<C>(callback), threads);
+    }
+
+    void parallel_fill_n(size_t start_index, size_t length, const T& value, int threads = 0) {
+        reserved_snapshot(start_index+length).parallel_fill_n(start_index, length, value, threads);
+    }
+
+    template<typename IT>
+    void parallel_copy_n(IT iter, size_t length, size_t start_index, int threads = 0) {
+        reserved_snapshot(start_index+length).parallel_copy_n(iter, length, start_index, threads);
+    }
     Snapshot snapshot() {
-        return Snapshot(_table.load(std::memory_order_acquire), _meta);
+        return Snapshot(this);
+    }
+    // 只读的Snapshot，不能调用writable、fill_n、copy_n等写接口
+    const Snapshot snapshot() const {
+        return Snapshot(const_cast<ConcurrentVector*>(this));
     }
     Snapshot reserved_snapshot(size_t size) {
-        Table* table = ensure_table(size);
-        return Snapshot(table, _meta);
+        EpochGuard guard(*_domain);
+        Table* table = ensure_table(_meta.require_shard_num(size));
+        return Snapshot(this, table);
     }
 private:
 
-    // 可能多个线程同时调用
+    // 可能多个线程同时调用，调用者必须在读临界区内
     Table* ensure_table(size_t shard_num) {
         auto* old_table = _table.load(std::memory_order_acquire);
         if (old_table->shard_num >= shard_num) {
             return old_table;
         }
-        size_t bytes = sizeof(Table) + shard_num * sizeof(T*);
-        size_t size = (bytes + CACHELINE_SIZE) & ~static_cast<size_t>(CACHELINE_SIZE-1);
-        auto* new_table = reinterpret_cast<Table*>(aligned_alloc(CACHELINE_SIZE, size));
-        new_table->shard_num = shard_num;
-        auto old_shard_num = old_table->shard_num;
-
-        while (true) {
-            // Copy Old Data
-            for (int i = 0; i < old_table->shard_num; ++i) {
-                new_table->shards[i] = old_table->shards[i];
+        // 新shard在锁外创建，[created_from, shard_num)是自己创建的
+        auto* new_table = ConcurrentVector::new_table(shard_num);
+        size_t created_from = old_table->shard_num;
+        for (size_t i = created_from; i < shard_num; ++i) {
+            try {
+                new_table->shards[i] = create_shard(i);
+            } catch (...) {
+                for (size_t k = created_from; k < i; ++k) {
+                    delete_shard(new_table->shards[k]);
+                }
+                delete_table(new_table);
+                throw;
             }
+        }
 
-            // Create New Storage
-            for (int i = old_shard_num; i < shard_num; ++i) {
-                new_table->shards[i] = create_shard();
-            }
-            if (_table.compare_exchange_strong(
-                                old_table, 
-                                new_table, 
-                                std::memory_order_release, 
-                                std::memory_order_acquire)) {
-                _retired_list.retire(old_table);
-                LOG(NOTICE) << "trace 1...";
-                return new_table;
-            } else {
-                // 被别的线程抢先一步扩容了，看看别人扩容后能否满足我的要求
-                for (int i = old_shard_num; i < shard_num; ++i) {
-                    delete_shard(new_table->shards[i]);
+        size_t old_shard_num = 0;
+        // 被别的线程扩容过的部分用别人的shard，自己创建的在锁外释放
+        std::vector<T*> stale_shards;
+        {
+            // 只在复制旧table和替换table时持有锁，和cow_shard互斥，否则可能漏掉正在被替换的shard
+            std::lock_guard<std::mutex> lock(_version_mutex);
+            old_table = _table.load(std::memory_order_acquire);
+            old_shard_num = old_table->shard_num;
+            if (old_shard_num < shard_num) {
+                // Copy Old Data，别的线程可能已经扩容过，以新的old_table为准
+                for (size_t i = 0; i < old_shard_num; ++i) {
+                    if (i >= created_from) {
+                        stale_shards.push_back(new_table->shards[i]);
+                    }
+                    new_table->shards[i] = old_table->shards[i];
+                    new_table->versions()[i].store(
+                            old_table->versions()[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
                 }
-                if (old_table->shard_num > shard_num) {
-                    LOG(NOTICE) << "trace 2...";
-                    delete_table(new_table);
-                    return old_table;
-                } else {
-                    // capacity is still not enough, retry...
-                    LOG(NOTICE) << "trace 3...";
+                uint64_t version = _version.load(std::memory_order_relaxed);
+                for (size_t i = old_shard_num; i < shard_num; ++i) {
+                    new_table->versions()[i].store(version, std::memory_order_relaxed);
+                }
+                _table.store(new_table, std::memory_order_release);
+                if (_file) {
+                    _file->set_shard_num(shard_num);
                 }
             }
         }
+        if (old_shard_num >= shard_num) {
+            // 被别的线程抢先一步扩容了，并且已经满足要求
+            for (size_t i = created_from; i < shard_num; ++i) {
+                delete_shard(new_table->shards[i]);
+            }
+            delete_table(new_table);
+            return old_table;
+        }
+        for (auto* shard : stale_shards) {
+            delete_shard(shard);
+        }
+        // 旧table上的shard已经被新table引用，只释放table本身
+        _domain->retire<Table, TableDeleter>(old_table);
+        return new_table;
     }
 
     static void delete_table(Table* table) {
@@ -326,10 +754,63 @@ private:
         }
     }
 
-    T* create_shard() {
+    static Table* new_table(size_t shard_num) {
+        size_t bytes = sizeof(Table) + shard_num * (sizeof(T*) + sizeof(uint64_t));
+        size_t size = (bytes + CACHELINE_SIZE) & ~static_cast<size_t>(CACHELINE_SIZE-1);
+        auto* table = reinterpret_cast<Table*>(aligned_alloc(CACHELINE_SIZE, size));
+        table->shard_num = shard_num;
+        return table;
+    }
+
+    // 调用者必须在读临界区内，写入前调用，返回当前table上可以原地写的shard
+    T* writable_shard(size_t shard_id) {
+        Table* table = _table.load(std::memory_order_acquire);
+        // 写入之前标记，checkpoint会等临界区里的写者写完再msync
+        if (_file) {
+            _file->mark_dirty(shard_id);
+        }
+        // cow_shard先替换shard再写版本号，看到新版本号就一定能看到新shard
+        if (likely(table->versions()[shard_id].load(std::memory_order_acquire) ==
+                    _version.load(std::memory_order_relaxed))) {
+            return __atomic_load_n(&table->shards[shard_id], __ATOMIC_RELAXED);
+        }
+        return cow_shard(shard_id);
+    }
+
+    T* cow_shard(size_t shard_id);
+    void release_version(VersionData* data);
+    T* clone_shard(const T* src);
+
+    // 版本释放后不再被引用的shard，等读者离开后再析构
+    struct RetiredShard {
+        ~RetiredShard() {
+            if constexpr (!std::is_trivial_v<T>) {
+                for (size_t k = 0; k < num_per_shard; ++k) {
+                    shard[k].~T();
+                }
+            }
+            free(shard);
+        }
+        T* shard;
+        size_t num_per_shard;
+    };
+
+    // 分配失败(文件模式下超过max_size或者ftruncate失败)时抛出std::bad_alloc
+    T* create_shard(size_t shard_id) {
+        if (_file) {
+            // 同一个shard_id总是得到文件中同一块内存，扩容失败的线程不需要释放
+            T* shard = reinterpret_cast<T*>(_file->create_shard(shard_id));
+            if (shard == nullptr) {
+                throw std::bad_alloc();
+            }
+            return shard;
+        }
         size_t bytes = _meta.num_per_shard * sizeof(T);
         size_t size = (bytes + CACHELINE_SIZE) & ~static_cast<size_t>(CACHELINE_SIZE-1);
         T* shard = reinterpret_cast<T*>(aligned_alloc(CACHELINE_SIZE, size));
+        if (shard == nullptr) {
+            throw std::bad_alloc();
+        }
         if constexpr (!std::is_trivial_v<T>) {
             for (int k = 0; k < _meta.num_per_shard; ++k) {
                 new (shard + k) T;
@@ -341,18 +822,29 @@ private:
     }
 
     void delete_shard(T* shard) {
+        if (_file) {
+            return;
+        }
         if constexpr (!std::is_trivial_v<T>) {
             for (int k = 0; k < _meta.num_per_shard; ++k) {
                 shard[k].~T();
             } 
         } 
+        free(shard);
     }
 
 private:
     static constexpr Table EMPTY_TABLE = {};
-    RetireList<Table, TableDeleter> _retired_list;
+    EpochDomain* _domain = {nullptr};
     std::atomic<Table*> _table = {nullptr};
     Meta _meta;
+    std::unique_ptr<ShardFile> _file;
+    // 每次创建版本快照加1
+    std::atomic<uint64_t> _version = {0};
+    // 保护_shard_refs，以及复制shard时对table的修改
+    std::mutex _version_mutex;
+    // 被版本快照引用的shard -> 引用它的版本数
+    std::unordered_map<const T*, int> _shard_refs;
 };
 
 } // namespace
@@ -6,13 +6,130 @@
 namespace rcu {
 
 template <typename T>
-inline ConcurrentVector<T>::ConcurrentVector(size_t num_per_shard) noexcept
+inline ConcurrentVector<T>::ConcurrentVector(size_t num_per_shard, EpochDomain& domain) noexcept
+        : _domain(&domain)
 {
     _meta.num_per_shard = folly::nextPowTwo(num_per_shard);
     _meta.shard_bit =  __builtin_popcount(_meta.num_per_shard - 1) ;
     _table.store(const_cast<Table*>(&EMPTY_TABLE), std::memory_order_relaxed);
 }
 
+template <typename T>
+inline int ConcurrentVector<T>::attach_file(const std::string& path, size_t max_size) {
+    static_assert(std::is_trivially_copyable_v<T>, "file backed ConcurrentVector requires trivially copyable T");
+    if (_file || _table.load(std::memory_order_acquire)->shard_num > 0) {
+        LOG(WARNING) << "attach_file must be called on an empty ConcurrentVector, path:" << path;
+        return -1;
+    }
+    std::unique_ptr<ShardFile> file(new ShardFile);
+    if (file->open(path, sizeof(T), _meta.num_per_shard, _meta.require_shard_num(max_size)) != 0) {
+        return -1;
+    }
+    _file = std::move(file);
+    // 上次的shard直接指向文件中的数据
+    size_t shard_num = _file->shard_num();
+    if (shard_num > 0) {
+        Table* table = new_table(shard_num);
+        // 版本号等于当前版本，第一次写入不用进cow_shard
+        uint64_t version = _version.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < shard_num; ++i) {
+            table->shards[i] = reinterpret_cast<T*>(_file->get_shard(i));
+            table->versions()[i].store(version, std::memory_order_relaxed);
+        }
+        Table* old_table = _table.exchange(table, std::memory_order_acq_rel);
+        delete_table(old_table);
+    }
+    return 0;
+}
+
+template <typename T>
+inline int ConcurrentVector<T>::checkpoint() {
+    if (!_file) {
+        return 0;
+    }
+    return _file->checkpoint([this] { _domain->synchronize(); });
+}
+
+template <typename T>
+inline typename ConcurrentVector<T>::VersionedSnapshot ConcurrentVector<T>::versioned_snapshot() {
+    if (_file) {
+        LOG(WARNING) << "versioned_snapshot is not supported on file backed ConcurrentVector";
+        return VersionedSnapshot();
+    }
+    auto* data = new VersionData;
+    {
+        // 持有锁期间table不会被替换
+        std::lock_guard<std::mutex> lock(_version_mutex);
+        Table* table = _table.load(std::memory_order_acquire);
+        data->shards.assign(table->shards, table->shards + table->shard_num);
+        for (auto* shard : data->shards) {
+            _shard_refs[shard]++;
+        }
+        // 之后对每个shard的第一次写入都会走cow_shard
+        data->version = _version.fetch_add(1, std::memory_order_acq_rel);
+    }
+    // 等待通过Snapshot拿到旧shard、正在写入的线程离开临界区，之后快照不再变化
+    _domain->synchronize();
+    return VersionedSnapshot(this, data);
+}
+
+template <typename T>
+inline T* ConcurrentVector<T>::cow_shard(size_t shard_id) {
+    std::lock_guard<std::mutex> lock(_version_mutex);
+    // 持有锁期间table不会被替换
+    Table* table = _table.load(std::memory_order_acquire);
+    uint64_t version = _version.load(std::memory_order_relaxed);
+    T* shard = table->shards[shard_id];
+    if (table->versions()[shard_id].load(std::memory_order_relaxed) == version) {
+        // 别的线程已经复制过了
+        return shard;
+    }
+    if (_shard_refs.count(shard) > 0) {
+        shard = clone_shard(shard);
+        __atomic_store_n(&table->shards[shard_id], shard, __ATOMIC_RELEASE);
+    }
+    table->versions()[shard_id].store(version, std::memory_order_release);
+    return shard;
+}
+
+template <typename T>
+inline T* ConcurrentVector<T>::clone_shard(const T* src) {
+    size_t bytes = _meta.num_per_shard * sizeof(T);
+    size_t size = (bytes + CACHELINE_SIZE) & ~static_cast<size_t>(CACHELINE_SIZE-1);
+    T* shard = reinterpret_cast<T*>(aligned_alloc(CACHELINE_SIZE, size));
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        memcpy(shard, src, bytes);
+    } else {
+        for (size_t k = 0; k < _meta.num_per_shard; ++k) {
+            new (shard + k) T(src[k]);
+        }
+    }
+    return shard;
+}
+
+template <typename T>
+inline void ConcurrentVector<T>::release_version(VersionData* data) {
+    {
+        std::lock_guard<std::mutex> lock(_version_mutex);
+        Table* table = _table.load(std::memory_order_acquire);
+        for (size_t i = 0; i < data->shards.size(); ++i) {
+            T* shard = data->shards[i];
+            auto iter = _shard_refs.find(shard);
+            DCHECK(iter != _shard_refs.end());
+            if (--iter->second > 0) {
+                continue;
+            }
+            _shard_refs.erase(iter);
+            // 还挂在live table上的shard继续使用，否则已经被复制过，释放旧的
+            if (table->shards[i] != shard) {
+                // 创建Snapshot时拿到的旧table上可能还有这个shard
+                _domain->retire(new RetiredShard{shard, _meta.num_per_shard});
+            }
+        }
+    }
+    delete data;
+}
+
 template <typename T>
 inline ConcurrentVector<T>::~ConcurrentVector() noexcept
 {
@@ -22,7 +139,9 @@ inline ConcurrentVector<T>::~ConcurrentVector() noexcept
         delete_shard(shard);
     }
     delete_table(table);
-    _retired_list.force_gc();
+    // 之前retire的旧table由domain在读者都离开之后释放
+    // VersionedSnapshot不能比vector活得更久，这里不处理_shard_refs
+    DCHECK(_shard_refs.empty());
 }
 
 
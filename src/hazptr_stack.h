@@ -1,22 +1,50 @@
 #pragma once
 
+// TODO
+// 1 pop用hazptr保护栈顶，retire之后再回收 done
+// 2 侵入式node，从ThreadSlabAllocator分配，不再每个元素一个shared_ptr done
+// 3 pop_all一次exchange摘下整个栈 done
+// 4 node挂在栈自己的cohort上回收，默认domain的阈值太小，每几次pop就有一次heavy fence done
+
 #include <atomic>
 #include <memory>
-#include <assert.h> 
-#include <iostream> 
+#include <utility>
+#include <assert.h>
+#include <iostream>
 #include "base/comlog_sink.h"
+#include "concurrent/hazptr.h"
+#include "concurrent/thread_slab_allocator.h"
 
 namespace rcu {
 
-template<typename T>
+/** Treiber栈，pop的读者用hazptr保护栈顶。
+ *
+ *  栈顶被保护之后不会被回收，也就不会被重新分配后再压回栈顶，CAS没有ABA问题，不需要带版本号的指针。
+ *  pop成功的线程独占这个node，value移出来之后retire，别的线程可能还在读它的next。
+ *  node是侵入式的，默认从线程本地的slab free list分配，回收时还给Allocator。
+ *  retire的node挂在栈自己的cohort上，攒够HAZPTR_COHORT_THRESHOLD个才扫描一次，栈析构时全部回收。
+ */
+template<typename T, typename Allocator = ThreadSlabAllocator<uint8_t>>
 class HazptrStack {
 private:
-    struct Node {
-        std::shared_ptr<T> data;
-        Node* next;
-        Node(T const& data_):
-            data(std::make_shared<T>(data_))
-        {}
+    struct Node : public HazptrNode<Node> {
+        template <typename... Args>
+        explicit Node(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+        static Node* create(T&& value) {
+            return new (Allocator().allocate(sizeof(Node))) Node(std::move(value));
+        }
+        static void destroy(Node* node) {
+            node->~Node();
+            Allocator().deallocate(reinterpret_cast<uint8_t*>(node), sizeof(Node));
+        }
+        void reclaim() override {
+            destroy(this);
+        }
+
+        T value;
+        // 入栈之前写好，之后不再修改
+        Node* next = {nullptr};
     };
 public:
     HazptrStack(HazptrStack const&) = delete;             // Copy construct
@@ -24,27 +52,75 @@ public:
     HazptrStack& operator=(HazptrStack const&) = delete;  // Copy assign
     HazptrStack& operator=(HazptrStack &&) = delete;      // Move assign
 
-    HazptrStack() {
+    // 读者的保护和node的回收都在manager这个domain里
+    explicit HazptrStack(HazptrManager& manager = get_default_manager()) : _cohort(manager) {
     }
 
+    // 调用者保证析构时没有并发的push和pop，已经retire的node由_cohort析构时回收
     ~HazptrStack() {
+        Node* node = _head.load(std::memory_order_acquire);
+        while (node) {
+            Node* next = node->next;
+            Node::destroy(node);
+            node = next;
+        }
+    }
+
+    void push(T const& value) {
+        push(T(value));
+    }
+
+    void push(T&& value) {
+        Node* node = Node::create(std::move(value));
+        node->set_cohort(&_cohort);
+        node->next = _head.load(std::memory_order_relaxed);
+        while (!_head.compare_exchange_weak(node->next, node,
+                    std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    // 栈为空时返回false
+    bool pop(T& value) {
+        HazptrHolder holder(_cohort.manager());
+        while (true) {
+            // 保护之后head不会被回收，读next是安全的
+            Node* head = holder.get_protected(_head);
+            if (head == nullptr) {
+                return false;
+            }
+            if (_head.compare_exchange_weak(head, head->next,
+                        std::memory_order_acquire, std::memory_order_relaxed)) {
+                value = std::move(head->value);
+                holder.reset();
+                head->retire();
+                return true;
+            }
+        }
     }
 
-    void push(T const& data) {
-        Node* node = new Node(data);
-        node->next = _head.load();
-        while(!_head.compare_exchange_weak(node->next, node, std::memory_order_seq_cst));
+    /** 一次exchange摘下整个栈，按出栈的顺序对每个元素调用fn(T&&)，返回元素个数。
+     *  摘下之前别的线程可能已经保护了栈顶，所以node同样retire，不直接释放。
+     */
+    template <typename Fn>
+    size_t pop_all(Fn&& fn) {
+        Node* node = _head.exchange(nullptr, std::memory_order_acquire);
+        size_t count = 0;
+        while (node) {
+            Node* next = node->next;
+            fn(std::move(node->value));
+            node->retire();
+            node = next;
+            count++;
+        }
+        return count;
     }
 
-    std::shared_ptr<T> pop() {
-        Node* old_head = _head.load();
-        while (old_head && !_head.compare_exchange_weak(old_head, old_head->next, std::memory_order_seq_cst));
-        auto p_data = old_head ? old_head->data : std::shared_ptr<T>();
-        delete old_head;
-        return p_data;
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == nullptr;
     }
 
 private:
+    HazptrCohort _cohort;
     std::atomic<Node*> _head = {nullptr};
 };
 
@@ -32,13 +32,60 @@ public:
     LockFreeStack& operator=(LockFreeStack &&) = delete;      // Move assign
 
     LockFreeStack() {
+        head.store(CountedNodePtr{0, nullptr});
     }
 
+    ~LockFreeStack() {
+        while (pop()) {
+        }
+    }
+
+    void push(T const& data) {
+        CountedNodePtr new_node;
+        new_node.ptr = new Node(data);
+        new_node.external_count = 1;
+        new_node.ptr->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(new_node.ptr->next, new_node,
+                    std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    // 外部计数加1之后才能解引用head指向的node
     void increase_head_count(CountedNodePtr& old_head) {
         CountedNodePtr new_head;
         do {
             new_head = old_head;
-   e:
+            ++new_head.external_count;
+        } while (!head.compare_exchange_strong(old_head, new_head,
+                    std::memory_order_acquire, std::memory_order_relaxed));
+        old_head.external_count = new_head.external_count;
+    }
+
+    std::shared_ptr<T> pop() {
+        CountedNodePtr old_head = head.load(std::memory_order_relaxed);
+        while (true) {
+            increase_head_count(old_head);
+            Node* const ptr = old_head.ptr;
+            if (!ptr) {
+                return std::shared_ptr<T>();
+            }
+            if (head.compare_exchange_strong(old_head, ptr->next, std::memory_order_relaxed)) {
+                std::shared_ptr<T> res;
+                res.swap(ptr->data);
+                // 减去链表本身的1个和自己的1个，剩下的是还在访问这个node的线程
+                int const count_increase = old_head.external_count - 2;
+                if (ptr->internal_count.fetch_add(count_increase, std::memory_order_release) == -count_increase) {
+                    delete ptr;
+                }
+                return res;
+            } else if (ptr->internal_count.fetch_add(-1, std::memory_order_relaxed) == 1) {
+                // 最后一个访问者负责释放
+                ptr->internal_count.load(std::memory_order_acquire);
+                delete ptr;
+            }
+        }
+    }
+private:
     std::atomic<CountedNodePtr> head;
 };
 
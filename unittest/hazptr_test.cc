@@ -4,8 +4,6 @@
 #include <chrono>
 #include <random>
 
-#define USE_THREAD_LOCAL_CACHE false
-
 #define private public
 #define protected public
 #include "hazptr_stack.h"
@@ -116,7 +114,7 @@ TEST_F(HazptrTest, append) {
     priv.push(node2);
 
     manager.append(priv.priv_list.head, priv.priv_list.tail, priv.priv_list.count);
-    int cnt = print_obj_list("_retired_list", manager._retired_list.load());
+    int cnt = print_obj_list("_retired_list", manager.local_shard().list.load());
     ASSERT_EQ(cnt, 2);
  
     priv.reset();
@@ -126,7 +124,7 @@ TEST_F(HazptrTest, append) {
     priv.push(node4);
 
     manager.append(priv.priv_list.head, priv.priv_list.tail, priv.priv_list.count);
-    cnt = print_obj_list("_retired_list", manager._retired_list.load());
+    cnt = print_obj_list("_retired_list", manager.local_shard().list.load());
     ASSERT_EQ(cnt, 4);
 }
 
@@ -250,7 +248,7 @@ TEST_F(HazptrTest, try_protect) {
         ASSERT_EQ(priv.priv_list.count,  i+1);
         print_rec_list("hazptr_list", manager._hazptr_list.load());
         print_obj_list("private retired_list", priv.priv_list.head);
-        print_obj_list("global retired_list", manager._retired_list.load());
+        print_obj_list("global retired_list", manager.local_shard().list.load());
         if (!USE_THREAD_LOCAL_CACHE) {
             ASSERT_EQ(count_active(manager._hazptr_list.load()), 2);
         }
@@ -275,9 +273,9 @@ TEST_F(HazptrTest, try_protect) {
         std::cout << "retire object -> " << node << std::endl;
         node->retire();
         print_rec_list("hazptr_list", manager._hazptr_list.load());
-        int rcount = print_obj_list("global retired_list", manager._retired_list.load());
+        int rcount = print_obj_list("global retired_list", manager.local_shard().list.load());
         LOG(NOTICE) << "priv.priv_list.count:" << priv.priv_list.count;
-        ASSERT_TRUE(manager._retired_count == rcount);
+        ASSERT_TRUE(manager.retired_count() == rcount);
     }
 }
 
@@ -365,6 +363,457 @@ TEST_F(HazptrTest, case_queue) {
     */
 }
 
+TEST_F(HazptrTest, asymmetric_fence) {
+    struct CheckedNode : public rcu::HazptrNode<CheckedNode> {
+        ~CheckedNode() {
+            alive = 0;
+        }
+        std::atomic<int> alive = {1};
+    };
+    // heavy fence在membarrier/mprotect下都要能正常返回
+    std::cout << "heavy fence type:" << static_cast<int>(rcu::heavy_fence_type()) << std::endl;
+    rcu::asymmetric_thread_fence_heavy();
+
+    std::atomic<CheckedNode*> src = {new CheckedNode};
+    std::atomic<bool> stop = {false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            rcu::HazptrHolder holder;
+            while (!stop.load()) {
+                // 读者只有编译器屏障，保护住的对象不能被回收
+                CheckedNode* node = holder.get_protected(src);
+                ASSERT_EQ(node->alive.load(std::memory_order_relaxed), 1);
+                holder.reset();
+            }
+        });
+    }
+    for (int i = 0; i < 20000; ++i) {
+        CheckedNode* old = src.exchange(new CheckedNode);
+        old->retire();
+    }
+    stop.store(true);
+    for (auto& th : readers) {
+        th.join();
+    }
+    src.load()->retire();
+}
+
+TEST_F(HazptrTest, nested_reclaim) {
+    auto& manager = rcu::get_default_manager();
+    static std::atomic<int> freed = {0};
+    // 析构时retire子节点，回收过程中嵌套触发bulkReclaim
+    struct ChainNode : public rcu::HazptrNode<ChainNode> {
+        ~ChainNode() {
+            freed++;
+            if (child) {
+                child->retire();
+                rcu::HazptrPrivate::instance().pushAlltoDomain();
+            }
+        }
+        ChainNode* child = {nullptr};
+    };
+    ChainNode* protected_node = new ChainNode;
+    rcu::HazptrHolder holder;
+    holder.reset(protected_node);
+    for (int i = 0; i < 100; ++i) {
+        ChainNode* node = new ChainNode;
+        node->child = new ChainNode;
+        node->retire();
+    }
+    protected_node->retire();
+    rcu::HazptrPrivate::instance().pushAlltoDomain();
+    manager.bulkReclaim();
+    // 最后几个子节点retire时可能没到阈值，留在全局链表里
+    manager.bulkReclaim();
+    ASSERT_EQ(freed.load(), 200);
+    holder.reset();
+    manager.bulkReclaim();
+    ASSERT_EQ(freed.load(), 201);
+}
+
+TEST_F(HazptrTest, thread_exit_handoff) {
+    auto& manager = rcu::get_default_manager();
+    auto run_thread = [] {
+        std::thread t([] {
+            {
+                rcu::HazptrArray<4> holders;
+                MyNode* node = new MyNode;
+                std::atomic<MyNode*> src = {node};
+                ASSERT_EQ(holders[0].get_protected(src), node);
+                holders[0].reset();
+                delete node;
+            }
+            // holder析构时record放进线程缓存，而不是直接还给全局链表
+            auto& pool = rcu::HazptrPrivate::instance().pool;
+            ASSERT_EQ(pool._available_cnt, 4);
+            for (int i = 0; i < pool._available_cnt; ++i) {
+                ASSERT_TRUE(pool._record_cache[i]->active.load());
+            }
+        });
+        t.join();
+    };
+    run_thread();
+    int before = manager._hazptr_count.load();
+    // 线程退出时缓存的record交还给全局链表，后面的线程可以重用，record总数不再增长
+    for (int i = 0; i < 10; ++i) {
+        run_thread();
+    }
+    ASSERT_EQ(manager._hazptr_count.load(), before);
+}
+
+TEST_F(HazptrTest, hazptr_array) {
+    auto& manager = rcu::get_default_manager();
+    int before = manager._hazptr_count.load();
+    MyNode* nodes[3] = {new MyNode, new MyNode, new MyNode};
+    {
+        rcu::HazptrArray<3> holders;
+        int after = manager._hazptr_count.load();
+        ASSERT_LE(after - before, 3);
+        for (int i = 0; i < 3; ++i) {
+            holders[i].reset(nodes[i]);
+        }
+        // 多跳遍历时交换holder，保护的指针跟着record走
+        holders[1].swap(holders[2]);
+        for (int i = 0; i < 3; ++i) {
+            nodes[i]->retire();
+        }
+        rcu::HazptrPrivate::instance().pushAlltoDomain();
+        manager.bulkReclaim();
+        // 三个节点都还被保护
+        int protected_cnt = 0;
+        for (auto* p = manager.local_shard().list.load(); p != nullptr; p = p->next) {
+            for (auto* node : nodes) {
+                protected_cnt += (p == node);
+            }
+        }
+        ASSERT_EQ(protected_cnt, 3);
+        // 构造之后不再申请record
+        ASSERT_EQ(manager._hazptr_count.load(), after);
+    }
+    manager.bulkReclaim();
+    for (auto* p = manager.local_shard().list.load(); p != nullptr; p = p->next) {
+        for (auto* node : nodes) {
+            ASSERT_NE(p, node);
+        }
+    }
+}
+
+struct CountedNode : public rcu::HazptrNode<CountedNode> {
+    ~CountedNode() {
+        freed++;
+    }
+    static std::atomic<int> freed;
+};
+std::atomic<int> CountedNode::freed = {0};
+
+TEST_F(HazptrTest, executor) {
+    auto& manager = rcu::get_default_manager();
+    manager.bulkReclaim();
+    CountedNode::freed = 0;
+    std::vector<std::function<void()>> tasks;
+    manager.set_executor([&](std::function<void()> task) {
+        tasks.push_back(std::move(task));
+    });
+    for (int i = 0; i < 1000; ++i) {
+        (new CountedNode)->retire();
+    }
+    rcu::HazptrPrivate::instance().pushAlltoDomain();
+    // retire的线程不回收，投递的任务没执行之前只投递一次
+    ASSERT_EQ(CountedNode::freed.load(), 0);
+    ASSERT_EQ(tasks.size(), 1);
+    tasks[0]();
+    ASSERT_EQ(CountedNode::freed.load(), 1000);
+    manager.set_executor(nullptr);
+}
+
+TEST_F(HazptrTest, background_reclaimer) {
+    auto& manager = rcu::get_default_manager();
+    manager.bulkReclaim();
+    CountedNode::freed = 0;
+    manager.start_reclaimer(10);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 1000; ++i) {
+                (new CountedNode)->retire();
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    // 线程退出时剩下的也交给了全局链表，定时扫描会回收掉
+    for (int i = 0; i < 100 && CountedNode::freed.load() < 4000; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(CountedNode::freed.load(), 4000);
+    manager.stop_reclaimer();
+    // 停止之后恢复同步回收
+    for (int i = 0; i < 1000; ++i) {
+        (new CountedNode)->retire();
+    }
+    rcu::HazptrPrivate::instance().pushAlltoDomain();
+    // 不到阈值的最后几个还留在链表里
+    ASSERT_GT(CountedNode::freed.load(), 4000);
+    manager.bulkReclaim();
+    ASSERT_EQ(CountedNode::freed.load(), 5000);
+}
+
+// 析构时释放next，模拟hashmap的node链
+struct ChainedNode : public rcu::HazptrNode<ChainedNode> {
+    ~ChainedNode() {
+        freed++;
+        if (next_node) {
+            next_node->retire();
+        }
+    }
+    ChainedNode* next_node = {nullptr};
+    static std::atomic<int> freed;
+};
+std::atomic<int> ChainedNode::freed = {0};
+
+TEST_F(HazptrTest, cohort) {
+    auto& manager = rcu::get_default_manager();
+    manager.bulkReclaim();
+    int global_before = manager.retired_count();
+    ChainedNode::freed = 0;
+    {
+        rcu::HazptrCohort cohort;
+        for (int i = 0; i < 10000; ++i) {
+            auto* node = new ChainedNode;
+            node->set_cohort(&cohort);
+            node->retire();
+        }
+        rcu::HazptrPrivate::instance().pushAlltoDomain();
+        // 不进全局链表，达到阈值时cohort自己回收
+        ASSERT_EQ(manager.retired_count(), global_before);
+        ASSERT_GT(ChainedNode::freed.load(), 0);
+        ASSERT_LT(cohort.retired_count(), 10000);
+    }
+    ASSERT_EQ(ChainedNode::freed.load(), 10000);
+}
+
+TEST_F(HazptrTest, cohort_teardown) {
+    auto& manager = rcu::get_default_manager();
+    manager.bulkReclaim();
+    int global_before = manager.retired_count();
+    ChainedNode::freed = 0;
+    rcu::HazptrHolder holder;
+    ChainedNode* protected_node = nullptr;
+    {
+        rcu::HazptrCohort cohort;
+        // 10条长度为1000的链，只retire链头，析构时级联retire剩下的node
+        for (int c = 0; c < 10; ++c) {
+            ChainedNode* head = nullptr;
+            for (int i = 0; i < 1000; ++i) {
+                auto* node = new ChainedNode;
+                node->set_cohort(&cohort);
+                node->next_node = head;
+                head = node;
+            }
+            if (c == 0) {
+                // 链尾，回收时不会再级联retire
+                protected_node = head;
+                while (protected_node->next_node) {
+                    protected_node = protected_node->next_node;
+                }
+                holder.reset(protected_node);
+            }
+            head->retire();
+        }
+    }
+    // 析构不等读者，还被保护的对象交给domain
+    ASSERT_EQ(ChainedNode::freed.load(), 9999);
+    ASSERT_EQ(protected_node->_cohort, nullptr);
+    ASSERT_EQ(manager.retired_count(), global_before + 1);
+    holder.reset();
+    manager.bulkReclaim();
+    ASSERT_EQ(ChainedNode::freed.load(), 10000);
+}
+
+TEST_F(HazptrTest, domains) {
+    auto& global = rcu::get_default_manager();
+    int global_records = global._hazptr_count.load();
+    int global_retired = global.retired_count();
+    rcu::HazptrDomainOptions options;
+    options.scan_threshold = 100;
+    options.scan_mult = 1;
+    rcu::HazptrManager domain(options);
+    CountedNode::freed = 0;
+    CountedNode* protected_node = new CountedNode;
+    {
+        rcu::HazptrHolder holder(domain);
+        rcu::HazptrArray<2> holders(domain);
+        holder.reset(protected_node);
+        // record只挂在domain自己的链表上
+        ASSERT_EQ(domain._hazptr_count.load(), 3);
+        ASSERT_EQ(global._hazptr_count.load(), global_records);
+        // 按domain自己的阈值回收，不经过线程私有链表
+        protected_node->retire(domain);
+        for (int i = 0; i < 98; ++i) {
+            (new CountedNode)->retire(domain);
+        }
+        ASSERT_EQ(domain.retired_count(), 99);
+        ASSERT_EQ(CountedNode::freed.load(), 0);
+        (new CountedNode)->retire(domain);
+        ASSERT_EQ(CountedNode::freed.load(), 99);
+        ASSERT_EQ(domain.retired_count(), 1);
+        ASSERT_EQ(global.retired_count(), global_retired);
+
+        // 在默认domain里保护的指针，domain回收时看不到
+        rcu::HazptrHolder other;
+        other.reset(protected_node);
+        holder.reset();
+        domain.bulkReclaim();
+        ASSERT_EQ(CountedNode::freed.load(), 100);
+    }
+    // 换domain时record还给原来的domain
+    int value = 0;
+    rcu::HazptrHolder holder;
+    holder.reset(&value);
+    holder.set_manager(domain);
+    ASSERT_EQ(&holder.manager(), &domain);
+    ASSERT_EQ(holder._rec, nullptr);
+}
+
+TEST_F(HazptrTest, hazptr_stack) {
+    rcu::HazptrStack<std::string> stack;
+    std::string value;
+    ASSERT_FALSE(stack.pop(value));
+    for (int i = 0; i < 10; ++i) {
+        stack.push(std::to_string(i));
+    }
+    ASSERT_TRUE(stack.pop(value));
+    ASSERT_EQ(value, "9");
+    // pop_all按出栈顺序
+    std::vector<std::string> values;
+    ASSERT_EQ(stack.pop_all([&](std::string&& v) { values.push_back(std::move(v)); }), 9);
+    ASSERT_EQ(values.front(), "8");
+    ASSERT_EQ(values.back(), "0");
+    ASSERT_TRUE(stack.empty());
+    ASSERT_EQ(stack.pop_all([](std::string&&) {}), 0);
+    // 析构时释放还在栈里的node
+    stack.push("left");
+}
+
+TEST_F(HazptrTest, hazptr_stack_multi_thread) {
+    rcu::HazptrStack<int64_t> stack;
+    std::atomic<int64_t> popped_sum = {0};
+    std::atomic<int64_t> popped_cnt = {0};
+    std::vector<std::thread> threads;
+    const int n = 100000;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            int64_t sum = 0;
+            int64_t cnt = 0;
+            int64_t value = 0;
+            for (int i = 0; i < n; ++i) {
+                stack.push(t * n + i);
+                if (i % 64 == 63) {
+                    stack.pop_all([&](int64_t&& v) {
+                        sum += v;
+                        cnt++;
+                    });
+                } else if (stack.pop(value)) {
+                    sum += value;
+                    cnt++;
+                }
+            }
+            popped_sum += sum;
+            popped_cnt += cnt;
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    int64_t value = 0;
+    while (stack.pop(value)) {
+        popped_sum += value;
+        popped_cnt++;
+    }
+    // 每个元素恰好出栈一次
+    ASSERT_EQ(popped_cnt.load(), 4 * n);
+    ASSERT_EQ(popped_sum.load(), int64_t(4 * n) * (4 * n - 1) / 2);
+}
+
+TEST_F(HazptrTest, stats) {
+    rcu::HazptrDomainOptions options;
+    options.scan_threshold = 100;
+    options.scan_mult = 1;
+    rcu::HazptrManager domain(options);
+    CountedNode::freed = 0;
+    CountedNode* protected_node = new CountedNode;
+    rcu::HazptrHolder holder(domain);
+    holder.reset(protected_node);
+    protected_node->retire(domain);
+    for (int i = 0; i < 9; ++i) {
+        (new CountedNode)->retire(domain);
+    }
+    auto stats = domain.stats();
+    ASSERT_EQ(stats.records, 1);
+    ASSERT_EQ(stats.records_active, 1);
+    ASSERT_EQ(stats.records_protecting, 1);
+    ASSERT_EQ(stats.retired_pending, 10);
+    ASSERT_EQ(stats.scans, 0);
+
+    domain.bulkReclaim();
+    stats = domain.stats();
+    ASSERT_EQ(stats.scans, 1);
+    ASSERT_EQ(stats.reclaimed, 9);
+    ASSERT_EQ(stats.last_scan_reclaimed, 9);
+    ASSERT_GT(stats.last_scan_ns, 0);
+    ASSERT_GE(stats.max_scan_ns, stats.last_scan_ns);
+    ASSERT_EQ(stats.retired_pending, 1);
+    // 被保护的对象挂回去之后还是原来的时间戳
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    domain.bulkReclaim();
+    stats = domain.stats();
+    ASSERT_EQ(stats.retired_pending, 1);
+    ASSERT_GE(stats.oldest_retired_ms, 20);
+
+    // cohort里的对象也算在domain里
+    {
+        rcu::HazptrCohort cohort(domain);
+        for (int i = 0; i < 5; ++i) {
+            auto* node = new CountedNode;
+            node->set_cohort(&cohort);
+            node->retire();
+        }
+        ASSERT_EQ(domain.stats().retired_pending, 6);
+    }
+    stats = domain.stats();
+    ASSERT_EQ(stats.retired_pending, 1);
+    ASSERT_EQ(stats.reclaimed, 14);
+
+    holder.reset();
+    domain.bulkReclaim();
+    stats = domain.stats();
+    ASSERT_EQ(stats.retired_pending, 0);
+    ASSERT_EQ(stats.oldest_retired_ms, 0);
+    ASSERT_EQ(stats.records_protecting, 0);
+    ASSERT_EQ(CountedNode::freed.load(), 15);
+}
+
+TEST_F(HazptrTest, pin_report) {
+    rcu::HazptrDomainOptions options;
+    options.pin_report_seconds = 1;
+    rcu::HazptrManager domain(options);
+    int value = 0;
+    int other = 0;
+    rcu::HazptrHolder holder(domain);
+    holder.reset(&value);
+    // 第一次看到开始计时
+    ASSERT_EQ(domain.stats().records_pinned, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    ASSERT_EQ(domain.stats().records_pinned, 1);
+    ASSERT_TRUE(holder._rec->pin_reported.load());
+    // 换了指针重新计时
+    holder.reset(&other);
+    ASSERT_EQ(domain.stats().records_pinned, 0);
+    ASSERT_FALSE(holder._rec->pin_reported.load());
+}
+
 int main(int argc, char* argv[]) {
     testing::InitGoogleTest(&argc, argv);
     google::ParseCommandLineFlags(&argc, &argv, false);
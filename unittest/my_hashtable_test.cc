@@ -3,6 +3,7 @@
 #include <thread>
 #include <chrono>
 #include <random>
+#include <map>
 #include <set>
 
 #include <assert.h>
@@ -340,3 +341,720 @@ TEST_F(ConcurrentHashMapTest, multi_thread) {
     }
 }
 
+
+TEST_F(ConcurrentHashMapTest, swiss_insert_find_erase) {
+    using HashMap = rcu::SwissConcurrentHashMap<std::string, std::string, std::hash<std::string>, std::allocator<uint8_t>, 2>;
+    HashMap hs;
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    for (int i = 0; i < 1000; ++i) {
+        keys.emplace_back("key_" + std::to_string(i+1));
+        values.emplace_back("value_" + std::to_string(i+1));
+    }
+    for (int i = 0; i < keys.size(); ++i) {
+        if (i % 2 == 0) {
+            hs.insert(keys[i], values[i]);
+        } else {
+            hs.emplace(keys[i], values[i]);
+        }
+    }
+    ASSERT_EQ(hs.size(), keys.size());
+    for (int i = 0; i < keys.size(); ++i) {
+        auto iter = hs.find(keys[i]);
+        ASSERT_TRUE(iter != hs.cend());
+        ASSERT_EQ(*iter, values[i]);
+    }
+    ASSERT_TRUE(hs.find("key_not_exist") == hs.cend());
+
+    // 覆盖写
+    hs.insert(keys[0], std::string("new_value"));
+    ASSERT_EQ(*hs.find(keys[0]), "new_value");
+    ASSERT_EQ(hs.size(), keys.size());
+
+    for (int i = 0; i < keys.size(); i += 2) {
+        hs.erase(keys[i]);
+    }
+    ASSERT_EQ(hs.size(), keys.size() / 2);
+    for (int i = 0; i < keys.size(); ++i) {
+        auto iter = hs.find(keys[i]);
+        ASSERT_EQ(iter == hs.cend(), i % 2 == 0);
+    }
+
+    std::set<std::string> set;
+    for (auto iter = hs.cbegin(); iter != hs.cend(); iter++) {
+        set.insert(*iter);
+    }
+    ASSERT_EQ(set.size(), keys.size() / 2);
+
+    hs.clear();
+    ASSERT_EQ(hs.size(), 0);
+    ASSERT_TRUE(hs.cbegin() == hs.cend());
+}
+
+TEST_F(ConcurrentHashMapTest, swiss_tombstone_rehash) {
+    using HashMap = rcu::SwissConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 0>;
+    HashMap hs;
+    auto* segment = hs.ensureSegment(0);
+    // 反复插入删除，tombstone会触发原地rehash，表不会一直变大
+    for (int round = 0; round < 100; ++round) {
+        for (int64_t i = 0; i < 100; ++i) {
+            hs.insert(round * 100 + i, i);
+        }
+        for (int64_t i = 0; i < 100; ++i) {
+            hs.erase(round * 100 + i);
+        }
+    }
+    ASSERT_EQ(hs.size(), 0);
+    ASSERT_LE(segment->get_bucket_list()->bucket_count(), 512);
+
+    hs.reserve(100000);
+    ASSERT_GE(segment->get_bucket_list()->bucket_count(), 100000);
+    for (int64_t i = 0; i < 100000; ++i) {
+        hs.insert(i, i * 2);
+    }
+    for (int64_t i = 0; i < 100000; ++i) {
+        auto iter = hs.find(i);
+        ASSERT_TRUE(iter != hs.cend());
+        ASSERT_EQ(*iter, i * 2);
+    }
+}
+
+TEST_F(ConcurrentHashMapTest, swiss_multi_thread) {
+    using HashMap = rcu::SwissConcurrentHashMap<std::string, std::string, std::hash<std::string>, std::allocator<uint8_t>, 2>;
+    HashMap hs;
+    size_t key_size = 10000;
+    std::vector<std::string> keys;
+    for (int i = 0; i < key_size; ++i) {
+        keys.emplace_back("key_" + std::to_string(i));
+        hs.insert(keys[i], keys[i]);
+    }
+    std::atomic<bool> stop = {false};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            while (!stop) {
+                auto& key = keys[intRand(0, key_size - 1)];
+                auto iter = hs.find(key);
+                if (iter != hs.cend()) {
+                    ASSERT_EQ(*iter, key);
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            for (int k = 0; k < 200000; ++k) {
+                auto& key = keys[intRand(0, key_size - 1)];
+                if (k % 2 == 0) {
+                    hs.erase(key);
+                } else {
+                    hs.insert(key, key);
+                }
+            }
+        });
+    }
+    for (size_t i = 4; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    stop = true;
+    for (size_t i = 0; i < 4; ++i) {
+        threads[i].join();
+    }
+    size_t count = 0;
+    for (auto iter = hs.cbegin(); iter != hs.cend(); ++iter) {
+        count++;
+    }
+    ASSERT_EQ(count, hs.size());
+}
+
+// reserve()直接调用segment的rehash，要和insert触发的扩容互斥
+TEST_F(ConcurrentHashMapTest, swiss_reserve_during_insert) {
+    using HashMap = rcu::SwissConcurrentHashMap<int64_t, int64_t>;
+    HashMap hs;
+    const int64_t key_size = 200000;
+    std::atomic<bool> stop = {false};
+    std::thread reserver([&] {
+        size_t capacity = 16;
+        while (!stop) {
+            hs.reserve(capacity);
+            capacity = capacity >= key_size * 2 ? 16 : capacity * 2;
+        }
+    });
+    for (int64_t i = 0; i < key_size; ++i) {
+        hs.insert(i, i * 2);
+    }
+    stop = true;
+    reserver.join();
+    ASSERT_EQ(hs.size(), key_size);
+    for (int64_t i = 0; i < key_size; ++i) {
+        auto iter = hs.find(i);
+        ASSERT_TRUE(iter != hs.cend());
+        ASSERT_EQ(*iter, i * 2);
+    }
+}
+
+TEST_F(ConcurrentHashMapTest, striped_insert_find_erase) {
+    using HashMap = rcu::StripedConcurrentHashMap<std::string, std::string, std::hash<std::string>, std::allocator<uint8_t>, 0>;
+    HashMap hs;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 1000; ++i) {
+        keys.emplace_back("key_" + std::to_string(i+1));
+        hs.insert(keys[i], keys[i]);
+    }
+    // 插入过程中扩容了
+    ASSERT_GE(hs.ensureSegment(0)->get_bucket_list()->bucket_count(), 512);
+    ASSERT_EQ(hs.size(), keys.size());
+    for (int i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(*hs.find(keys[i]), keys[i]);
+    }
+    hs.emplace(keys[0], std::string("new_value"));
+    ASSERT_EQ(*hs.find(keys[0]), "new_value");
+    for (int i = 0; i < keys.size(); ++i) {
+        hs.erase(keys[i]);
+        ASSERT_TRUE(hs.find(keys[i]) == hs.cend());
+    }
+    ASSERT_EQ(hs.size(), 0);
+}
+
+TEST_F(ConcurrentHashMapTest, striped_multi_thread) {
+    using HashMap = rcu::StripedConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 0>;
+    HashMap hs;
+    std::vector<std::thread> threads;
+    // 每个线程写自己的key，并发写入和扩容之后一个都不能少
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            for (int64_t i = 0; i < 20000; ++i) {
+                hs.insert(t * 100000 + i, i);
+                if (i % 3 == 0) {
+                    hs.erase(t * 100000 + i);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    size_t count = 0;
+    for (int t = 0; t < 8; ++t) {
+        for (int64_t i = 0; i < 20000; ++i) {
+            auto iter = hs.find(t * 100000 + i);
+            if (i % 3 == 0) {
+                ASSERT_TRUE(iter == hs.cend());
+            } else {
+                ASSERT_TRUE(iter != hs.cend());
+                ASSERT_EQ(*iter, i);
+                count++;
+            }
+        }
+    }
+    ASSERT_EQ(hs.size(), count);
+}
+
+TEST_F(ConcurrentHashMapTest, incremental_rehash) {
+    using HashMap = rcu::ConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 0>;
+    HashMap hs;
+    hs.set_migrate_batch(1);
+    auto* segment = hs.ensureSegment(0);
+    bool seen_migrating = false;
+    for (int64_t i = 0; i < 10000; ++i) {
+        hs.insert(i, i * 2);
+        if (segment->migrating()) {
+            seen_migrating = true;
+            // 迁移过程中新旧两张表里的key都要能找到
+            for (int64_t j = 0; j <= i; j += 97) {
+                auto iter = hs.find(j);
+                ASSERT_TRUE(iter != hs.cend());
+                ASSERT_EQ(*iter, j * 2);
+            }
+        }
+    }
+    ASSERT_TRUE(seen_migrating);
+    ASSERT_EQ(hs.size(), 10000);
+
+    // 迁移中erase和遍历
+    for (int64_t i = 0; i < 10000; i += 2) {
+        hs.erase(i);
+    }
+    std::set<int64_t> values;
+    for (auto iter = hs.cbegin(); iter != hs.cend(); ++iter) {
+        values.insert(*iter);
+    }
+    ASSERT_EQ(values.size(), 5000);
+    ASSERT_EQ(*values.begin(), 2);
+
+    // rehash会先把进行中的迁移做完
+    hs.reserve(1 << 16);
+    ASSERT_FALSE(segment->migrating());
+    ASSERT_EQ(segment->get_bucket_list()->bucket_count(), 1 << 16);
+    for (int64_t i = 0; i < 10000; ++i) {
+        auto iter = hs.find(i);
+        ASSERT_EQ(iter == hs.cend(), i % 2 == 0);
+    }
+}
+
+// for_each期间推迟扩容，结束之后的第一次插入再扩容
+TEST_F(ConcurrentHashMapTest, resize_deferred_by_scanner) {
+    using HashMap = rcu::ConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 0>;
+    HashMap hs;
+    hs.insert(0, 0);
+    auto* segment = hs.ensureSegment(0);
+    size_t bucket_count = segment->get_bucket_list()->bucket_count();
+    size_t rehash_count = segment->rehash_count_.load();
+    // 模拟一个正在进行的for_each
+    segment->scanners_.fetch_add(1);
+    for (int64_t i = 1; i < 10000; ++i) {
+        hs.insert(i, i);
+    }
+    ASSERT_EQ(segment->get_bucket_list()->bucket_count(), bucket_count);
+    ASSERT_EQ(segment->rehash_count_.load(), rehash_count);
+    segment->scanners_.fetch_sub(1);
+    hs.insert(10000, 10000);
+    ASSERT_GT(segment->rehash_count_.load(), rehash_count);
+    ASSERT_EQ(hs.size(), 10001);
+}
+
+TEST_F(ConcurrentHashMapTest, incremental_rehash_multi_thread) {
+    using HashMap = rcu::StripedConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 0>;
+    HashMap hs;
+    hs.set_migrate_batch(2);
+    const int64_t stable_keys = 1000;
+    for (int64_t i = 0; i < stable_keys; ++i) {
+        hs.insert(-i - 1, i);
+    }
+    std::atomic<bool> stop = {false};
+    std::vector<std::thread> readers;
+    // 读者在写者不断扩容的过程中一直要能读到已有的key
+    for (int t = 0; t < 2; ++t) {
+        readers.emplace_back([&] {
+            while (!stop.load()) {
+                for (int64_t i = 0; i < stable_keys; ++i) {
+                    auto iter = hs.find(-i - 1);
+                    ASSERT_TRUE(iter != hs.cend());
+                    ASSERT_EQ(*iter, i);
+                }
+            }
+        });
+    }
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t] {
+            for (int64_t i = 0; i < 50000; ++i) {
+                hs.insert(t * 1000000 + i, i);
+            }
+        });
+    }
+    for (auto& th : writers) {
+        th.join();
+    }
+    stop = true;
+    for (auto& th : readers) {
+        th.join();
+    }
+    ASSERT_EQ(hs.size(), stable_keys + 4 * 50000);
+    for (int t = 0; t < 4; ++t) {
+        for (int64_t i = 0; i < 50000; ++i) {
+            auto iter = hs.find(t * 1000000 + i);
+            ASSERT_TRUE(iter != hs.cend());
+            ASSERT_EQ(*iter, i);
+        }
+    }
+}
+
+template <typename HashMap>
+void check_transparent_lookup() {
+    HashMap hs;
+    for (int i = 0; i < 1000; ++i) {
+        hs.insert(std::to_string(i), i);
+    }
+    std::string_view view = "123";
+    auto iter = hs.find(view);
+    ASSERT_TRUE(iter != hs.cend());
+    ASSERT_EQ(*iter, 123);
+    iter = hs.find("456");
+    ASSERT_TRUE(iter != hs.cend());
+    ASSERT_EQ(*iter, 456);
+    ASSERT_TRUE(hs.find(std::string_view("1000")) == hs.cend());
+
+    // 预先算好的hash
+    size_t hash = rcu::StringHash()(view);
+    iter = hs.find(view, hash);
+    ASSERT_TRUE(iter != hs.cend());
+    ASSERT_EQ(*iter, 123);
+
+    hs.erase(view);
+    ASSERT_TRUE(hs.find(view) == hs.cend());
+    ASSERT_EQ(hs.size(), 999);
+}
+
+TEST_F(ConcurrentHashMapTest, transparent_lookup) {
+    check_transparent_lookup<rcu::ConcurrentHashMap<std::string, int, rcu::StringHash>>();
+    check_transparent_lookup<rcu::SwissConcurrentHashMap<std::string, int, rcu::StringHash>>();
+}
+
+template <typename HashMap>
+void check_multi_find() {
+    HashMap hs;
+    std::vector<int64_t> keys;
+    std::vector<int64_t> values;
+    for (int64_t i = 0; i < 5000; ++i) {
+        keys.push_back(i);
+        values.push_back(i * 3);
+    }
+    // 从很小的表开始插入，批量插入过程中会扩容
+    ASSERT_EQ(hs.multi_insert(keys, values), 5000);
+    ASSERT_EQ(hs.size(), 5000);
+
+    // 一半存在一半不存在，顺序打乱
+    std::vector<int64_t> query;
+    for (int64_t i = 0; i < 2000; ++i) {
+        query.push_back((i * 7919) % 10000);
+    }
+    std::vector<std::optional<int64_t>> out;
+    size_t found = hs.multi_find(query, out);
+    ASSERT_EQ(out.size(), query.size());
+    size_t expect_found = 0;
+    for (size_t i = 0; i < query.size(); ++i) {
+        if (query[i] < 5000) {
+            ASSERT_TRUE(out[i].has_value());
+            ASSERT_EQ(*out[i], query[i] * 3);
+            expect_found++;
+        } else {
+            ASSERT_FALSE(out[i].has_value());
+        }
+    }
+    ASSERT_EQ(found, expect_found);
+
+    // 比预取距离还小的batch
+    query = {1, 10001};
+    ASSERT_EQ(hs.multi_find(query, out), 1);
+    ASSERT_EQ(*out[0], 3);
+    ASSERT_FALSE(out[1].has_value());
+    query.clear();
+    ASSERT_EQ(hs.multi_find(query, out), 0);
+}
+
+TEST_F(ConcurrentHashMapTest, multi_find) {
+    check_multi_find<rcu::ConcurrentHashMap<int64_t, int64_t>>();
+    check_multi_find<rcu::ConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 0>>();
+    check_multi_find<rcu::StripedConcurrentHashMap<int64_t, int64_t>>();
+    check_multi_find<rcu::SwissConcurrentHashMap<int64_t, int64_t>>();
+}
+
+TEST_F(ConcurrentHashMapTest, multi_find_during_migration) {
+    using HashMap = rcu::ConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 0>;
+    HashMap hs;
+    hs.set_migrate_batch(1);
+    std::vector<int64_t> query;
+    std::vector<std::optional<int64_t>> out;
+    for (int64_t i = 0; i < 20000; ++i) {
+        hs.insert(i, i);
+        if (i % 1000 == 999) {
+            query.clear();
+            for (int64_t j = 0; j <= i; j += 3) {
+                query.push_back(j);
+            }
+            ASSERT_EQ(hs.multi_find(query, out), query.size());
+            for (size_t j = 0; j < query.size(); ++j) {
+                ASSERT_EQ(*out[j], query[j]);
+            }
+        }
+    }
+}
+
+template <typename HashMap>
+void check_update() {
+    HashMap hs;
+    // 不存在时插入
+    ASSERT_TRUE(hs.upsert(1, [](int64_t& v) { v += 10; }));
+    ASSERT_FALSE(hs.upsert(1, [](int64_t& v) { v += 10; }));
+    ASSERT_EQ(*hs.find(1), 20);
+
+    ASSERT_FALSE(hs.compute_if_present(2, [](int64_t& v) { v = 100; }));
+    ASSERT_TRUE(hs.find(2) == hs.cend());
+    ASSERT_TRUE(hs.compute_if_present(1, [](int64_t& v) { v *= 2; }));
+    ASSERT_EQ(*hs.find(1), 40);
+
+    ASSERT_FALSE(hs.assign_if_equal(1, 41, 0));
+    ASSERT_TRUE(hs.assign_if_equal(1, 40, 7));
+    ASSERT_EQ(*hs.find(1), 7);
+    ASSERT_FALSE(hs.assign_if_equal(2, 0, 1));
+
+    ASSERT_EQ(hs.fetch_add(1, 3), 7);
+    ASSERT_EQ(hs.fetch_add(3, 5), 0);
+    ASSERT_EQ(*hs.find(1), 10);
+    ASSERT_EQ(*hs.find(3), 5);
+    ASSERT_EQ(hs.size(), 2);
+
+    // 并发计数不能丢
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 20000; ++i) {
+                hs.fetch_add(100 + i % 50, 1);
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    for (int i = 0; i < 50; ++i) {
+        ASSERT_EQ(*hs.find(100 + i), 4 * 20000 / 50);
+    }
+}
+
+TEST_F(ConcurrentHashMapTest, update) {
+    check_update<rcu::ConcurrentHashMap<int64_t, int64_t>>();
+    check_update<rcu::StripedConcurrentHashMap<int64_t, int64_t>>();
+    check_update<rcu::SwissConcurrentHashMap<int64_t, int64_t>>();
+}
+
+template <typename HashMap>
+void check_update_string() {
+    HashMap hs;
+    // 非trivially copyable的value走换node的路径
+    ASSERT_TRUE(hs.upsert("k", [](std::string& v) { v += "a"; }));
+    auto iter = hs.find("k");
+    ASSERT_FALSE(hs.upsert("k", [](std::string& v) { v += "b"; }));
+    // 老的iterator仍然能读到旧值
+    ASSERT_EQ(*iter, "a");
+    ASSERT_EQ(*hs.find("k"), "ab");
+    ASSERT_TRUE(hs.assign_if_equal("k", "ab", "c"));
+    ASSERT_EQ(*hs.find("k"), "c");
+    ASSERT_EQ(hs.size(), 1);
+}
+
+TEST_F(ConcurrentHashMapTest, update_string) {
+    check_update_string<rcu::ConcurrentHashMap<std::string, std::string, rcu::StringHash>>();
+    check_update_string<rcu::SwissConcurrentHashMap<std::string, std::string, rcu::StringHash>>();
+}
+
+template <typename HashMap>
+void check_const_iterator() {
+    HashMap hs;
+    ASSERT_TRUE(hs.cbegin() == hs.cend());
+    std::map<int64_t, int64_t> expect;
+    for (int64_t i = 0; i < 3000; ++i) {
+        hs.insert(i, i + 1);
+        expect[i] = i + 1;
+    }
+    std::map<int64_t, int64_t> result;
+    for (auto iter = hs.cbegin(); iter != hs.cend(); ++iter) {
+        ASSERT_TRUE(result.emplace(iter.key(), *iter).second);
+    }
+    ASSERT_EQ(result, expect);
+
+    // 拷贝出来的iterator独立前进
+    auto iter = hs.cbegin();
+    auto copy = iter;
+    ++iter;
+    ASSERT_TRUE(copy != iter);
+    ASSERT_EQ(*copy, copy.key() + 1);
+    ++copy;
+    ASSERT_TRUE(copy == iter);
+
+    // find到的iterator可以继续遍历到末尾
+    size_t count = 0;
+    for (auto it = hs.find(5); it != hs.cend(); ++it) {
+        count++;
+    }
+    ASSERT_GT(count, 0);
+    ASSERT_LE(count, 3000);
+}
+
+TEST_F(ConcurrentHashMapTest, const_iterator) {
+    check_const_iterator<rcu::ConcurrentHashMap<int64_t, int64_t>>();
+    check_const_iterator<rcu::SwissConcurrentHashMap<int64_t, int64_t>>();
+}
+
+TEST_F(ConcurrentHashMapTest, parallel_for_each) {
+    using HashMap = rcu::StripedConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 2>;
+    HashMap hs;
+    hs.set_migrate_batch(1);
+    const int64_t stable_keys = 20000;
+    for (int64_t i = 0; i < stable_keys; ++i) {
+        hs.insert(i, 1);
+    }
+    std::atomic<bool> stop = {false};
+    // 写者不断插入新key触发扩容，删除自己插入的key
+    std::thread writer([&] {
+        for (int64_t i = 0; !stop.load(); ++i) {
+            hs.insert(stable_keys + i, 0);
+            if (i % 2 == 0) {
+                hs.erase(stable_keys + i / 2);
+            }
+        }
+    });
+    for (int round = 0; round < 5; ++round) {
+        std::atomic<int64_t> sum = {0};
+        std::vector<std::atomic<int>> seen(stable_keys);
+        hs.parallel_for_each([&](const int64_t& key, const int64_t& value) {
+            sum += value;
+            if (key < stable_keys) {
+                seen[key]++;
+            }
+        }, 4);
+        // 一直存在的key恰好访问一次
+        ASSERT_EQ(sum.load(), stable_keys);
+        for (auto& cnt : seen) {
+            ASSERT_EQ(cnt.load(), 1);
+        }
+    }
+    stop = true;
+    writer.join();
+
+    size_t count = 0;
+    hs.for_each([&](const int64_t&, const int64_t&) { count++; });
+    ASSERT_EQ(count, hs.size());
+}
+
+TEST_F(ConcurrentHashMapTest, size_counter) {
+    using HashMap = rcu::ConcurrentHashMap<int64_t, int64_t>;
+    using SwissMap = rcu::SwissConcurrentHashMap<int64_t, int64_t>;
+    HashMap hs;
+    SwissMap swiss;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            // 插入的key由别的线程删除，计数落在不同的分片上
+            for (int64_t i = 0; i < 20000; ++i) {
+                hs.insert(t * 100000 + i, i);
+                swiss.insert(t * 100000 + i, i);
+                int64_t other = ((t + 1) % 4) * 100000 + i / 2;
+                hs.erase(other);
+                swiss.erase(other);
+                if (i % 1000 == 0) {
+                    hs.size();
+                    hs.size_exact();
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    size_t count = 0;
+    hs.for_each([&](const int64_t&, const int64_t&) { count++; });
+    ASSERT_EQ(hs.size(), count);
+    ASSERT_EQ(hs.size_exact(), count);
+    count = 0;
+    swiss.for_each([&](const int64_t&, const int64_t&) { count++; });
+    ASSERT_EQ(swiss.size(), count);
+    ASSERT_EQ(swiss.size_exact(), count);
+
+    hs.clear();
+    swiss.clear();
+    ASSERT_EQ(hs.size(), 0);
+    ASSERT_EQ(swiss.size(), 0);
+    ASSERT_EQ(hs.size_exact(), 0);
+}
+
+// 只用低几位的hash函数，所有key挤在少数几个bucket里
+struct BadHash {
+    size_t operator()(int64_t key) const {
+        return (key & 7) << 8;
+    }
+};
+
+TEST_F(ConcurrentHashMapTest, segment_stats) {
+    rcu::ConcurrentHashMap<int64_t, int64_t> good(1024);
+    rcu::ConcurrentHashMap<int64_t, int64_t, BadHash> bad(1024);
+    rcu::SwissConcurrentHashMap<int64_t, int64_t, BadHash> swiss_bad(1024);
+    for (int64_t i = 0; i < 4096; ++i) {
+        good.insert(i, i);
+        bad.insert(i, i);
+        swiss_bad.insert(i, i);
+    }
+    auto good_stats = good.segment_stats();
+    size_t total = 0;
+    size_t longest = 0;
+    for (auto& stats : good_stats) {
+        total += stats.size;
+        longest = std::max(longest, stats.longest_chain);
+        if (stats.bucket_count) {
+            ASSERT_DOUBLE_EQ(stats.load_factor, double(stats.size) / stats.bucket_count);
+        }
+    }
+    ASSERT_EQ(total, 4096);
+    ASSERT_LE(longest, 8);
+
+    // BadHash的低8位全是0，所有key都在segment 0
+    auto bad_stats = bad.segment_stats();
+    ASSERT_EQ(bad_stats[0].size, 4096);
+    ASSERT_GE(bad_stats[0].rehash_count, 1);
+    ASSERT_EQ(bad_stats[0].longest_chain, 4096 / 8);
+    ASSERT_EQ(bad_stats[1].size, 0);
+
+    auto swiss_stats = swiss_bad.segment_stats();
+    ASSERT_EQ(swiss_stats[0].size, 4096);
+    ASSERT_GT(swiss_stats[0].longest_chain, 4096 / 8 / rcu::swiss::GROUP_WIDTH);
+}
+
+TEST_F(ConcurrentHashMapTest, destroy_with_cohort) {
+    using HashMap = rcu::ConcurrentHashMap<int64_t, std::string>;
+    auto& manager = rcu::get_default_manager();
+    manager.bulkReclaim();
+    int global_before = manager.retired_count();
+    auto* hs = new HashMap(16);
+    // 扩容、覆盖写和删除换下来的bucket list和node都挂在segment的cohort上
+    for (int64_t i = 0; i < 100000; ++i) {
+        hs->insert(i, std::to_string(i));
+    }
+    for (int64_t i = 0; i < 100000; i += 2) {
+        hs->upsert(i, [](std::string& value) { value = "x"; });
+    }
+    for (int64_t i = 0; i < 100000; i += 3) {
+        hs->erase(i);
+    }
+    {
+        auto iter = hs->find(1);
+        ASSERT_EQ(*iter, "1");
+    }
+    rcu::HazptrPrivate::instance().pushAlltoDomain();
+    ASSERT_EQ(manager.retired_count(), global_before);
+    delete hs;
+    ASSERT_EQ(manager.retired_count(), global_before);
+
+    auto* swiss = new rcu::SwissConcurrentHashMap<int64_t, std::string>(16);
+    for (int64_t i = 0; i < 100000; ++i) {
+        swiss->insert(i, std::to_string(i));
+    }
+    swiss->clear();
+    delete swiss;
+    ASSERT_EQ(manager.retired_count(), global_before);
+}
+
+TEST_F(ConcurrentHashMapTest, hazptr_domain) {
+    auto& global = rcu::get_default_manager();
+    int global_records = global._hazptr_count.load();
+    int global_retired = global.retired_count();
+    rcu::HazptrManager domain;
+    {
+        rcu::ConcurrentHashMap<int64_t, std::string> hs(16, domain);
+        rcu::SwissConcurrentHashMap<int64_t, std::string> swiss(16, domain);
+        for (int64_t i = 0; i < 10000; ++i) {
+            hs.insert(i, std::to_string(i));
+            swiss.insert(i, std::to_string(i));
+        }
+        for (int64_t i = 0; i < 10000; i += 2) {
+            hs.upsert(i, [](std::string& value) { value = "x"; });
+            swiss.erase(i);
+        }
+        auto iter = hs.find(1);
+        ASSERT_EQ(*iter, "1");
+        // 拷贝到默认构造的iterator，保护跟着换到map的domain
+        decltype(iter) copy = hs.cend();
+        copy = iter;
+        ASSERT_EQ(&copy.it_.holder_node.manager(), &domain);
+        ASSERT_EQ(*swiss.find(3), "3");
+        size_t count = 0;
+        for (auto it = hs.cbegin(); it != hs.cend(); ++it) {
+            count++;
+        }
+        ASSERT_EQ(count, 10000);
+        ASSERT_GT(domain._hazptr_count.load(), 0);
+    }
+    // 读者的record和retired对象都没有进默认domain
+    ASSERT_EQ(global._hazptr_count.load(), global_records);
+    ASSERT_EQ(global.retired_count(), global_retired);
+    ASSERT_EQ(domain.retired_count(), 0);
+}
@@ -0,0 +1,184 @@
+#include "gtest/gtest.h"
+#include "gflags/gflags.h"
+#include <thread>
+#include <chrono>
+#include <random>
+#include <string>
+
+#define  DCHECK_IS_ON
+
+#define private public
+#define protected public
+#include "concurrent/concurrent_cache.h"
+#undef private
+#undef protected
+
+using namespace rcu;
+
+class ConcurrentCacheTest : public ::testing::Test {
+private:
+    virtual void SetUp() {
+    }
+    virtual void TearDown() {
+    }
+};
+
+TEST_F(ConcurrentCacheTest, get_put_erase) {
+    ConcurrentCacheOptions options;
+    ConcurrentCache<int64_t, std::string> cache(options);
+    std::string value;
+    ASSERT_FALSE(cache.get(1, &value));
+    cache.put(1, "a");
+    ASSERT_TRUE(cache.get(1, &value));
+    ASSERT_EQ(value, "a");
+    // 覆盖写入不增加entry数
+    cache.put(1, "b");
+    ASSERT_TRUE(cache.get(1, &value));
+    ASSERT_EQ(value, "b");
+    ASSERT_EQ(cache.size(), 1);
+
+    ASSERT_TRUE(cache.erase(1));
+    ASSERT_FALSE(cache.erase(1));
+    ASSERT_FALSE(cache.get(1, &value));
+
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.hits, 2);
+    ASSERT_EQ(stats.misses, 2);
+    ASSERT_EQ(stats.entries, 0);
+    ASSERT_EQ(stats.bytes, 0);
+}
+
+TEST_F(ConcurrentCacheTest, ttl) {
+    ConcurrentCacheOptions options;
+    options.default_ttl_ms = 20;
+    ConcurrentCache<int64_t, int64_t> cache(options);
+    cache.put(1, 1);
+    cache.put(2, 2, 0, 16);
+    int64_t value = 0;
+    ASSERT_TRUE(cache.get(1, &value));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // 过期之后读不到，ttl为0的不过期
+    ASSERT_FALSE(cache.get(1, &value));
+    ASSERT_TRUE(cache.get(2, &value));
+    ASSERT_EQ(value, 2);
+}
+
+TEST_F(ConcurrentCacheTest, entry_budget) {
+    ConcurrentCacheOptions options;
+    options.max_entries = 1024;
+    // 每个segment 4个entry
+    ConcurrentCache<int64_t, int64_t, std::hash<int64_t>, 8> cache(options);
+    for (int64_t i = 0; i < 100000; ++i) {
+        cache.put(i, i);
+    }
+    auto stats = cache.stats();
+    ASSERT_LE(stats.entries, 1024 + 256);
+    ASSERT_GE(stats.evictions, 100000 - 1024 - 256);
+    ASSERT_EQ(stats.entries + stats.evictions, 100000);
+
+    // 最近写入的key大部分还在
+    size_t hit = 0;
+    int64_t value = 0;
+    for (int64_t i = 100000 - 256; i < 100000; ++i) {
+        hit += cache.get(i, &value);
+    }
+    ASSERT_GT(hit, 128);
+}
+
+// 上限小于segment个数时，余数分给前面的segment，总数不超过上限
+TEST_F(ConcurrentCacheTest, small_budget) {
+    {
+        ConcurrentCacheOptions options;
+        options.max_entries = 10;
+        ConcurrentCache<int64_t, int64_t, std::hash<int64_t>, 8> cache(options);
+        ASSERT_EQ(cache._shards[0].max_entries, 1);
+        ASSERT_EQ(cache._shards[9].max_entries, 1);
+        ASSERT_EQ(cache._shards[10].max_entries, 0);
+        for (int64_t i = 0; i < 10000; ++i) {
+            cache.put(i, i);
+        }
+        auto stats = cache.stats();
+        ASSERT_EQ(stats.entries, 10);
+        ASSERT_EQ(stats.entries + stats.evictions, 10000);
+    }
+    {
+        ConcurrentCacheOptions options;
+        options.max_bytes = 100;
+        ConcurrentCache<int64_t, int64_t, std::hash<int64_t>, 8> cache(options);
+        size_t total_bytes = 0;
+        for (auto& shard : cache._shards) {
+            total_bytes += shard.max_bytes;
+        }
+        ASSERT_EQ(total_bytes, 100);
+        for (int64_t i = 0; i < 10000; ++i) {
+            cache.put(i, i, 0, 1);
+        }
+        auto stats = cache.stats();
+        ASSERT_EQ(stats.bytes, 100);
+        ASSERT_EQ(stats.entries, 100);
+    }
+}
+
+TEST_F(ConcurrentCacheTest, clock_keeps_hot_keys) {
+    ConcurrentCacheOptions options;
+    options.max_entries = 2048;
+    ConcurrentCache<int64_t, int64_t, std::hash<int64_t>, 0> cache(options);
+    for (int64_t i = 0; i < 200; ++i) {
+        cache.put(i, i);
+    }
+    int64_t value = 0;
+    // 热点key在CLOCK指针转一圈之内一定会被访问到，冷key只写一次
+    for (int64_t i = 0; i < 50000; ++i) {
+        cache.put(1000000 + i, i);
+        cache.get(i % 200, &value);
+    }
+    size_t hit = 0;
+    for (int64_t i = 0; i < 200; ++i) {
+        hit += cache.get(i, &value);
+    }
+    ASSERT_EQ(hit, 200);
+    ASSERT_LE(cache.size(), 2048 + 1);
+}
+
+TEST_F(ConcurrentCacheTest, byte_budget) {
+    ConcurrentCacheOptions options;
+    options.max_bytes = 1 << 20;
+    ConcurrentCache<int64_t, std::string, std::hash<int64_t>, 2> cache(options);
+    for (int64_t i = 0; i < 10000; ++i) {
+        cache.put(i, std::string(1000, 'x'), 0, 1024);
+    }
+    auto stats = cache.stats();
+    ASSERT_LE(stats.bytes, (1 << 20) + 4 * 1024);
+    ASSERT_EQ(stats.bytes, stats.entries * 1024);
+}
+
+TEST_F(ConcurrentCacheTest, multi_thread) {
+    ConcurrentCacheOptions options;
+    options.max_entries = 4096;
+    ConcurrentCache<int64_t, int64_t> cache(options);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937_64 generator(t);
+            int64_t value = 0;
+            for (int i = 0; i < 50000; ++i) {
+                int64_t key = generator() % 20000;
+                if (!cache.get(key, &value)) {
+                    cache.put(key, key * 2);
+                } else {
+                    ASSERT_EQ(value, key * 2);
+                }
+                if (i % 16 == 0) {
+                    cache.erase(key);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.hits + stats.misses, 4 * 50000);
+    ASSERT_EQ(stats.entries, cache._map.size());
+    ASSERT_LE(stats.entries, 4096 + 256 * 4);
+}
@@ -3,6 +3,7 @@
 #include <thread>
 #include <chrono>
 #include <random>
+#include <unistd.h>
 
 #define  DCHECK_IS_ON
 
@@ -37,16 +38,19 @@ TEST_F(ConcurrentVectorTest, ConcurrentVectorPool) {
         rcu::ConcurrentVector<int> vec;
         vec.reserve(2004);
 
-        vec[0] = 4241;
+        vec.writable(0) = 4241;
         ASSERT_EQ(vec[0], 4241);
-        vec[2003] = 4242;
+        vec.writable(2003) = 4242;
         ASSERT_EQ(vec[2003], 4242);
+        rcu::EpochGuard guard;
+        ASSERT_EQ(vec.get_unguarded(0), 4241);
+        ASSERT_EQ(vec.get_unguarded(2003), 4242);
     }
 
     {
         rcu::ConcurrentVector<int> vec(232);  // num_per_shard
         vec.reserve(4238);  // size
-        vec[4237] = 9433;
+        vec.writable(4237) = 9433;
         ASSERT_EQ(vec[4237], 9433);
     }
 
@@ -86,7 +90,7 @@ template<typename T>
 int print_list(std::string name, T* head) {
     int cnt = 0;
     std::cout << "PRINT_LIST " << name << " -> ";
-    for (auto p = head; p != nullptr; p = p->next) {
+    for (auto p = head; p != nullptr; p = p->retire_next) {
         cnt++;
         std::cout << p << " -> ";
     }
@@ -103,7 +107,7 @@ TEST_F(ConcurrentVectorTest, test_retire_list) {
         data->message = "Hello, World";
         auto* node = new Node;
         node->data = data;
-        list.push(node, now);
+        list.push(node, node, now);
     }
     auto head = list._head.load();
     int cnt = 0;
@@ -114,6 +118,70 @@ TEST_F(ConcurrentVectorTest, test_retire_list) {
     ASSERT_EQ(cnt, 0);
     cnt = print_list("dropped_list:", dropped_list);
     ASSERT_EQ(cnt, 5);
+    ASSERT_EQ(list.delete_list(dropped_list), 5);
+}
+
+static std::atomic<int> g_hook_deleted = {0};
+
+struct HookedFoobar : public rcu::RetireListHook {
+    ~HookedFoobar() {
+        g_hook_deleted++;
+    }
+    int64_t value = {0};
+};
+
+TEST_F(ConcurrentVectorTest, test_retire_list_intrusive) {
+    g_hook_deleted = 0;
+    {
+        rcu::RetireList<HookedFoobar> list;
+        static_assert(rcu::RetireList<HookedFoobar>::INTRUSIVE, "HookedFoobar should be intrusive");
+        for (int i = 0; i < 10; i++) {
+            list.retire(new HookedFoobar);
+        }
+        // 侵入式链表直接挂对象本身
+        ASSERT_EQ(print_list("intrusive:", list.get_head()), 10);
+        list.force_gc();
+        ASSERT_EQ(g_hook_deleted, 10);
+        ASSERT_EQ(list.get_head(), nullptr);
+
+        list.retire(new HookedFoobar);
+    }
+    // 析构时释放剩下的对象
+    ASSERT_EQ(g_hook_deleted, 11);
+}
+
+TEST_F(ConcurrentVectorTest, test_retire_list_batch) {
+    g_hook_deleted = 0;
+    rcu::RetireList<HookedFoobar> list;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            rcu::RetireList<HookedFoobar>::Batch batch;
+            for (int i = 0; i < 1000; ++i) {
+                batch.add(new HookedFoobar);
+                if (batch.size() == 32) {
+                    list.retire(batch);
+                    ASSERT_TRUE(batch.empty());
+                }
+            }
+            list.retire(batch);
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    ASSERT_EQ(print_list("batch:", list.get_head()), 4000);
+    list.force_gc();
+    ASSERT_EQ(g_hook_deleted, 4000);
+
+    // 非侵入式对象也可以批量retire
+    rcu::RetireList<Foobar> node_list;
+    rcu::RetireList<Foobar>::Batch batch;
+    for (int i = 0; i < 10; ++i) {
+        batch.add(new Foobar);
+    }
+    node_list.retire(batch);
+    ASSERT_EQ(print_list("node batch:", node_list.get_head()), 10);
 }
 
 TEST_F(ConcurrentVectorTest, test_snapshot) {
@@ -122,6 +190,58 @@ TEST_F(ConcurrentVectorTest, test_snapshot) {
     auto snapshot = vec.snapshot();
 }
 
+TEST_F(ConcurrentVectorTest, test_table_reclaim) {
+    rcu::EpochDomain domain;
+    rcu::ConcurrentVector<int> vec(4, domain);
+    auto* rec = rcu::EpochThreadCache::instance().get_record(&domain);
+    {
+        auto snapshot = vec.snapshot();
+        vec.reserve(100);
+        vec.reserve(200);
+        // snapshot还在使用旧table，不能释放
+        ASSERT_EQ(rec->retired.size(), 2);
+    }
+    // 离开读临界区后立即释放
+    ASSERT_EQ(rec->retired.size(), 0);
+    vec.reserve(300);
+    ASSERT_EQ(rec->retired.size(), 0);
+}
+
+TEST_F(ConcurrentVectorTest, test_concurrent_grow) {
+    rcu::ConcurrentVector<size_t> vec(16);
+    std::vector<std::thread> threads;
+    std::atomic<bool> stop = {false};
+    // 读者开始之前shard 0必须已经存在
+    for (size_t k = 0; k < 16; ++k) {
+        vec.ensure(k) = k;
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            while (!stop) {
+                auto snapshot = vec.snapshot();
+                for (size_t k = 0; k < 16; ++k) {
+                    ASSERT_EQ(snapshot[k], k);
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            for (int j = 0; j < 1000; ++j) {
+                size_t idx = intRand(16, 100000);
+                vec.ensure(idx) = idx;
+            }
+        });
+    }
+    for (size_t i = 4; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    stop = true;
+    for (size_t i = 0; i < 4; ++i) {
+        threads[i].join();
+    }
+}
+
 TEST_F(ConcurrentVectorTest, test_fill_n) {
     rcu::ConcurrentVector<int> vec(4);
     size_t index = 2;
@@ -156,7 +276,7 @@ TEST_F(ConcurrentVectorTest, test_for_each) {
     rcu::ConcurrentVector<std::string> vec(4);
     vec.reserve(2004);
     for (int i = 0; i < 1000; ++i) {
-        vec[i] = std::to_string(i);
+        vec.writable(i) = std::to_string(i);
     }
 
     int cnt = 0;
@@ -179,6 +299,67 @@ TEST_F(ConcurrentVectorTest, test_for_each) {
     test(2, 4);
     test(2, 6);
     test(2, 10);
+    test(2, 3);
+    test(5, 7);
+    test(4, 8);
+}
+
+TEST_F(ConcurrentVectorTest, test_parallel_for_each) {
+    rcu::ConcurrentVector<int> vec(16);
+    vec.reserve(10000);
+    for (int i = 0; i < 10000; ++i) {
+        vec.writable(i) = i;
+    }
+    std::atomic<int64_t> sum = {0};
+    std::atomic<int> cnt = {0};
+    vec.parallel_for_each(3, 9999, [&](int* iter, int* end) {
+        for (; iter != end; ++iter) {
+            sum += *iter;
+            cnt++;
+        }
+    }, 4);
+    ASSERT_EQ(cnt, 9999 - 3);
+    ASSERT_EQ(sum, (int64_t)(3 + 9998) * (9999 - 3) / 2);
+}
+
+TEST_F(ConcurrentVectorTest, test_parallel_fill_n) {
+    rcu::ConcurrentVector<int> vec(1024);
+    // 超过CONCURRENT_VECTOR_NT_THRESHOLD，走non-temporal store
+    size_t index = 3;
+    size_t length = (CONCURRENT_VECTOR_NT_THRESHOLD / sizeof(int)) + 77;
+    vec.parallel_fill_n(index, length, 666, 4);
+    ASSERT_EQ(vec[index-1], 0);
+    ASSERT_EQ(vec[index+length], 0);
+    for (size_t i = index; i < index+length; ++i) {
+        ASSERT_EQ(vec[i], 666);
+    }
+    vec.fill_n(index, length, 777);
+    for (size_t i = index; i < index+length; ++i) {
+        ASSERT_EQ(vec[i], 777);
+    }
+}
+
+TEST_F(ConcurrentVectorTest, test_parallel_copy_n) {
+    rcu::ConcurrentVector<int> vec(1024);
+    size_t start_index = 5;
+    size_t length = (CONCURRENT_VECTOR_NT_THRESHOLD / sizeof(int)) + 33;
+    std::vector<int> src(length);
+    for (size_t i = 0; i < length; ++i) {
+        src[i] = i + 1;
+    }
+    vec.parallel_copy_n(src.begin(), length, start_index, 4);
+    ASSERT_EQ(vec[start_index-1], 0);
+    ASSERT_EQ(vec[start_index+length], 0);
+    for (size_t i = 0; i < length; ++i) {
+        ASSERT_EQ(vec[start_index+i], i + 1);
+    }
+
+    rcu::ConcurrentVector<std::string> svec(4);
+    std::vector<std::string> ssrc = {"a", "b", "c", "d", "e", "f", "g"};
+    svec.parallel_copy_n(ssrc.begin(), ssrc.size(), 1, 2);
+    for (size_t i = 0; i < ssrc.size(); ++i) {
+        ASSERT_EQ(svec[1+i], ssrc[i]);
+    }
 }
 
 /*
@@ -220,3 +401,198 @@ TEST_F(ConcurrentVectorTest, bench_retire_list) {
     }
 }
 */
+
+TEST_F(ConcurrentVectorTest, test_attach_file) {
+    std::string path = "./test_concurrent_vector.shard";
+    unlink(path.c_str());
+    {
+        rcu::ConcurrentVector<int64_t> vec(1024);
+        ASSERT_EQ(vec.attach_file(path, 100000), 0);
+        vec.fill_n(0, 5000, 7);
+        vec.ensure(9999) = 9999;
+        // shard 0~4被fill_n写过，shard 9被ensure写过
+        ASSERT_EQ(vec.checkpoint(), 6);
+        ASSERT_EQ(vec.checkpoint(), 0);
+        // 只读不标记dirty
+        const auto& cvec = vec;
+        ASSERT_EQ(vec[100], 7);
+        ASSERT_EQ(cvec[9999], 9999);
+        ASSERT_EQ(vec.checkpoint(), 0);
+        vec.writable(3000) = 3000;
+        ASSERT_EQ(vec.checkpoint(), 1);
+    }
+    {
+        // 重启之后直接读到上次的数据
+        rcu::ConcurrentVector<int64_t> vec(1024);
+        ASSERT_EQ(vec.attach_file(path, 100000), 0);
+        ASSERT_EQ(vec[0], 7);
+        ASSERT_EQ(vec[4999], 7);
+        ASSERT_EQ(vec[5000], 0);
+        ASSERT_EQ(vec[3000], 3000);
+        ASSERT_EQ(vec[9999], 9999);
+        vec.ensure(20000) = 1;
+        ASSERT_EQ(vec[20000], 1);
+        // 超过max_size的扩容失败，之前的数据不受影响
+        ASSERT_THROW(vec.ensure(200000), std::bad_alloc);
+        ASSERT_THROW(vec.fill_n(100000, 200000, 1), std::bad_alloc);
+        ASSERT_EQ(vec[20000], 1);
+        vec.ensure(99999) = 2;
+        ASSERT_EQ(vec[99999], 2);
+    }
+    {
+        // num_per_shard不一致
+        rcu::ConcurrentVector<int64_t> vec(2048);
+        ASSERT_EQ(vec.attach_file(path, 100000), -1);
+    }
+    {
+        // 非空的vector不能attach
+        rcu::ConcurrentVector<int64_t> vec(1024);
+        vec.reserve(10);
+        ASSERT_EQ(vec.attach_file(path, 100000), -1);
+    }
+    unlink(path.c_str());
+}
+
+// dirty位清除之后才落下的写入，标记要留到下一次checkpoint
+TEST_F(ConcurrentVectorTest, test_checkpoint_concurrent_write) {
+    std::string path = "./test_checkpoint_concurrent_write.shard";
+    unlink(path.c_str());
+    {
+        rcu::ShardFile file;
+        ASSERT_EQ(file.open(path, sizeof(int64_t), 1024, 16), 0);
+        auto* shard = reinterpret_cast<int64_t*>(file.create_shard(0));
+        file.set_shard_num(1);
+        shard[0] = 1;
+        file.mark_dirty(0);
+        // 在清除dirty和msync之间写入并重新标记
+        ASSERT_EQ(file.checkpoint([&] {
+            shard[1] = 2;
+            file.mark_dirty(0);
+        }), 1);
+        ASSERT_TRUE(file.is_dirty(0));
+        ASSERT_EQ(file.checkpoint(), 1);
+        ASSERT_FALSE(file.is_dirty(0));
+        ASSERT_EQ(file.checkpoint(), 0);
+    }
+    unlink(path.c_str());
+    {
+        // 持有Snapshot的写者已经标记过dirty，checkpoint要等它写完离开临界区才msync
+        rcu::ConcurrentVector<int64_t> vec(1024);
+        ASSERT_EQ(vec.attach_file(path, 100000), 0);
+        vec.reserve(1024);
+        std::atomic<bool> marked = {false};
+        std::atomic<bool> released = {false};
+        std::thread writer([&] {
+            auto snapshot = vec.snapshot();
+            snapshot.writable(0) = 1;
+            marked = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            snapshot.writable(1) = 2;
+            released = true;
+        });
+        while (!marked) {
+            std::this_thread::yield();
+        }
+        ASSERT_EQ(vec.checkpoint(), 1);
+        ASSERT_TRUE(released.load());
+        writer.join();
+    }
+    unlink(path.c_str());
+}
+
+TEST_F(ConcurrentVectorTest, test_versioned_snapshot) {
+    rcu::ConcurrentVector<int> vec(1024);
+    vec.fill_n(0, 4096, 1);
+    auto v1 = vec.versioned_snapshot();
+    ASSERT_TRUE(v1.valid());
+    ASSERT_EQ(v1.capacity(), 4096);
+    int* shard1 = vec._table.load()->shards[1];
+    // 只读不复制shard
+    ASSERT_EQ(vec[1500], 1);
+    ASSERT_EQ(vec.snapshot()[1500], 1);
+    ASSERT_EQ(vec._table.load()->shards[1], shard1);
+    vec.writable(1500) = 2;
+    // 只有被写的shard被复制
+    ASSERT_NE(vec._table.load()->shards[1], shard1);
+    ASSERT_EQ(vec._table.load()->shards[0], v1._data->shards[0]);
+    ASSERT_EQ(vec[1500], 2);
+    ASSERT_EQ(v1[1500], 1);
+    // 同一个版本内再次写入不会再复制
+    int* cloned = vec._table.load()->shards[1];
+    vec.writable(1501) = 3;
+    ASSERT_EQ(vec._table.load()->shards[1], cloned);
+
+    auto v2 = vec.versioned_snapshot();
+    vec.fill_n(0, 4096, 5);
+    vec.ensure(5000) = 6;
+    int sum = 0;
+    v1.for_each(0, 4096, [&](const int* begin, const int* end) {
+        for (; begin != end; ++begin) {
+            sum += *begin;
+        }
+    });
+    ASSERT_EQ(sum, 4096);
+    ASSERT_EQ(v2[1500], 2);
+    ASSERT_EQ(v2[1501], 3);
+    ASSERT_EQ(v2.capacity(), 4096);
+    ASSERT_EQ(vec[1500], 5);
+    ASSERT_EQ(vec[5000], 6);
+
+    auto copy = v1;
+    v1.reset();
+    ASSERT_EQ(copy[0], 1);
+    ASSERT_EQ(vec._shard_refs.size(), 4 + 1);
+    copy.reset();
+    v2.reset();
+    ASSERT_TRUE(vec._shard_refs.empty());
+    // 所有版本都释放之后原地写
+    int* shard0 = vec._table.load()->shards[0];
+    vec.writable(0) = 7;
+    ASSERT_EQ(vec._table.load()->shards[0], shard0);
+}
+
+TEST_F(ConcurrentVectorTest, test_versioned_snapshot_string) {
+    rcu::ConcurrentVector<std::string> vec(16);
+    vec.ensure(100) = "hello";
+    auto version = vec.versioned_snapshot();
+    vec.writable(100) = "world";
+    ASSERT_EQ(version[100], "hello");
+    ASSERT_EQ(vec[100], "world");
+}
+
+TEST_F(ConcurrentVectorTest, test_versioned_snapshot_concurrent) {
+    rcu::ConcurrentVector<int64_t> vec(256);
+    vec.fill_n(0, 100000, 0);
+    std::atomic<bool> stop = {false};
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t] {
+            for (int64_t i = 0; !stop; ++i) {
+                // 通过Snapshot写入，写入期间在读临界区内
+                auto snapshot = vec.reserved_snapshot(100000 + (t + 1) * 10000);
+                snapshot.writable(intRand(0, 99999)) = i;
+                snapshot.writable(100000 + t * 10000 + i % 10000) = i;
+            }
+        });
+    }
+    for (int i = 0; i < 100; ++i) {
+        auto version = vec.versioned_snapshot();
+        auto capacity = version.capacity();
+        int64_t sum1 = 0;
+        int64_t sum2 = 0;
+        version.for_each(0, capacity, [&](const int64_t* begin, const int64_t* end) {
+            for (; begin != end; ++begin) {
+                sum1 += *begin;
+            }
+        });
+        for (size_t k = 0; k < capacity; ++k) {
+            sum2 += version[k];
+        }
+        ASSERT_EQ(sum1, sum2);
+    }
+    stop = true;
+    for (auto& th : writers) {
+        th.join();
+    }
+    ASSERT_TRUE(vec._shard_refs.empty());
+}
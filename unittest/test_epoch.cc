@@ -0,0 +1,189 @@
+#include "gtest/gtest.h"
+#include "gflags/gflags.h"
+#include <thread>
+#include <chrono>
+#include <random>
+
+#define  DCHECK_IS_ON
+
+#define private public
+#define protected public
+#include "concurrent/epoch.h"
+#undef private
+#undef protected
+
+using namespace rcu;
+
+class EpochTest : public ::testing::Test {
+private:
+    virtual void SetUp() {
+    }
+    virtual void TearDown() {
+    }
+protected:
+};
+
+static std::atomic<int> g_deleted = {0};
+
+struct Foobar {
+    ~Foobar() {
+        g_deleted++;
+    }
+    char data[189];
+    std::string message;
+};
+
+TEST_F(EpochTest, retire_without_reader) {
+    EpochDomain domain;
+    g_deleted = 0;
+    for (int i = 0; i < 10; ++i) {
+        domain.retire(new Foobar);
+    }
+    // 没有读者，retire的时候直接释放
+    ASSERT_EQ(g_deleted, 10);
+}
+
+TEST_F(EpochTest, guard_blocks_reclaim) {
+    EpochDomain domain;
+    g_deleted = 0;
+    std::atomic<bool> in_guard = {false};
+    std::atomic<bool> leave = {false};
+    std::thread reader([&] {
+        EpochGuard guard(domain);
+        in_guard = true;
+        while (!leave) {
+            std::this_thread::yield();
+        }
+    });
+    while (!in_guard) {
+        std::this_thread::yield();
+    }
+    domain.retire(new Foobar);
+    domain.retire(new Foobar);
+    ASSERT_EQ(domain.reclaim(), 2);
+    ASSERT_EQ(g_deleted, 0);
+
+    leave = true;
+    reader.join();
+    ASSERT_EQ(domain.reclaim(), 0);
+    ASSERT_EQ(g_deleted, 2);
+}
+
+TEST_F(EpochTest, nested_guard) {
+    EpochDomain domain;
+    g_deleted = 0;
+    {
+        EpochGuard outer(domain);
+        {
+            EpochGuard inner(domain);
+            EpochGuard copy(inner);
+        }
+        domain.retire(new Foobar);
+        // 当前线程还在临界区内，不能释放
+        ASSERT_EQ(g_deleted, 0);
+    }
+    // 退出最外层临界区时释放
+    ASSERT_EQ(g_deleted, 1);
+}
+
+TEST_F(EpochTest, quiescent_state) {
+    EpochDomain domain;
+    g_deleted = 0;
+    std::atomic<int> step = {0};
+    std::thread reader([&] {
+        domain.thread_online();
+        step = 1;
+        while (step != 2) {
+            std::this_thread::yield();
+        }
+        domain.quiescent_state();
+        step = 3;
+        while (step != 4) {
+            std::this_thread::yield();
+        }
+        domain.thread_offline();
+    });
+    while (step != 1) {
+        std::this_thread::yield();
+    }
+    domain.retire(new Foobar);
+    ASSERT_EQ(g_deleted, 0);
+    step = 2;
+    while (step != 3) {
+        std::this_thread::yield();
+    }
+    // 读者已经越过了retire时的epoch
+    ASSERT_EQ(domain.reclaim(), 0);
+    ASSERT_EQ(g_deleted, 1);
+    step = 4;
+    reader.join();
+}
+
+TEST_F(EpochTest, record_reuse) {
+    EpochDomain domain;
+    for (int i = 0; i < 10; ++i) {
+        std::thread th([&] {
+            EpochGuard guard(domain);
+        });
+        th.join();
+    }
+    ASSERT_LE(domain._record_count.load(), 2);
+}
+
+TEST_F(EpochTest, synchronize) {
+    EpochDomain domain;
+    g_deleted = 0;
+    std::atomic<bool> stop = {false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            while (!stop) {
+                EpochGuard guard(domain);
+            }
+        });
+    }
+    for (int i = 0; i < 100; ++i) {
+        domain.retire(new Foobar);
+    }
+    domain.synchronize();
+    ASSERT_EQ(g_deleted, 100);
+    stop = true;
+    for (auto& th : threads) {
+        th.join();
+    }
+}
+
+// retire之后不再进入domain的线程，它的对象由别的线程的synchronize释放
+TEST_F(EpochTest, synchronize_idle_retirer) {
+    EpochDomain domain;
+    g_deleted = 0;
+    std::atomic<int> step = {0};
+    std::thread reader([&] {
+        EpochGuard guard(domain);
+        step = 1;
+        while (step != 3) {
+            std::this_thread::yield();
+        }
+    });
+    std::thread retirer([&] {
+        while (step != 1) {
+            std::this_thread::yield();
+        }
+        domain.retire(new Foobar);
+        step = 2;
+        // 一直不再调用domain，直到测试结束
+        while (step != 4) {
+            std::this_thread::yield();
+        }
+    });
+    while (step != 2) {
+        std::this_thread::yield();
+    }
+    ASSERT_EQ(g_deleted, 0);
+    step = 3;
+    reader.join();
+    domain.synchronize();
+    ASSERT_EQ(g_deleted, 1);
+    step = 4;
+    retirer.join();
+}
@@ -0,0 +1,155 @@
+#include "gtest/gtest.h"
+#include "gflags/gflags.h"
+#include <thread>
+#include <random>
+#include <vector>
+
+#define private public
+#define protected public
+#include "concurrent/lock_free_list_set.h"
+#undef private
+#undef protected
+
+using namespace rcu;
+
+class LockFreeListSetTest : public ::testing::Test {
+private:
+    virtual void SetUp() {
+    }
+    virtual void TearDown() {
+    }
+protected:
+};
+
+template <typename Set>
+std::vector<int> to_vector(Set& set) {
+    std::vector<int> result;
+    for (auto p = set._head.load(); p != nullptr; p = Set::get_unmarked(p->next.load())) {
+        result.push_back(p->element);
+    }
+    return result;
+}
+
+TEST_F(LockFreeListSetTest, basic) {
+    LockFreeListSet<int> set;
+    ASSERT_TRUE(set.empty());
+    for (int v : {3, 4, 5, 1, 2}) {
+        ASSERT_TRUE(set.add(v));
+    }
+    ASSERT_FALSE(set.add(3));
+    ASSERT_EQ(to_vector(set), std::vector<int>({1, 2, 3, 4, 5}));
+    ASSERT_TRUE(set.remove(3));
+    ASSERT_FALSE(set.remove(3));
+    ASSERT_FALSE(set.remove(100));
+    ASSERT_TRUE(set.contains(4));
+    ASSERT_FALSE(set.contains(3));
+    ASSERT_FALSE(set.contains(0));
+    ASSERT_FALSE(set.contains(6));
+    ASSERT_EQ(to_vector(set), std::vector<int>({1, 2, 4, 5}));
+    ASSERT_TRUE(set.add(3));
+    ASSERT_TRUE(set.contains(3));
+    for (int v : {1, 2, 3, 4, 5}) {
+        ASSERT_TRUE(set.remove(v));
+    }
+    ASSERT_TRUE(set.empty());
+}
+
+struct Counted {
+    Counted(int v) : value(v) { count++; }
+    Counted(const Counted& o) : value(o.value) { count++; }
+    ~Counted() { count--; }
+    bool operator<(const Counted& o) const { return value < o.value; }
+    bool operator==(const Counted& o) const { return value == o.value; }
+    int value;
+    static int count;
+};
+int Counted::count = 0;
+
+// 对象被摘除之后挂在set的cohort上，攒够阈值或者set析构时回收
+TEST_F(LockFreeListSetTest, reclaim) {
+    {
+        LockFreeListSet<Counted> set;
+        for (int i = 0; i < 1000; ++i) {
+            set.add(Counted(i));
+        }
+        for (int i = 0; i < 1000; i += 2) {
+            set.remove(Counted(i));
+        }
+        ASSERT_GE(Counted::count, 500);
+        ASSERT_LT(Counted::count, 500 + HAZPTR_COHORT_THRESHOLD * 2);
+    }
+    ASSERT_EQ(Counted::count, 0);
+}
+
+// 每个线程只写自己的key，结束之后每个key的状态是确定的
+TEST_F(LockFreeListSetTest, disjoint_writers) {
+    LockFreeListSet<int> set;
+    const int thread_num = 4;
+    const int key_num = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = t; i < key_num; i += thread_num) {
+                ASSERT_TRUE(set.add(i));
+            }
+            for (int i = t; i < key_num; i += thread_num * 2) {
+                ASSERT_TRUE(set.remove(i));
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    std::vector<int> expected;
+    for (int i = 0; i < key_num; ++i) {
+        if (i % (thread_num * 2) >= thread_num) {
+            expected.push_back(i);
+        }
+    }
+    ASSERT_EQ(to_vector(set), expected);
+}
+
+// 多个线程在同一批key上随机add/remove，成功的add和remove个数之差就是最后剩下的
+TEST_F(LockFreeListSetTest, churn) {
+    LockFreeListSet<int> set;
+    const int key_num = 64;
+    std::vector<std::atomic<int>> balance(key_num);
+    for (auto& b : balance) {
+        b = 0;
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937 generator(t);
+            for (int i = 0; i < 100000; ++i) {
+                int key = generator() % key_num;
+                int op = generator() % 3;
+                if (op == 0) {
+                    balance[key] += set.add(key) ? 1 : 0;
+                } else if (op == 1) {
+                    balance[key] -= set.remove(key) ? 1 : 0;
+                } else {
+                    set.contains(key);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    std::vector<int> expected;
+    for (int i = 0; i < key_num; ++i) {
+        ASSERT_TRUE(balance[i] == 0 || balance[i] == 1);
+        ASSERT_EQ(set.contains(i), balance[i] == 1);
+        if (balance[i] == 1) {
+            expected.push_back(i);
+        }
+    }
+    ASSERT_EQ(to_vector(set), expected);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    google::ParseCommandLineFlags(&argc, &argv, false);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,198 @@
+#include "gtest/gtest.h"
+#include "gflags/gflags.h"
+#include <thread>
+#include <chrono>
+#include <random>
+
+#define  DCHECK_IS_ON
+
+#define private public
+#define protected public
+#include "concurrent/concurrent_hashmap.h"
+#include "concurrent/urcu_policy.h"
+#undef private
+#undef protected
+
+using namespace rcu;
+
+class ReclaimPolicyTest : public ::testing::Test {
+private:
+    virtual void SetUp() {
+    }
+    virtual void TearDown() {
+    }
+protected:
+};
+
+// 存活的对象个数，node回收之后value才析构
+struct Live {
+    Live() : value(0) { count++; }
+    explicit Live(int64_t v) : value(v) { count++; }
+    Live(const Live& o) : value(o.value) { count++; }
+    Live& operator=(const Live& o) {
+        value = o.value;
+        return *this;
+    }
+    ~Live() { count--; }
+    int64_t value;
+    static std::atomic<int64_t> count;
+};
+std::atomic<int64_t> Live::count = {0};
+
+template <typename Policy>
+using ChainedMap = ConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>,
+      std::allocator<uint8_t>, 8, ConcurrentHashMapSegment, Policy>;
+template <typename Policy>
+using LiveMap = ConcurrentHashMap<int64_t, Live, std::hash<int64_t>,
+      std::allocator<uint8_t>, 8, ConcurrentHashMapSegment, Policy>;
+
+template <typename Map>
+void check_basic(Map& map) {
+    for (int64_t i = 0; i < 10000; ++i) {
+        ASSERT_TRUE(map.insert(i, i * 2).second);
+    }
+    for (int64_t i = 0; i < 10000; i += 2) {
+        map.erase(i);
+    }
+    ASSERT_EQ(map.size(), 5000);
+    for (int64_t i = 0; i < 10000; ++i) {
+        auto iter = map.find(i);
+        if (i % 2) {
+            ASSERT_EQ(*iter, i * 2);
+        } else {
+            ASSERT_TRUE(iter == map.cend());
+        }
+    }
+    int64_t count = 0;
+    for (auto iter = map.cbegin(); iter != map.cend(); ++iter) {
+        count++;
+    }
+    ASSERT_EQ(count, 5000);
+}
+
+template <typename Policy>
+void check_policy_basic() {
+    typename Policy::ThreadScope scope;
+    {
+        ChainedMap<Policy> map(8);
+        check_basic(map);
+    }
+    {
+        SwissConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, std::allocator<uint8_t>, 8, Policy> map(8);
+        check_basic(map);
+    }
+    Policy::barrier();
+}
+
+TEST_F(ReclaimPolicyTest, basic) {
+    check_policy_basic<HazptrReclaimPolicy>();
+    check_policy_basic<UrcuQsbrPolicy>();
+    check_policy_basic<UrcuMembPolicy>();
+}
+
+// 覆盖写、删除、扩容和析构换下来的对象都在barrier之后回收完
+template <typename Policy>
+void check_policy_reclaim() {
+    typename Policy::ThreadScope scope;
+    Live::count = 0;
+    {
+        LiveMap<Policy> map(8);
+        for (int64_t i = 0; i < 1000; ++i) {
+            map.insert(i, Live(i));
+        }
+        for (int64_t i = 0; i < 1000; ++i) {
+            map.insert(i, Live(i + 1));
+        }
+        for (int64_t i = 0; i < 500; ++i) {
+            map.erase(i);
+        }
+        ASSERT_EQ(map.find(600)->value, 601);
+    }
+    Policy::barrier();
+    ASSERT_EQ(Live::count.load(), 0);
+}
+
+TEST_F(ReclaimPolicyTest, reclaim) {
+    check_policy_reclaim<UrcuQsbrPolicy>();
+    check_policy_reclaim<UrcuMembPolicy>();
+}
+
+// QSBR下在线的线程两次quiescent_state之间拿到的iterator一直有效，删掉的node要等它报告静止状态之后才回收
+TEST_F(ReclaimPolicyTest, qsbr_grace_period) {
+    UrcuQsbrPolicy::ThreadScope scope;
+    Live::count = 0;
+    LiveMap<UrcuQsbrPolicy> map(8);
+    map.insert(1, Live(100));
+    {
+        auto iter = map.find(1);
+        std::thread t([&] {
+            UrcuQsbrPolicy::ThreadScope scope;
+            map.erase(1);
+        });
+        t.join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        ASSERT_EQ(Live::count.load(), 1);
+        ASSERT_EQ(iter->value, 100);
+    }
+    UrcuQsbrPolicy::quiescent_state();
+    UrcuQsbrPolicy::barrier();
+    ASSERT_EQ(Live::count.load(), 0);
+}
+
+template <typename Map, typename Policy>
+void check_multi_thread() {
+    std::unique_ptr<Map> map;
+    {
+        typename Policy::ThreadScope scope;
+        map.reset(new Map(8));
+    }
+    std::atomic<bool> bad = {false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            typename Policy::ThreadScope scope;
+            std::mt19937_64 generator(t);
+            for (int i = 0; i < 20000; ++i) {
+                int64_t key = generator() % 1000;
+                if (t == 0) {
+                    // 写线程触发扩容、覆盖写和删除
+                    if (i % 3 == 2) {
+                        map->erase(key);
+                    } else {
+                        map->insert(key, key * 3);
+                    }
+                } else {
+                    auto iter = map->find(key);
+                    if (iter != map->cend() && *iter != key * 3) {
+                        bad = true;
+                    }
+                }
+                if (i % 64 == 0) {
+                    Policy::quiescent_state();
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    ASSERT_FALSE(bad.load());
+    typename Policy::ThreadScope scope;
+    map.reset();
+    Policy::barrier();
+}
+
+TEST_F(ReclaimPolicyTest, multi_thread) {
+    check_multi_thread<ChainedMap<UrcuQsbrPolicy>, UrcuQsbrPolicy>();
+    check_multi_thread<ChainedMap<UrcuMembPolicy>, UrcuMembPolicy>();
+    check_multi_thread<StripedConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>,
+        std::allocator<uint8_t>, 8, UrcuMembPolicy>, UrcuMembPolicy>();
+    check_multi_thread<SwissConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>,
+        std::allocator<uint8_t>, 8, UrcuQsbrPolicy>, UrcuQsbrPolicy>();
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    google::ParseCommandLineFlags(&argc, &argv, false);
+    return RUN_ALL_TESTS();
+}
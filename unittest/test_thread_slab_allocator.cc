@@ -0,0 +1,142 @@
+#include "gtest/gtest.h"
+#include "gflags/gflags.h"
+#include <thread>
+#include <random>
+#include <set>
+#include <string>
+
+#define  DCHECK_IS_ON
+
+#define private public
+#define protected public
+#include "concurrent/thread_slab_allocator.h"
+#include "concurrent/concurrent_hashmap.h"
+#undef private
+#undef protected
+
+using namespace rcu;
+
+class ThreadSlabAllocatorTest : public ::testing::Test {
+private:
+    virtual void SetUp() {
+    }
+    virtual void TearDown() {
+    }
+};
+
+TEST_F(ThreadSlabAllocatorTest, size_class) {
+    ASSERT_EQ(slab::size_class(0), 0);
+    ASSERT_EQ(slab::size_class(1), 0);
+    ASSERT_EQ(slab::size_class(16), 0);
+    ASSERT_EQ(slab::size_class(17), 1);
+    ASSERT_EQ(slab::size_class(SLAB_ALLOCATOR_MAX_SIZE), slab::NUM_CLASSES - 1);
+    ASSERT_EQ(slab::class_size(slab::size_class(40)), 48);
+}
+
+TEST_F(ThreadSlabAllocatorTest, reuse_in_same_thread) {
+    ThreadSlabAllocator<uint8_t> allocator;
+    std::set<uint8_t*> ptrs;
+    for (int i = 0; i < 100; ++i) {
+        uint8_t* p = allocator.allocate(40);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(p) % slab::ALIGN, 0);
+        memset(p, 0xab, 40);
+        ASSERT_TRUE(ptrs.insert(p).second);
+    }
+    for (auto* p : ptrs) {
+        allocator.deallocate(p, 40);
+    }
+    // 释放后再分配，拿回的是刚释放的对象
+    for (int i = 0; i < 100; ++i) {
+        uint8_t* p = allocator.allocate(40);
+        ASSERT_TRUE(ptrs.count(p));
+        allocator.deallocate(p, 40);
+    }
+}
+
+TEST_F(ThreadSlabAllocatorTest, large_and_zeroed) {
+    ThreadSlabAllocator<uint8_t> allocator;
+    uint8_t* big = allocator.allocate_zeroed(1 << 20);
+    for (int i = 0; i < (1 << 20); i += 4096) {
+        ASSERT_EQ(big[i], 0);
+    }
+    allocator.deallocate(big, 1 << 20);
+
+    uint8_t* small = allocator.allocate(64);
+    memset(small, 0xff, 64);
+    allocator.deallocate(small, 64);
+    small = allocator.allocate_zeroed(64);
+    for (int i = 0; i < 64; ++i) {
+        ASSERT_EQ(small[i], 0);
+    }
+    allocator.deallocate(small, 64);
+}
+
+TEST_F(ThreadSlabAllocatorTest, cross_thread_free) {
+    ThreadSlabAllocator<uint8_t> allocator;
+    std::vector<uint8_t*> ptrs;
+    for (int i = 0; i < 10000; ++i) {
+        ptrs.push_back(allocator.allocate(32));
+    }
+    size_t slabs = slab::SlabDepot::instance().slab_count();
+    // 另一个线程释放，线程退出时还给depot
+    std::thread t([&] {
+        for (auto* p : ptrs) {
+            allocator.deallocate(p, 32);
+        }
+    });
+    t.join();
+    // depot里的对象可以被重新分配，不需要切新的slab
+    for (int i = 0; i < 10000; ++i) {
+        ptrs[i] = allocator.allocate(32);
+    }
+    ASSERT_EQ(slab::SlabDepot::instance().slab_count(), slabs);
+    for (auto* p : ptrs) {
+        allocator.deallocate(p, 32);
+    }
+}
+
+TEST_F(ThreadSlabAllocatorTest, hashmap_churn) {
+    using Map = ConcurrentHashMap<int64_t, std::string, std::hash<int64_t>, ThreadSlabAllocator<uint8_t>>;
+    Map map(1024);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937_64 generator(t);
+            for (int i = 0; i < 50000; ++i) {
+                int64_t key = generator() % 5000;
+                if (i % 2 == 0) {
+                    map.upsert(key, [&](std::string& value) { value = std::to_string(key); });
+                } else {
+                    map.erase(key);
+                }
+                auto iter = map.find(key);
+                if (iter != map.cend()) {
+                    ASSERT_EQ(*iter, std::to_string(key));
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    for (int64_t key = 0; key < 5000; ++key) {
+        map.upsert(key, [&](std::string& value) { value = std::to_string(key); });
+    }
+    ASSERT_EQ(map.size(), 5000);
+    for (int64_t key = 0; key < 5000; ++key) {
+        ASSERT_EQ(*map.find(key), std::to_string(key));
+    }
+}
+
+TEST_F(ThreadSlabAllocatorTest, swiss_hashmap) {
+    using Map = SwissConcurrentHashMap<int64_t, int64_t, std::hash<int64_t>, ThreadSlabAllocator<uint8_t>>;
+    Map map(8);
+    for (int64_t key = 0; key < 10000; ++key) {
+        ASSERT_TRUE(map.emplace(key, key * 2).second);
+    }
+    for (int64_t key = 0; key < 10000; key += 2) {
+        map.erase(key);
+    }
+    ASSERT_EQ(map.size(), 5000);
+    ASSERT_EQ(*map.find(1), 2);
+}